@@ -0,0 +1,640 @@
+/*
+ * Filename:         cfs_bench.c
+ * Description:      Latency histograms of cortxfs metadata operations
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This harness runs the metadata operations of getattr_profiling.c and
+ * readdir_profiling.c through the cortxfs API, so it measures whatever
+ * NSAL and DSAL backends the cortxfs config selects. For every file
+ * count and thread count of the sweep, each cycle:
+ * - makes a directory under the root and creates N files in it per thread
+ * - looks up every file by name
+ * - gets the attributes of every file
+ * - makes a handle of every file, as each NFS request does
+ * - sets the mtime of every file through a handle, as NFS SETATTR does
+ * - lists the directory
+ * - unlinks every file and removes the directory
+ * The first -w cycles warm up caches and are not recorded, the next -r
+ * cycles are. -o picks the operations to run and report; create and
+ * unlink run in every cycle, since the others need the files, but are
+ * only reported when picked.
+ *
+ * With -s all threads work in one directory, so creates and unlinks
+ * update the same parent and readdir lists the files of every thread;
+ * otherwise each thread has its own directory and files. Phases are
+ * bracketed by barriers, so all threads run the same operation at once.
+ *
+ * Every call is timed with CLOCK_MONOTONIC into a log-linear histogram
+ * with about 1.6% relative error (common/perf_hist.h). One row is printed
+ * per operation and sweep point with throughput, speedup over the single
+ * thread row and per-call latency percentiles, as CSV or JSON lines.
+ *
+ * To tell where threads contend, each row also has the share of the wall
+ * time the threads spent on a CPU, from CLOCK_THREAD_CPUTIME_ID, and the
+ * voluntary and involuntary context switches per call, from
+ * getrusage(RUSAGE_THREAD), both taken around each phase. As threads are added:
+ * - latency up, CPU share down, switches per call flat: calls wait for KV
+ *   ops which queue in the client or the backend
+ * - switches per call up: threads sleep on locks, such as a global lock or
+ *   the lock of the shared parent directory
+ * - CPU time per call up with few switches: spinning and shared cache
+ *   lines, as in handle allocation; compare fh_from_ino with getattr,
+ *   which reads the same record without making a handle
+ *
+ * Build as the profiling experiments, against cortxfs and its ut helpers,
+ * together with common/bench.c and common/perf_hist.c.
+ *
+ * Example:
+ *   cfs_bench -n 1000 -t 1,2,4,8,16,32,64 -r 3 -o lookup,fh_from_ino
+ */
+
+/* RUSAGE_THREAD */
+#define _GNU_SOURCE
+#include "ut_cortxfs_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "common/bench.h"
+
+#define MAX_FILENAME_LENGTH 32
+#define BENCH_DIR "cfs_bench"
+
+enum bench_op {
+	BENCH_CREATE,
+	BENCH_LOOKUP,
+	BENCH_GETATTR,
+	BENCH_FH,
+	BENCH_SETATTR,
+	BENCH_READDIR,
+	BENCH_UNLINK,
+	BENCH_OP_NR,
+};
+
+static const char *bench_op_name[BENCH_OP_NR] = {
+	[BENCH_CREATE] = "create",
+	[BENCH_LOOKUP] = "lookup",
+	[BENCH_GETATTR] = "getattr",
+	[BENCH_FH] = "fh_from_ino",
+	[BENCH_SETATTR] = "setattr",
+	[BENCH_READDIR] = "readdir",
+	[BENCH_UNLINK] = "unlink",
+};
+
+struct bench_cfg {
+	struct bench_sweep files;
+	struct bench_sweep threads;
+	int warmup;
+	int reps;
+	/* Bit per enum bench_op to report */
+	unsigned int ops;
+	bool shared;
+	const char *conf;
+	bool json;
+};
+
+/* ut_cfs_fs_setup() takes a state whose first member is the params */
+struct bench_env {
+	struct ut_cfs_params cfs;
+};
+
+/* Thread CPU time and context switches over the phases of one op */
+struct bench_cpu {
+	uint64_t cpu_ns;
+	uint64_t vcsw;
+	uint64_t ivcsw;
+};
+
+/* Parameters of one point in the sweep. */
+struct bench_run {
+	struct bench_env *env;
+	int files;
+	int threads;
+	bool shared;
+	int warmup;
+	int reps;
+	/* Bit per enum bench_op to run */
+	unsigned int ops;
+	struct bench_clock clock;
+	/* Directory of all threads with -s */
+	cfs_ino_t dir_ino;
+};
+
+struct bench_thread {
+	int index;
+	struct bench_run *run;
+	char dir_name[MAX_FILENAME_LENGTH];
+	cfs_ino_t dir_ino;
+	char **names;
+	cfs_ino_t *inos;
+	uint64_t cpu_ns;
+	struct rusage ru;
+	struct bench_stats stats[BENCH_OP_NR];
+	struct bench_cpu cpu[BENCH_OP_NR];
+};
+
+struct readdir_ctx {
+	int count;
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+"Usage: %s [-n files] [-t threads] [-s] [-w warmup] [-r reps] [-o ops]\n"
+"          [-C conf] [-f csv|json]\n"
+"  -n  files per thread, default 1000\n"
+"  -t  threads, default 1\n"
+"  -s  all threads work in one directory instead of one each\n"
+"  -w  cycles run before the recorded ones, default 1\n"
+"  -r  cycles merged into each result row, default 3\n"
+"  -o  comma separated operations to run and report, default all of\n"
+"      create,lookup,getattr,fh_from_ino,setattr,readdir,unlink\n"
+"  -C  cortxfs config, default %s\n"
+"  -f  output format, default csv\n"
+"  -n and -t take comma separated lists which are swept.\n",
+		prog, CONF_FILE);
+}
+
+static int parse_args(int argc, char **argv, struct bench_cfg *cfg)
+{
+	int opt;
+	int rc = 0;
+
+	memset(cfg, 0, sizeof(*cfg));
+	bench_sweep_parse("1000", &cfg->files);
+	bench_sweep_parse("1", &cfg->threads);
+	cfg->warmup = 1;
+	cfg->reps = 3;
+	cfg->ops = (1U << BENCH_OP_NR) - 1;
+	cfg->conf = CONF_FILE;
+
+	while (rc == 0 &&
+	       (opt = getopt(argc, argv, "n:t:sw:r:o:C:f:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			rc = bench_sweep_parse(optarg, &cfg->files);
+			break;
+		case 't':
+			rc = bench_sweep_parse(optarg, &cfg->threads);
+			break;
+		case 's':
+			cfg->shared = true;
+			break;
+		case 'w':
+			cfg->warmup = atoi(optarg);
+			break;
+		case 'r':
+			cfg->reps = atoi(optarg);
+			break;
+		case 'o':
+			rc = bench_ops_parse(optarg, bench_op_name, BENCH_OP_NR,
+					     &cfg->ops);
+			break;
+		case 'C':
+			cfg->conf = optarg;
+			break;
+		case 'f':
+			if (strcmp(optarg, "json") == 0)
+				cfg->json = true;
+			else if (strcmp(optarg, "csv") != 0)
+				rc = -EINVAL;
+			break;
+		default:
+			rc = -EINVAL;
+			break;
+		}
+	}
+
+	if (rc == 0 && bench_sweep_max(&cfg->threads) > BENCH_THREADS_MAX)
+		rc = -EINVAL;
+
+	if (rc == 0 && (cfg->reps <= 0 || cfg->warmup < 0))
+		rc = -EINVAL;
+
+	return rc;
+}
+
+static bool bench_readdir_cb(void *ctx, const char *name,
+			     const cfs_ino_t *ino)
+{
+	struct readdir_ctx *readdir_ctx = ctx;
+
+	(void)name;
+	(void)ino;
+	readdir_ctx->count++;
+	return true;
+}
+
+static uint64_t thread_cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Phases also take the CPU time and context switches of each thread. */
+static void phase_begin(struct bench_thread *bt)
+{
+	bench_phase_begin(&bt->run->clock, bt->index);
+	bt->cpu_ns = thread_cpu_ns();
+	getrusage(RUSAGE_THREAD, &bt->ru);
+}
+
+static void phase_end(struct bench_thread *bt, enum bench_op op)
+{
+	struct bench_cpu *cpu = &bt->cpu[op];
+	uint64_t cpu_ns = thread_cpu_ns();
+	struct rusage ru;
+
+	getrusage(RUSAGE_THREAD, &ru);
+	bench_phase_end(&bt->run->clock, bt->index, op);
+
+	cpu->cpu_ns += cpu_ns - bt->cpu_ns;
+	cpu->vcsw += ru.ru_nvcsw - bt->ru.ru_nvcsw;
+	cpu->ivcsw += ru.ru_nivcsw - bt->ru.ru_nivcsw;
+}
+
+/* Drops what the warmup cycles recorded. */
+static void bench_thread_reset(struct bench_thread *bt)
+{
+	int op;
+
+	for (op = 0; op < BENCH_OP_NR; op++)
+		bench_stats_init(&bt->stats[op]);
+	memset(bt->cpu, 0, sizeof(bt->cpu));
+	if (bt->index == 0)
+		memset(bt->run->clock.elapsed, 0,
+		       sizeof(bt->run->clock.elapsed));
+}
+
+/* Makes the directory of the thread, or with -s thread 0 makes the one
+ * shared by all, before the create phase.
+ */
+static int dir_make(struct bench_thread *bt)
+{
+	struct bench_run *run = bt->run;
+	struct ut_cfs_params *cfs = &run->env->cfs;
+	int rc = 0;
+
+	if (!run->shared || bt->index == 0) {
+		rc = cfs_mkdir(cfs->cfs_fs, &cfs->current_inode, bt->dir_name,
+			       &cfs->cred, 0755, &bt->dir_ino);
+		if (rc)
+			fprintf(stderr, "error(%d): cfs_mkdir %s\n", rc,
+				bt->dir_name);
+		if (run->shared)
+			run->dir_ino = bt->dir_ino;
+	}
+
+	pthread_barrier_wait(&run->clock.barrier);
+	if (run->shared)
+		bt->dir_ino = run->dir_ino;
+	return rc;
+}
+
+static int dir_remove(struct bench_thread *bt)
+{
+	struct bench_run *run = bt->run;
+	struct ut_cfs_params *cfs = &run->env->cfs;
+	int rc = 0;
+
+	pthread_barrier_wait(&run->clock.barrier);
+	if (!run->shared || bt->index == 0) {
+		rc = cfs_rmdir(cfs->cfs_fs, &cfs->cred, &cfs->current_inode,
+			       bt->dir_name);
+		if (rc)
+			fprintf(stderr, "error(%d): cfs_rmdir %s\n", rc,
+				bt->dir_name);
+	}
+
+	return rc;
+}
+
+static void bench_phase(struct bench_thread *bt, enum bench_op op)
+{
+	struct bench_run *run = bt->run;
+	struct ut_cfs_params *cfs = &run->env->cfs;
+	struct bench_stats *stats = &bt->stats[op];
+	struct readdir_ctx readdir_ctx;
+	struct cfs_fh *fh;
+	struct stat stat_in;
+	struct stat st;
+	cfs_ino_t ino;
+	uint64_t t0;
+	int expect;
+	int rc, i;
+
+	switch (op) {
+	case BENCH_CREATE:
+		for (i = 0; i < run->files; i++) {
+			t0 = perf_now_ns();
+			rc = cfs_creat(cfs->cfs_fs, &cfs->cred, &bt->dir_ino,
+				       bt->names[i], 0644, &bt->inos[i]);
+			bench_record(stats, 1, rc, t0);
+			if (rc)
+				bt->inos[i] = 0LL;
+		}
+		break;
+	case BENCH_LOOKUP:
+		for (i = 0; i < run->files; i++) {
+			t0 = perf_now_ns();
+			rc = cfs_lookup(cfs->cfs_fs, &cfs->cred, &bt->dir_ino,
+					bt->names[i], &ino);
+			if (rc == 0 && ino != bt->inos[i])
+				rc = -EIO;
+			bench_record(stats, 1, rc, t0);
+		}
+		break;
+	case BENCH_GETATTR:
+		for (i = 0; i < run->files; i++) {
+			t0 = perf_now_ns();
+			rc = cfs_getattr(cfs->cfs_fs, &cfs->cred, &bt->inos[i],
+					 &st);
+			bench_record(stats, 1, rc, t0);
+		}
+		break;
+	case BENCH_FH:
+		for (i = 0; i < run->files; i++) {
+			t0 = perf_now_ns();
+			rc = cfs_fh_from_ino(cfs->cfs_fs, &bt->inos[i], &fh);
+			if (rc == 0)
+				cfs_fh_destroy(fh);
+			bench_record(stats, 1, rc, t0);
+		}
+		break;
+	case BENCH_SETATTR:
+		memset(&stat_in, 0, sizeof(stat_in));
+		clock_gettime(CLOCK_REALTIME, &stat_in.st_mtim);
+		for (i = 0; i < run->files; i++) {
+			t0 = perf_now_ns();
+			rc = cfs_fh_from_ino(cfs->cfs_fs, &bt->inos[i], &fh);
+			if (rc == 0) {
+				rc = cfs_setattr(fh, &cfs->cred, &stat_in,
+						 STAT_MTIME_SET);
+				cfs_fh_destroy(fh);
+			}
+			bench_record(stats, 1, rc, t0);
+		}
+		break;
+	case BENCH_READDIR:
+		expect = run->shared ? run->files * run->threads : run->files;
+		readdir_ctx.count = 0;
+		t0 = perf_now_ns();
+		rc = cfs_readdir(cfs->cfs_fs, &cfs->cred, &bt->dir_ino,
+				 bench_readdir_cb, &readdir_ctx);
+		if (rc == 0 && readdir_ctx.count != expect)
+			rc = -EIO;
+		bench_record(stats, readdir_ctx.count, rc, t0);
+		break;
+	case BENCH_UNLINK:
+		for (i = 0; i < run->files; i++) {
+			t0 = perf_now_ns();
+			rc = cfs_unlink(cfs->cfs_fs, &cfs->cred, &bt->dir_ino,
+					&bt->inos[i], bt->names[i]);
+			bench_record(stats, 1, rc, t0);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static void *bench_thread_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	struct bench_run *run = bt->run;
+	int cycle, op, rc, i;
+
+	bt->names = calloc(run->files, sizeof(*bt->names));
+	bt->inos = calloc(run->files, sizeof(*bt->inos));
+	if (bt->names == NULL || bt->inos == NULL) {
+		fprintf(stderr, "thread %d: out of memory\n", bt->index);
+		exit(-ENOMEM);
+	}
+
+	for (i = 0; i < run->files; i++) {
+		bt->names[i] = malloc(MAX_FILENAME_LENGTH);
+		if (bt->names[i] == NULL) {
+			fprintf(stderr, "thread %d: out of memory\n",
+				bt->index);
+			exit(-ENOMEM);
+		}
+		snprintf(bt->names[i], MAX_FILENAME_LENGTH, "t%d.f%d",
+			 bt->index, i);
+	}
+	snprintf(bt->dir_name, sizeof(bt->dir_name), "%s.%d", BENCH_DIR,
+		 run->shared ? 0 : bt->index);
+
+	for (cycle = 0; cycle < run->warmup + run->reps; cycle++) {
+		if (cycle == run->warmup)
+			bench_thread_reset(bt);
+		/* A failed mkdir shows as errors of every phase */
+		dir_make(bt);
+		for (op = 0; op < BENCH_OP_NR; op++) {
+			if (!(run->ops & (1U << op)))
+				continue;
+			phase_begin(bt);
+			bench_phase(bt, op);
+			phase_end(bt, op);
+		}
+		rc = dir_remove(bt);
+		if (rc)
+			exit(rc);
+	}
+
+	for (i = 0; i < run->files; i++)
+		free(bt->names[i]);
+	free(bt->names);
+	free(bt->inos);
+	return NULL;
+}
+
+static void print_row(const struct bench_cfg *cfg, const struct bench_run *run,
+		      enum bench_op op, const struct bench_stats *stats,
+		      const struct bench_cpu *cpu, double rate,
+		      double base_rate)
+{
+	double wall = (double)run->clock.elapsed[op] * run->threads;
+	double calls = stats->hist.count ? stats->hist.count : 1;
+	struct bench_row row;
+
+	bench_row_init(&row, cfg->json);
+	bench_row_str(&row, "op", bench_op_name[op]);
+	bench_row_int(&row, "files", run->files);
+	bench_row_int(&row, "threads", run->threads);
+	bench_row_int(&row, "shared", run->shared);
+	bench_row_int(&row, "reps", run->reps);
+	bench_row_stats(&row, stats, run->clock.elapsed[op]);
+	bench_row_num(&row, "speedup", base_rate > 0 ? rate / base_rate : 0,
+		      2);
+	bench_row_num(&row, "cpu_pct",
+		      wall > 0 ? 100.0 * cpu->cpu_ns / wall : 0, 1);
+	bench_row_num(&row, "vcsw_per_call", cpu->vcsw / calls, 3);
+	bench_row_num(&row, "ivcsw_per_call", cpu->ivcsw / calls, 3);
+	bench_row_int(&row, "errors", stats->errors);
+	bench_row_print(&row);
+}
+
+/* Runs one sweep point. @base_rate holds the rate of each op with one
+ * thread, for the speedup column; a single thread run sets it.
+ */
+static int bench_run(const struct bench_cfg *cfg, struct bench_run *run,
+		     double *base_rate)
+{
+	struct bench_thread *bt;
+	struct bench_stats *stats;
+	struct bench_cpu cpu;
+	uint64_t elapsed;
+	double rate;
+	int rc = 0;
+	int op, i;
+
+	bt = calloc(run->threads, sizeof(*bt));
+	stats = malloc(sizeof(*stats));
+	if (bt == NULL || stats == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	bench_clock_init(&run->clock, run->threads);
+
+	for (i = 0; i < run->threads; i++) {
+		bt[i].index = i;
+		bt[i].run = run;
+	}
+
+	rc = bench_threads_run(bt, sizeof(*bt), run->threads, bench_thread_fn);
+	bench_clock_fini(&run->clock);
+	if (rc)
+		goto out;
+
+	for (op = 0; op < BENCH_OP_NR; op++) {
+		bench_stats_init(stats);
+		memset(&cpu, 0, sizeof(cpu));
+		for (i = 0; i < run->threads; i++) {
+			bench_stats_merge(stats, &bt[i].stats[op]);
+			cpu.cpu_ns += bt[i].cpu[op].cpu_ns;
+			cpu.vcsw += bt[i].cpu[op].vcsw;
+			cpu.ivcsw += bt[i].cpu[op].ivcsw;
+		}
+
+		elapsed = run->clock.elapsed[op];
+		rate = elapsed ? stats->items / (elapsed / 1e9) : 0;
+		if (run->threads == 1)
+			base_rate[op] = rate;
+		if (cfg->ops & (1U << op))
+			print_row(cfg, run, op, stats, &cpu, rate,
+				  base_rate[op]);
+	}
+
+out:
+	free(stats);
+	free(bt);
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_cfg cfg;
+	struct bench_env *env;
+	struct bench_run run;
+	double base_rate[BENCH_OP_NR];
+	char *test_log = "/var/log/cortx/test/ut/ut_cortxfs.log";
+	void *state;
+	int rc, n, t;
+
+	if (parse_args(argc, argv, &cfg) != 0) {
+		usage(basename(argv[0]));
+		return -1;
+	}
+
+	rc = ut_load_config((char *)cfg.conf);
+	if (rc != 0) {
+		fprintf(stderr, "ut_load_config: err = %d\n", rc);
+		return rc;
+	}
+
+	test_log = ut_get_config("cortxfs", "log_path", test_log);
+
+	rc = ut_init(test_log);
+	if (rc != 0) {
+		fprintf(stderr, "ut_init failed, log path=%s, rc=%d.\n",
+			test_log, rc);
+		goto out;
+	}
+
+	env = calloc(1, sizeof(*env));
+	if (env == NULL) {
+		rc = -ENOMEM;
+		goto fini;
+	}
+
+	state = env;
+	rc = ut_cfs_fs_setup(&state);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): ut_cfs_fs_setup\n", rc);
+		goto free_env;
+	}
+
+	for (n = 0; n < cfg.files.nr; n++) {
+		memset(base_rate, 0, sizeof(base_rate));
+		for (t = 0; t < cfg.threads.nr; t++) {
+			memset(&run, 0, sizeof(run));
+			run.env = env;
+			run.files = cfg.files.val[n];
+			run.threads = cfg.threads.val[t];
+			run.shared = cfg.shared;
+			run.warmup = cfg.warmup;
+			run.reps = cfg.reps;
+			/* The other phases need the files */
+			run.ops = cfg.ops | 1U << BENCH_CREATE |
+				  1U << BENCH_UNLINK;
+
+			rc = bench_run(&cfg, &run, base_rate);
+			if (rc != 0)
+				goto teardown;
+		}
+	}
+
+teardown:
+	ut_cfs_fs_teardown(&state);
+free_env:
+	free(env);
+fini:
+	ut_fini();
+out:
+	free(test_log);
+
+	if (rc == 0)
+		fprintf(stderr, "%s success\n", basename(argv[0]));
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
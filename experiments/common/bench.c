@@ -0,0 +1,261 @@
+/*
+ * Filename:         bench.c
+ * Description:      Sweeps, phases and result rows shared by the benchmarks
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+/* A process prints one table, so one header. */
+static bool bench_header_done;
+
+int bench_sweep_parse(const char *arg, struct bench_sweep *sweep)
+{
+	char *copy = strdup(arg);
+	char *save = NULL;
+	char *tok;
+	char *end;
+
+	if (copy == NULL)
+		return -ENOMEM;
+
+	sweep->nr = 0;
+	for (tok = strtok_r(copy, ",", &save); tok != NULL;
+	     tok = strtok_r(NULL, ",", &save)) {
+		if (sweep->nr == BENCH_SWEEP_MAX)
+			goto err;
+		sweep->val[sweep->nr] = strtol(tok, &end, 0);
+		if (*end != '\0' || sweep->val[sweep->nr] <= 0)
+			goto err;
+		sweep->nr++;
+	}
+
+	free(copy);
+	return sweep->nr > 0 ? 0 : -EINVAL;
+err:
+	free(copy);
+	return -EINVAL;
+}
+
+long bench_sweep_max(const struct bench_sweep *sweep)
+{
+	long max = 0;
+	int i;
+
+	for (i = 0; i < sweep->nr; i++)
+		if (sweep->val[i] > max)
+			max = sweep->val[i];
+
+	return max;
+}
+
+int bench_ops_parse(const char *arg, const char *const *names, int nr,
+		    unsigned int *ops)
+{
+	char *copy = strdup(arg);
+	char *save = NULL;
+	char *tok;
+	int op;
+
+	if (copy == NULL)
+		return -ENOMEM;
+
+	*ops = 0;
+	for (tok = strtok_r(copy, ",", &save); tok != NULL;
+	     tok = strtok_r(NULL, ",", &save)) {
+		for (op = 0; op < nr; op++)
+			if (strcmp(tok, names[op]) == 0)
+				break;
+		if (op == nr || op >= BENCH_OPS_MAX) {
+			free(copy);
+			return -EINVAL;
+		}
+		*ops |= 1U << op;
+	}
+
+	free(copy);
+	return *ops != 0 ? 0 : -EINVAL;
+}
+
+void bench_stats_init(struct bench_stats *stats)
+{
+	perf_hist_init(&stats->hist);
+	stats->items = 0;
+	stats->errors = 0;
+}
+
+void bench_stats_merge(struct bench_stats *dst, const struct bench_stats *src)
+{
+	perf_hist_merge(&dst->hist, &src->hist);
+	dst->items += src->items;
+	dst->errors += src->errors;
+}
+
+void bench_record(struct bench_stats *stats, int items, int rc, uint64_t t0)
+{
+	perf_hist_record(&stats->hist, perf_now_ns() - t0);
+	stats->items += items;
+	if (rc)
+		stats->errors++;
+}
+
+void bench_clock_init(struct bench_clock *clock, int threads)
+{
+	memset(clock, 0, sizeof(*clock));
+	pthread_barrier_init(&clock->barrier, NULL, threads);
+}
+
+void bench_clock_fini(struct bench_clock *clock)
+{
+	pthread_barrier_destroy(&clock->barrier);
+}
+
+void bench_phase_begin(struct bench_clock *clock, int index)
+{
+	pthread_barrier_wait(&clock->barrier);
+	if (index == 0)
+		clock->start = perf_now_ns();
+}
+
+void bench_phase_end(struct bench_clock *clock, int index, int op)
+{
+	pthread_barrier_wait(&clock->barrier);
+	if (index == 0)
+		clock->elapsed[op] += perf_now_ns() - clock->start;
+}
+
+int bench_threads_run(void *threads, size_t size, int nr,
+		      void *(*fn)(void *))
+{
+	pthread_t *tids;
+	int rc, i;
+
+	tids = calloc(nr, sizeof(*tids));
+	if (tids == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		rc = pthread_create(&tids[i], NULL, fn,
+				    (char *)threads + i * size);
+		if (rc) {
+			fprintf(stderr, "error(%d): pthread_create\n", rc);
+			exit(-rc);
+		}
+	}
+
+	for (i = 0; i < nr; i++)
+		pthread_join(tids[i], NULL);
+
+	free(tids);
+	return 0;
+}
+
+void bench_row_init(struct bench_row *row, bool json)
+{
+	row->json = json;
+	row->nr = 0;
+	row->keys[0] = '\0';
+	row->vals[0] = '\0';
+}
+
+static void bench_row_add(struct bench_row *row, const char *key,
+			  const char *val, bool quote)
+{
+	size_t klen = strlen(row->keys);
+	size_t vlen = strlen(row->vals);
+	const char *sep = row->nr > 0 ? "," : "";
+	const char *q = quote ? "\"" : "";
+
+	if (row->json) {
+		snprintf(row->vals + vlen, sizeof(row->vals) - vlen,
+			 "%s\"%s\":%s%s%s", sep, key, q, val, q);
+	} else {
+		snprintf(row->keys + klen, sizeof(row->keys) - klen, "%s%s",
+			 sep, key);
+		snprintf(row->vals + vlen, sizeof(row->vals) - vlen, "%s%s",
+			 sep, val);
+	}
+	row->nr++;
+}
+
+void bench_row_str(struct bench_row *row, const char *key, const char *val)
+{
+	bench_row_add(row, key, val, true);
+}
+
+void bench_row_int(struct bench_row *row, const char *key, long long val)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%lld", val);
+	bench_row_add(row, key, buf, false);
+}
+
+void bench_row_num(struct bench_row *row, const char *key, double val,
+		   int prec)
+{
+	char buf[64];
+
+	snprintf(buf, sizeof(buf), "%.*f", prec, val);
+	bench_row_add(row, key, buf, false);
+}
+
+void bench_row_stats(struct bench_row *row, const struct bench_stats *stats,
+		     uint64_t elapsed)
+{
+	const struct perf_hist *hist = &stats->hist;
+	double secs = elapsed / 1e9;
+	double rate = secs > 0 ? stats->items / secs : 0;
+	double mean = hist->count ? (double)hist->sum / hist->count : 0;
+
+	bench_row_int(row, "calls", hist->count);
+	bench_row_int(row, "items", stats->items);
+	bench_row_num(row, "elapsed_us", elapsed / 1e3, 3);
+	bench_row_num(row, "items_per_sec", rate, 1);
+	bench_row_num(row, "mean_us", mean / 1e3, 3);
+	bench_row_num(row, "p50_us", perf_hist_percentile(hist, 50) / 1e3, 3);
+	bench_row_num(row, "p99_us", perf_hist_percentile(hist, 99) / 1e3, 3);
+	bench_row_num(row, "p999_us",
+		      perf_hist_percentile(hist, 99.9) / 1e3, 3);
+	bench_row_num(row, "max_us", hist->max / 1e3, 3);
+}
+
+void bench_row_print(struct bench_row *row)
+{
+	if (row->json) {
+		printf("{%s}\n", row->vals);
+	} else {
+		if (!bench_header_done)
+			printf("%s\n", row->keys);
+		bench_header_done = true;
+		printf("%s\n", row->vals);
+	}
+	fflush(stdout);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,106 @@
+/*
+ * Filename:         bench.h
+ * Description:      Sweeps, phases and result rows shared by the benchmarks
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "perf_hist.h"
+
+#define BENCH_SWEEP_MAX 16
+#define BENCH_THREADS_MAX 256
+/* Phases of a benchmark, one bit each in an ops mask */
+#define BENCH_OPS_MAX 32
+#define BENCH_ROW_LEN 1024
+
+/* Values of a parameter taken from a comma separated list, one run each. */
+struct bench_sweep {
+	long val[BENCH_SWEEP_MAX];
+	int nr;
+};
+
+int bench_sweep_parse(const char *arg, struct bench_sweep *sweep);
+long bench_sweep_max(const struct bench_sweep *sweep);
+
+/* Sets a bit in @ops for each name of the comma separated @arg, its index
+ * in @names.
+ */
+int bench_ops_parse(const char *arg, const char *const *names, int nr,
+		    unsigned int *ops);
+
+/* Calls of one phase, per thread or merged over the threads of a run. */
+struct bench_stats {
+	struct perf_hist hist;
+	uint64_t items;
+	uint64_t errors;
+};
+
+void bench_stats_init(struct bench_stats *stats);
+void bench_stats_merge(struct bench_stats *dst, const struct bench_stats *src);
+
+/* Records a call started at @t0 which covered @items and returned @rc. */
+void bench_record(struct bench_stats *stats, int items, int rc, uint64_t t0);
+
+/* Phases are bracketed by barriers and timed by thread 0, so the elapsed
+ * time of a phase runs from all threads entering it to the last one leaving.
+ */
+struct bench_clock {
+	pthread_barrier_t barrier;
+	uint64_t start;
+	uint64_t elapsed[BENCH_OPS_MAX];
+};
+
+void bench_clock_init(struct bench_clock *clock, int threads);
+void bench_clock_fini(struct bench_clock *clock);
+void bench_phase_begin(struct bench_clock *clock, int index);
+void bench_phase_end(struct bench_clock *clock, int index, int op);
+
+/* Runs @fn on each of the @nr thread states at @threads, @size bytes
+ * apart, and waits for all of them.
+ */
+int bench_threads_run(void *threads, size_t size, int nr,
+		      void *(*fn)(void *));
+
+/* One result row, printed as CSV, with a header line before the first
+ * row, or as a JSON line. Columns are added in order.
+ */
+struct bench_row {
+	bool json;
+	int nr;
+	char keys[BENCH_ROW_LEN];
+	char vals[BENCH_ROW_LEN];
+};
+
+void bench_row_init(struct bench_row *row, bool json);
+void bench_row_str(struct bench_row *row, const char *key, const char *val);
+void bench_row_int(struct bench_row *row, const char *key, long long val);
+void bench_row_num(struct bench_row *row, const char *key, double val,
+		   int prec);
+
+/* Adds the calls and items of @stats, the throughput over @elapsed ns and
+ * the latency percentiles; callers add their own columns and the errors.
+ */
+void bench_row_stats(struct bench_row *row, const struct bench_stats *stats,
+		     uint64_t elapsed);
+void bench_row_print(struct bench_row *row);
+
+#endif /* _BENCH_H */
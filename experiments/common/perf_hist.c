@@ -0,0 +1,127 @@
+/*
+ * Filename:         perf_hist.c
+ * Description:      Latency histogram and timing helpers for experiments
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <string.h>
+#include "perf_hist.h"
+
+static int perf_hist_index(uint64_t v)
+{
+	int msb;
+	int shift;
+
+	if (v < PERF_HIST_SUB_CNT)
+		return (int)v;
+
+	msb = 63 - __builtin_clzll(v);
+	shift = msb - (PERF_HIST_SUB_BITS - 1);
+
+	/* (v >> shift) lies in [HALF_CNT, SUB_CNT) */
+	return PERF_HIST_SUB_CNT + (shift - 1) * PERF_HIST_HALF_CNT +
+	       (int)((v >> shift) - PERF_HIST_HALF_CNT);
+}
+
+/* Midpoint of the value range covered by bucket @idx. */
+static uint64_t perf_hist_value(int idx)
+{
+	int j;
+	int shift;
+	uint64_t sub;
+
+	if (idx < PERF_HIST_SUB_CNT)
+		return idx;
+
+	j = idx - PERF_HIST_SUB_CNT;
+	shift = j / PERF_HIST_HALF_CNT + 1;
+	sub = PERF_HIST_HALF_CNT + j % PERF_HIST_HALF_CNT;
+
+	return (sub << shift) + ((1ULL << shift) >> 1);
+}
+
+void perf_hist_init(struct perf_hist *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+	hist->min = UINT64_MAX;
+}
+
+void perf_hist_record(struct perf_hist *hist, uint64_t ns)
+{
+	hist->buckets[perf_hist_index(ns)]++;
+	hist->count++;
+	hist->sum += ns;
+	if (ns < hist->min)
+		hist->min = ns;
+	if (ns > hist->max)
+		hist->max = ns;
+}
+
+void perf_hist_merge(struct perf_hist *dst, const struct perf_hist *src)
+{
+	int i;
+
+	if (src->count == 0)
+		return;
+
+	for (i = 0; i < PERF_HIST_NR_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+uint64_t perf_hist_percentile(const struct perf_hist *hist, double pct)
+{
+	uint64_t target;
+	uint64_t seen = 0;
+	uint64_t v;
+	int i;
+
+	if (hist->count == 0)
+		return 0;
+
+	target = (uint64_t)(pct / 100.0 * hist->count + 0.5);
+	if (target == 0)
+		target = 1;
+
+	for (i = 0; i < PERF_HIST_NR_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen >= target)
+			break;
+	}
+
+	v = perf_hist_value(i);
+	if (v < hist->min)
+		v = hist->min;
+	if (v > hist->max)
+		v = hist->max;
+	return v;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,61 @@
+/*
+ * Filename:         perf_hist.h
+ * Description:      Latency histogram and timing helpers for experiments
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _PERF_HIST_H
+#define _PERF_HIST_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* Log-linear histogram of nanosecond samples.
+ * Values below 2^PERF_HIST_SUB_BITS are counted exactly, larger values fall
+ * into one of 2^(PERF_HIST_SUB_BITS - 1) sub-buckets per power of two, which
+ * bounds the relative error of any reported percentile to about 1.6%.
+ * A histogram is a flat array, so per-thread copies can be merged cheaply.
+ */
+#define PERF_HIST_SUB_BITS	7
+#define PERF_HIST_SUB_CNT	(1 << PERF_HIST_SUB_BITS)
+#define PERF_HIST_HALF_CNT	(PERF_HIST_SUB_CNT / 2)
+#define PERF_HIST_NR_BUCKETS	\
+	(PERF_HIST_SUB_CNT + (64 - PERF_HIST_SUB_BITS) * PERF_HIST_HALF_CNT)
+
+struct perf_hist {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[PERF_HIST_NR_BUCKETS];
+};
+
+void perf_hist_init(struct perf_hist *hist);
+void perf_hist_record(struct perf_hist *hist, uint64_t ns);
+void perf_hist_merge(struct perf_hist *dst, const struct perf_hist *src);
+
+/* Returns the value (ns) at or below which @pct percent of samples fall. */
+uint64_t perf_hist_percentile(const struct perf_hist *hist, double pct);
+
+static inline uint64_t perf_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif /* _PERF_HIST_H */
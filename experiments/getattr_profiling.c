@@ -97,7 +97,7 @@ static void set_ctime(void **state)
 	}
 	gettimeofday(&et,NULL);
 	int elapsed = ((et.tv_sec - st.tv_sec)*1000000)+(et.tv_usec-st.tv_usec);
-	printf("set_ctime:get attribute took %d seconds\n", elapsed);
+	printf("set_ctime:get attribute took %d microseconds\n", elapsed);
 
 	time(&end_time);
 	printf("set_ctime:End time %s\n",ctime(&end_time));	
@@ -174,7 +174,7 @@ static void set_mtime(void **state)
 	}
 	gettimeofday(&et,NULL);
 	int elapsed = ((et.tv_sec - st.tv_sec)*1000000)+(et.tv_usec-st.tv_usec);
-	printf("set_mtime:Get Attribute took %d seconds\n", elapsed);
+	printf("set_mtime:Get Attribute took %d microseconds\n", elapsed);
 
 	time(&end_time);
 	printf("set_mtime:End time %s\n",ctime(&end_time));	
@@ -248,7 +248,7 @@ static void set_atime(void **state)
 	}
 	gettimeofday(&et,NULL);
 	int elapsed = ((et.tv_sec - st.tv_sec)*1000000)+(et.tv_usec-st.tv_usec);
-	printf("set_atime:Get Attribute took %d seconds\n", elapsed);
+	printf("set_atime:Get Attribute took %d microseconds\n", elapsed);
 
 	time(&end_time);
 	printf("set_atime:End time %s\n",ctime(&end_time));	
@@ -316,7 +316,7 @@ static void set_gid(void **state)
 	}
 	gettimeofday(&et,NULL);
 	int elapsed = ((et.tv_sec - st.tv_sec)*1000000)+(et.tv_usec-st.tv_usec);
-	printf("set_gid:Get Attribute took %d seconds\n", elapsed);
+	printf("set_gid:Get Attribute took %d microseconds\n", elapsed);
 
 	time(&end_time);
 	printf("set_gid:End time %s\n",ctime(&end_time));	
@@ -381,7 +381,7 @@ static void set_uid(void **state)
 	}
 	gettimeofday(&et,NULL);
 	int elapsed = ((et.tv_sec - st.tv_sec)*1000000)+(et.tv_usec-st.tv_usec);
-	printf("set_uid:Get Attribute took %d seconds\n", elapsed);
+	printf("set_uid:Get Attribute took %d microseconds\n", elapsed);
 
 	time(&end_time);
 	printf("set_uid:End time %s\n",ctime(&end_time));	
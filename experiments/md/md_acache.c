@@ -0,0 +1,322 @@
+/*
+ * Filename:         md_acache.c
+ * Description:      In-memory inode attribute cache with lock-free reads
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <pthread.h>
+#include <urcu-bp.h>
+#include "md_acache.h"
+#include "md_wb.h"
+
+struct ac_entry {
+	struct ac_entry *next;
+	struct rcu_head rcu;
+	uint64_t ino;
+	/* Position in the CLOCK ring */
+	uint32_t slot;
+	/* Referenced since the hand last passed, set by lockless readers */
+	uint8_t ref;
+	struct stat st;
+};
+
+struct ac_shard {
+	pthread_mutex_t lock;
+	/* Bumped under the lock, read by lookups without it */
+	uint64_t gen;
+	struct ac_entry **bucket;
+	uint32_t bucket_mask;
+	struct ac_entry **ring;
+	uint32_t cap;
+	uint32_t hand;
+	/* Per shard, so lookups of different shards share no cache line */
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+} __attribute__((aligned(64)));
+
+static struct ac_shard *shards;
+
+static uint64_t ino_hash(uint64_t ino)
+{
+	return ino * 0x9E3779B97F4A7C15ULL;
+}
+
+static struct ac_shard *shard_of(uint64_t ino)
+{
+	return &shards[(ino_hash(ino) >> 32) % MD_ACACHE_SHARDS];
+}
+
+static struct ac_entry **bucket_of(struct ac_shard *sh, uint64_t ino)
+{
+	return &sh->bucket[ino_hash(ino) & sh->bucket_mask];
+}
+
+static void entry_free_rcu(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct ac_entry, rcu));
+}
+
+/* Unlinks @e from its chain and frees it after a grace period. Readers
+ * already on @e keep following its next pointer, which is left intact.
+ */
+static void entry_remove(struct ac_shard *sh, struct ac_entry *e)
+{
+	struct ac_entry **p = bucket_of(sh, e->ino);
+
+	while (*p != e)
+		p = &(*p)->next;
+	rcu_assign_pointer(*p, e->next);
+
+	sh->ring[e->slot] = NULL;
+	call_rcu(&e->rcu, entry_free_rcu);
+}
+
+static struct ac_entry **entry_find(struct ac_shard *sh, uint64_t ino)
+{
+	struct ac_entry **p;
+
+	for (p = bucket_of(sh, ino); *p != NULL; p = &(*p)->next)
+		if ((*p)->ino == ino)
+			return p;
+
+	return NULL;
+}
+
+/* Advances the hand to a free slot or to an entry which was not referenced
+ * since the last sweep, evicting the latter, whose inode is returned in
+ * @evicted. Ends within two turns.
+ */
+static uint32_t clock_claim(struct ac_shard *sh, uint64_t *evicted,
+			    bool *is_evicted)
+{
+	struct ac_entry *e;
+	uint32_t slot;
+
+	for (;;) {
+		slot = sh->hand;
+		sh->hand = (sh->hand + 1) % sh->cap;
+
+		e = sh->ring[slot];
+		if (e == NULL)
+			return slot;
+		if (__atomic_load_n(&e->ref, __ATOMIC_RELAXED)) {
+			__atomic_store_n(&e->ref, 0, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		*evicted = e->ino;
+		*is_evicted = true;
+		entry_remove(sh, e);
+		sh->evictions++;
+		return slot;
+	}
+}
+
+int md_acache_init(size_t max_bytes)
+{
+	uint32_t cap, nbuckets;
+	int i;
+
+	if (max_bytes == 0)
+		max_bytes = MD_ACACHE_BYTES;
+
+	cap = max_bytes / MD_ACACHE_SHARDS / sizeof(struct ac_entry);
+	if (cap == 0)
+		cap = 1;
+	for (nbuckets = 1; nbuckets < cap; nbuckets *= 2)
+		;
+
+	shards = aligned_alloc(64, MD_ACACHE_SHARDS * sizeof(*shards));
+	if (shards == NULL)
+		return -ENOMEM;
+	memset(shards, 0, MD_ACACHE_SHARDS * sizeof(*shards));
+
+	for (i = 0; i < MD_ACACHE_SHARDS; i++) {
+		shards[i].bucket = calloc(nbuckets, sizeof(*shards[i].bucket));
+		shards[i].ring = calloc(cap, sizeof(*shards[i].ring));
+		if (shards[i].bucket == NULL || shards[i].ring == NULL) {
+			md_acache_fini();
+			return -ENOMEM;
+		}
+		pthread_mutex_init(&shards[i].lock, NULL);
+		shards[i].bucket_mask = nbuckets - 1;
+		shards[i].cap = cap;
+	}
+
+	return 0;
+}
+
+/* Callers must have stopped using the cache. */
+void md_acache_fini(void)
+{
+	struct ac_shard *sh;
+	uint32_t j;
+	int i;
+
+	if (shards == NULL)
+		return;
+
+	for (i = 0; i < MD_ACACHE_SHARDS; i++) {
+		sh = &shards[i];
+		for (j = 0; sh->ring != NULL && j < sh->cap; j++)
+			if (sh->ring[j] != NULL)
+				entry_remove(sh, sh->ring[j]);
+		free(sh->ring);
+		free(sh->bucket);
+		if (sh->cap != 0)
+			pthread_mutex_destroy(&sh->lock);
+	}
+
+	/* Wait for the entries queued above */
+	rcu_barrier();
+	free(shards);
+	shards = NULL;
+}
+
+int md_acache_get(uint64_t ino, struct stat *st, uint64_t *gen)
+{
+	struct ac_shard *sh;
+	struct ac_entry *e;
+	int rc = -EAGAIN;
+
+	*gen = 0;
+	if (shards == NULL)
+		return -EAGAIN;
+
+	sh = shard_of(ino);
+
+	rcu_read_lock();
+	/* Before the lookup, so an invalidation after a miss is noticed */
+	*gen = __atomic_load_n(&sh->gen, __ATOMIC_ACQUIRE);
+	for (e = rcu_dereference(*bucket_of(sh, ino)); e != NULL;
+	     e = rcu_dereference(e->next)) {
+		if (e->ino != ino)
+			continue;
+		*st = e->st;
+		if (!__atomic_load_n(&e->ref, __ATOMIC_RELAXED))
+			__atomic_store_n(&e->ref, 1, __ATOMIC_RELAXED);
+		rc = 0;
+		break;
+	}
+	rcu_read_unlock();
+
+	if (rc == 0)
+		__atomic_add_fetch(&sh->hits, 1, __ATOMIC_RELAXED);
+	else
+		__atomic_add_fetch(&sh->misses, 1, __ATOMIC_RELAXED);
+	return rc;
+}
+
+void md_acache_put(uint64_t ino, const struct stat *st, uint64_t gen)
+{
+	struct ac_shard *sh;
+	struct ac_entry **p;
+	struct ac_entry *e;
+	struct ac_entry *old;
+	uint64_t evicted;
+	bool is_evicted = false;
+
+	if (shards == NULL)
+		return;
+
+	e = malloc(sizeof(*e));
+	if (e == NULL)
+		return;
+
+	e->ino = ino;
+	e->ref = 0;
+	e->st = *st;
+
+	sh = shard_of(ino);
+	pthread_mutex_lock(&sh->lock);
+	if (gen != sh->gen) {
+		/* Invalidated since the caller missed */
+		pthread_mutex_unlock(&sh->lock);
+		free(e);
+		return;
+	}
+
+	p = entry_find(sh, ino);
+	if (p != NULL) {
+		/* Another thread filled it meanwhile: replace in place */
+		old = *p;
+		e->slot = old->slot;
+		e->next = old->next;
+		sh->ring[e->slot] = e;
+		rcu_assign_pointer(*p, e);
+		call_rcu(&old->rcu, entry_free_rcu);
+	} else {
+		e->slot = clock_claim(sh, &evicted, &is_evicted);
+		sh->ring[e->slot] = e;
+		p = bucket_of(sh, ino);
+		e->next = *p;
+		rcu_assign_pointer(*p, e);
+	}
+	pthread_mutex_unlock(&sh->lock);
+
+	/* As an inode leaving the inode cache, write its pending lazytime
+	 * atime and other updates.
+	 */
+	if (is_evicted)
+		md_wb_sync(evicted);
+}
+
+void md_acache_invalidate(uint64_t ino)
+{
+	struct ac_shard *sh;
+	struct ac_entry **p;
+
+	if (shards == NULL)
+		return;
+
+	sh = shard_of(ino);
+	pthread_mutex_lock(&sh->lock);
+	__atomic_store_n(&sh->gen, sh->gen + 1, __ATOMIC_RELEASE);
+	p = entry_find(sh, ino);
+	if (p != NULL)
+		entry_remove(sh, *p);
+	pthread_mutex_unlock(&sh->lock);
+}
+
+void md_acache_stats(uint64_t *hits, uint64_t *misses, uint64_t *evictions)
+{
+	int i;
+
+	*hits = *misses = *evictions = 0;
+	for (i = 0; shards != NULL && i < MD_ACACHE_SHARDS; i++) {
+		*hits += __atomic_load_n(&shards[i].hits, __ATOMIC_RELAXED);
+		*misses += __atomic_load_n(&shards[i].misses,
+					   __ATOMIC_RELAXED);
+		pthread_mutex_lock(&shards[i].lock);
+		*evictions += shards[i].evictions;
+		pthread_mutex_unlock(&shards[i].lock);
+	}
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
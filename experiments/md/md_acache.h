@@ -0,0 +1,71 @@
+/*
+ * Filename:         md_acache.h
+ * Description:      In-memory inode attribute cache with lock-free reads
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _MD_ACACHE_H
+#define _MD_ACACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/* Caches the attribute record of an inode by inode number, for the
+ * handles made by md_fh_from_ino() and md_fh_from_ino_many().
+ *
+ * Entries are spread over shards by inode number. Lookups take no lock:
+ * they walk the hash chains of a shard under rcu_read_lock() and copy the
+ * attributes out. Entries are never changed in place; an update links a
+ * new entry and the old one is freed with call_rcu() once no reader can
+ * see it. Inserts and removals take the lock of their shard.
+ *
+ * Each shard holds a fixed number of entries, its share of the byte budget,
+ * in a CLOCK ring: a hit sets the referenced bit of the entry, and an
+ * insert into a full shard sweeps the hand, clearing set bits, until it
+ * finds an entry which was not referenced since the last sweep. An
+ * evicted inode is synced through md_wb_sync(), as the kernel writes a
+ * lazytime inode when it is evicted, so its pending updates do not
+ * outlive it in memory.
+ *
+ * As in xattr_cache, a lookup miss returns the generation of the shard,
+ * every invalidation bumps it, and an insert with an older generation is
+ * dropped. Every write of an attribute record through md_kvs invalidates
+ * its inode after the write. Only changes made through this process are
+ * seen.
+ *
+ * Until md_acache_init() is called every lookup misses and inserts are
+ * ignored. Threads which use the cache must be known to liburcu; the
+ * bulletproof flavour registers them on first use.
+ */
+
+#define MD_ACACHE_SHARDS	64
+#define MD_ACACHE_BYTES		(64 << 20)
+
+/* @max_bytes of 0 selects MD_ACACHE_BYTES. */
+int md_acache_init(size_t max_bytes);
+void md_acache_fini(void);
+
+/* Returns 0 with the cached attributes of @ino, or -EAGAIN on a miss.
+ * @gen is set in both cases, for a following md_acache_put().
+ */
+int md_acache_get(uint64_t ino, struct stat *st, uint64_t *gen);
+void md_acache_put(uint64_t ino, const struct stat *st, uint64_t gen);
+void md_acache_invalidate(uint64_t ino);
+
+void md_acache_stats(uint64_t *hits, uint64_t *misses, uint64_t *evictions);
+
+#endif /* _MD_ACACHE_H */
@@ -0,0 +1,146 @@
+/*
+ * Filename:         md_atime.c
+ * Description:      Access time update policies of the metadata experiments
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "md_attr.h"
+#include "md_kvs.h"
+#include "md_wb.h"
+#include "md_atime.h"
+
+/* Per shard by inode, so reads of different inodes share no cache line */
+struct at_stat {
+	uint64_t touches;
+	uint64_t updates;
+} __attribute__((aligned(64)));
+
+static enum md_atime_policy atime_policy = MD_ATIME_STRICT;
+static int atime_flush_ms = MD_ATIME_FLUSH_MS;
+static struct at_stat stats[MD_ATIME_SHARDS];
+
+static const char *policy_name[] = {
+	[MD_ATIME_STRICT] = "strict",
+	[MD_ATIME_NOATIME] = "noatime",
+	[MD_ATIME_RELATIME] = "relatime",
+	[MD_ATIME_LAZYTIME] = "lazytime",
+};
+
+static struct at_stat *stat_of(uint64_t ino)
+{
+	return &stats[((ino * 0x9E3779B97F4A7C15ULL) >> 32) % MD_ATIME_SHARDS];
+}
+
+static int ts_cmp(const struct timespec *a, const struct timespec *b)
+{
+	if (a->tv_sec != b->tv_sec)
+		return a->tv_sec < b->tv_sec ? -1 : 1;
+	if (a->tv_nsec != b->tv_nsec)
+		return a->tv_nsec < b->tv_nsec ? -1 : 1;
+	return 0;
+}
+
+static bool relatime_due(const struct stat *st, const struct timespec *now)
+{
+	return ts_cmp(&st->st_atim, &st->st_mtim) <= 0 ||
+	       ts_cmp(&st->st_atim, &st->st_ctim) <= 0 ||
+	       now->tv_sec - st->st_atim.tv_sec >= MD_ATIME_RELATIME_SECS;
+}
+
+int md_atime_touch(struct md_fh *fh)
+{
+	struct at_stat *as = stat_of(fh->ino);
+	struct timespec now;
+	int delay_ms = 0;
+
+	__atomic_add_fetch(&as->touches, 1, __ATOMIC_RELAXED);
+
+	switch (atime_policy) {
+	case MD_ATIME_NOATIME:
+		return 0;
+	case MD_ATIME_RELATIME:
+		clock_gettime(CLOCK_REALTIME, &now);
+		if (!relatime_due(&fh->st, &now))
+			return 0;
+		break;
+	case MD_ATIME_LAZYTIME:
+		clock_gettime(CLOCK_REALTIME, &now);
+		delay_ms = atime_flush_ms;
+		break;
+	default:
+		clock_gettime(CLOCK_REALTIME, &now);
+		break;
+	}
+
+	/* As cfs_read does: the handle's attributes with the new atime */
+	fh->st.st_atim = now;
+	__atomic_add_fetch(&as->updates, 1, __ATOMIC_RELAXED);
+	return md_wb_update(fh->ino, &fh->st, MD_STAT_ATIME_SET, delay_ms);
+}
+
+int md_atime_init(enum md_atime_policy policy, int flush_ms)
+{
+	atime_policy = policy;
+	atime_flush_ms = flush_ms > 0 ? flush_ms : MD_ATIME_FLUSH_MS;
+	memset(stats, 0, sizeof(stats));
+	return 0;
+}
+
+void md_atime_fini(void)
+{
+	atime_policy = MD_ATIME_STRICT;
+}
+
+int md_atime_policy_parse(const char *name, enum md_atime_policy *policy)
+{
+	int i;
+
+	for (i = 0; i < (int)(sizeof(policy_name) / sizeof(policy_name[0]));
+	     i++) {
+		if (strcmp(name, policy_name[i]) == 0) {
+			*policy = i;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+void md_atime_stats(uint64_t *touches, uint64_t *updates)
+{
+	int i;
+
+	*touches = *updates = 0;
+	for (i = 0; i < MD_ATIME_SHARDS; i++) {
+		*touches += __atomic_load_n(&stats[i].touches,
+					    __ATOMIC_RELAXED);
+		*updates += __atomic_load_n(&stats[i].updates,
+					    __ATOMIC_RELAXED);
+	}
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,69 @@
+/*
+ * Filename:         md_atime.h
+ * Description:      Access time update policies of the metadata experiments
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _MD_ATIME_H
+#define _MD_ATIME_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include "md_fh.h"
+
+/* What a read does to the atime of the inode, as the mount options of the
+ * same names.
+ *
+ * STRICT   sets atime and PUTs the attribute record on every read, which
+ *          is what cfs_read does today.
+ * NOATIME  never changes atime.
+ * RELATIME sets and PUTs atime only when it is not later than mtime or
+ *          ctime, so a reader can tell whether the file was read since
+ *          it changed, or when it is MD_ATIME_RELATIME_SECS old.
+ * LAZYTIME sets atime on every read but only in memory, as an md_wb
+ *          update due after the flush interval. md_wb writes pending
+ *          atimes in batches, on fsync and on eviction of the inode from
+ *          md_acache through md_wb_sync(), and merged with any other
+ *          pending update of the inode. Until md_wb_init() is called
+ *          LAZYTIME is STRICT.
+ */
+enum md_atime_policy {
+	MD_ATIME_STRICT,
+	MD_ATIME_NOATIME,
+	MD_ATIME_RELATIME,
+	MD_ATIME_LAZYTIME,
+};
+
+#define MD_ATIME_RELATIME_SECS	(24 * 60 * 60)
+#define MD_ATIME_FLUSH_MS	1000
+#define MD_ATIME_SHARDS		64
+
+/* Selects @policy; a LAZYTIME atime is due @flush_ms after the read,
+ * MD_ATIME_FLUSH_MS if 0.
+ */
+int md_atime_init(enum md_atime_policy policy, int flush_ms);
+void md_atime_fini(void);
+
+/* Parses "strict", "noatime", "relatime" or "lazytime". */
+int md_atime_policy_parse(const char *name, enum md_atime_policy *policy);
+
+/* Updates the atime of @fh after a read, as the policy says. */
+int md_atime_touch(struct md_fh *fh);
+
+/* Reads seen, and those which wrote or queued an atime. */
+void md_atime_stats(uint64_t *touches, uint64_t *updates);
+
+#endif /* _MD_ATIME_H */
@@ -0,0 +1,231 @@
+/*
+ * Filename:         md_attr.c
+ * Description:      Inode attribute updates of the metadata experiments
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "md_kvs.h"
+#include "md_wb.h"
+#include "md_attr.h"
+
+/* Per-call scratch of md_setattr_batch(), one chunk worth. */
+struct setattr_chunk {
+	struct stat cur[MD_BATCH_MAX];
+	int get_rcs[MD_BATCH_MAX];
+	/* Entry which first names the same inode */
+	int first[MD_BATCH_MAX];
+	/* Record of the PUT the inode goes to, -1 if none */
+	int slot[MD_BATCH_MAX];
+	uint64_t put_ino[MD_BATCH_MAX];
+	struct stat put_st[MD_BATCH_MAX];
+	int put_rcs[MD_BATCH_MAX];
+};
+
+static bool may_write(const struct md_cred *cred, const struct stat *st)
+{
+	if (cred->uid == st->st_uid)
+		return st->st_mode & S_IWUSR;
+	if (cred->gid == st->st_gid)
+		return st->st_mode & S_IWGRP;
+	return st->st_mode & S_IWOTH;
+}
+
+int md_setattr_check(const struct md_cred *cred, const struct stat *st,
+		     const struct stat *stat_in, int flags)
+{
+	bool owner = cred->uid == st->st_uid;
+
+	if (cred->uid == 0)
+		return 0;
+
+	/* Only root gives a file away */
+	if ((flags & MD_STAT_UID_SET) && stat_in->st_uid != st->st_uid)
+		return -EPERM;
+
+	/* The owner may move it to a group it belongs to */
+	if ((flags & MD_STAT_GID_SET) &&
+	    (!owner || (stat_in->st_gid != st->st_gid &&
+			stat_in->st_gid != cred->gid)))
+		return -EPERM;
+
+	if ((flags & (MD_STAT_MODE_SET | MD_STAT_ATIME_SET |
+		      MD_STAT_MTIME_SET | MD_STAT_CTIME_SET)) && !owner)
+		return -EPERM;
+
+	if ((flags & MD_STAT_SIZE_SET) && !may_write(cred, st))
+		return -EACCES;
+
+	return 0;
+}
+
+void md_setattr_apply(struct stat *st, const struct stat *stat_in, int flags)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	if (flags & MD_STAT_MODE_SET)
+		st->st_mode = (st->st_mode & S_IFMT) |
+			      (stat_in->st_mode & ~S_IFMT);
+	if (flags & MD_STAT_UID_SET)
+		st->st_uid = stat_in->st_uid;
+	if (flags & MD_STAT_GID_SET)
+		st->st_gid = stat_in->st_gid;
+	if (flags & MD_STAT_SIZE_SET) {
+		st->st_size = stat_in->st_size;
+		st->st_mtim = now;
+	}
+	if (flags & MD_STAT_ATIME_SET)
+		st->st_atim = stat_in->st_atim;
+	if (flags & MD_STAT_MTIME_SET)
+		st->st_mtim = stat_in->st_mtim;
+
+	st->st_ctim = (flags & MD_STAT_CTIME_SET) ? stat_in->st_ctim : now;
+}
+
+/* One GET and one PUT for up to MD_BATCH_MAX entries, with the inodes
+ * held in md_wb.
+ */
+static int setattr_chunk(struct setattr_chunk *c, const struct md_cred *cred,
+			 const uint64_t *inos, const struct stat *stat_in,
+			 const int *flags, int *rcs, int nr)
+{
+	int put_nr = 0;
+	int rc, i, j, f;
+
+	rc = md_stat_get_many(inos, c->cur, c->get_rcs, nr);
+	if (rc)
+		return rc;
+
+	/* Batches are small, a quadratic scan for repeats is cheap */
+	for (i = 0; i < nr; i++) {
+		c->first[i] = i;
+		c->slot[i] = -1;
+		for (j = 0; j < i; j++) {
+			if (inos[j] == inos[i]) {
+				c->first[i] = c->first[j];
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < nr; i++) {
+		f = c->first[i];
+		rcs[i] = c->get_rcs[f];
+		if (rcs[i])
+			continue;
+
+		rcs[i] = md_setattr_check(cred, &c->cur[f], &stat_in[i],
+					  flags[i]);
+		if (rcs[i])
+			continue;
+
+		md_setattr_apply(&c->cur[f], &stat_in[i], flags[i]);
+		if (c->slot[f] < 0) {
+			c->slot[f] = put_nr;
+			c->put_ino[put_nr++] = inos[f];
+		}
+	}
+
+	if (put_nr == 0)
+		return 0;
+
+	for (i = 0; i < nr; i++)
+		if (c->first[i] == i && c->slot[i] >= 0)
+			c->put_st[c->slot[i]] = c->cur[i];
+
+	rc = md_stat_put_many(c->put_ino, c->put_st, c->put_rcs, put_nr);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < nr; i++)
+		if (rcs[i] == 0)
+			rcs[i] = c->put_rcs[c->slot[c->first[i]]];
+
+	return 0;
+}
+
+int md_setattr_batch(const struct md_cred *cred, const uint64_t *inos,
+		     const struct stat *stat_in, const int *flags, int *rcs,
+		     int nr)
+{
+	struct setattr_chunk *c;
+	uint64_t held;
+	int rc = 0;
+	int i, n;
+
+	c = malloc(sizeof(*c));
+	if (c == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i += n) {
+		n = nr - i < MD_BATCH_MAX ? nr - i : MD_BATCH_MAX;
+		/* Explicit times and sizes go on top of what is pending */
+		rc = md_wb_hold(inos + i, n, &held);
+		if (rc)
+			break;
+		rc = setattr_chunk(c, cred, inos + i, stat_in + i, flags + i,
+				   rcs + i, n);
+		md_wb_release(held);
+		if (rc)
+			break;
+	}
+
+	for (; i < nr; i++)
+		rcs[i] = rc;
+
+	free(c);
+	return rc;
+}
+
+int md_setattr(const struct md_cred *cred, uint64_t ino,
+	       const struct stat *stat_in, int flags)
+{
+	struct stat st;
+	uint64_t held;
+	int rc;
+
+	/* Explicit times and sizes go on top of what is pending */
+	rc = md_wb_hold(&ino, 1, &held);
+	if (rc)
+		return rc;
+
+	rc = md_stat_get(ino, &st);
+	if (rc == 0)
+		rc = md_setattr_check(cred, &st, stat_in, flags);
+	if (rc == 0) {
+		md_setattr_apply(&st, stat_in, flags);
+		rc = md_stat_put(ino, &st);
+	}
+
+	md_wb_release(held);
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
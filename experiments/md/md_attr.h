@@ -0,0 +1,72 @@
+/*
+ * Filename:         md_attr.h
+ * Description:      Inode attribute updates of the metadata experiments
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _MD_ATTR_H
+#define _MD_ATTR_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include "md_kvs.h"
+
+/* Attributes of @stat_in to apply, as the STAT_*_SET flags of cfs_setattr */
+#define MD_STAT_MODE_SET	(1 << 0)
+#define MD_STAT_UID_SET		(1 << 1)
+#define MD_STAT_GID_SET		(1 << 2)
+#define MD_STAT_SIZE_SET	(1 << 3)
+#define MD_STAT_ATIME_SET	(1 << 4)
+#define MD_STAT_MTIME_SET	(1 << 5)
+#define MD_STAT_CTIME_SET	(1 << 6)
+
+/* Checks whether @cred may apply @flags of @stat_in to an inode with the
+ * attributes @st: 0, -EPERM or -EACCES.
+ */
+int md_setattr_check(const struct md_cred *cred, const struct stat *st,
+		     const struct stat *stat_in, int flags);
+
+/* Applies @flags of @stat_in to @st. ctime is set to now unless it is
+ * given explicitly.
+ */
+void md_setattr_apply(struct stat *st, const struct stat *stat_in, int flags);
+
+/* Same as cfs_setattr on one inode: a GET and a PUT of its attributes,
+ * with the inode held in md_wb, which syncs its pending update first.
+ */
+int md_setattr(const struct md_cred *cred, uint64_t ino,
+	       const struct stat *stat_in, int flags);
+
+/* Applies @stat_in[i] with @flags[i] to @inos[i] for @nr inodes.
+ *
+ * Up to MD_BATCH_MAX inodes at a time are held in md_wb, which writes
+ * their pending updates with one GET and one PUT. Their attributes are
+ * then read with one multi-key GET, each entry is checked against @cred,
+ * and all entries which pass are written with one multi-key PUT. An inode
+ * listed more than once gets its entries applied in order and is written
+ * once.
+ *
+ * @rcs returns the result of each entry: 0, -ENOENT for a missing inode,
+ * -EPERM or -EACCES from the permission check, or the error of its
+ * record. The call returns 0 when every op ran, else the error of the
+ * first op which failed as a whole; the entries it covered, and those
+ * after it, get that error as well.
+ */
+int md_setattr_batch(const struct md_cred *cred, const uint64_t *inos,
+		     const struct stat *stat_in, const int *flags, int *rcs,
+		     int nr);
+
+#endif /* _MD_ATTR_H */
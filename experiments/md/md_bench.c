@@ -0,0 +1,620 @@
+/*
+ * Filename:         md_bench.c
+ * Description:      Throughput and latency of inode attribute operations
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This driver runs the following experiment for every combination of the
+ * swept parameters:
+ * - each thread owns N inodes and writes their attribute records
+ * - sets the mtime of every inode, one md_setattr per inode, as the
+ *   getattr_profiling loops do with cfs_setattr
+ * - sets the atime and gid of all inodes with md_setattr_batch, in
+ *   batches
+ * - reads back the attributes of every inode through a handle, one
+ *   md_fh_from_ino per inode, and checks both updates
+ * - does the same with md_fh_from_ino_many, in batches; with -c both go
+ *   through md_acache, so the first pass fills it and the second hits
+ * - reads every inode twice, as a reader of a file does: makes a handle
+ *   and updates atime as the -a policy says
+ * - syncs every inode, which writes a pending lazytime atime
+ * - appends BENCH_APPENDS small WRITEs to every inode and closes it, which
+ *   with -w merges their attribute updates into one write
+ * - removes the attribute records
+ * For each phase one result row is printed with throughput (inodes/s) and
+ * per-call latency percentiles, merged over all threads and repetitions.
+ *
+ * Build together with md_acache.c, md_atime.c, md_attr.c, md_fh.c, md_kvs.c,
+ * md_rec.c, md_wb.c, ../xattr/xattr_kvs.c, ../xattr/xattr_kvs_async.c,
+ * ../common/bench.c and ../common/perf_hist.c against Motr and liburcu-bp.
+ *
+ * Example:
+ *   md_bench -n 1000,10000 -b 16,256 -t 1,8
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "../common/bench.h"
+#include "../xattr/xattr_kvs.h"
+#include "md_kvs.h"
+#include "md_acache.h"
+#include "md_atime.h"
+#include "md_attr.h"
+#include "md_fh.h"
+#include "md_wb.h"
+
+#define DEFAULT_INO 0x10000000ULL
+#define BENCH_UID 1000
+#define BENCH_GID 1000
+#define BENCH_APPENDS 8
+#define BENCH_APPEND_LEN 4096
+
+enum bench_op {
+	BENCH_CREATE,
+	BENCH_SETATTR,
+	BENCH_SETATTR_BATCH,
+	BENCH_GETATTR,
+	BENCH_GETATTR_MANY,
+	BENCH_READ,
+	BENCH_SYNC,
+	BENCH_APPEND,
+	BENCH_REMOVE,
+	BENCH_OP_NR,
+};
+
+static const char *bench_op_name[BENCH_OP_NR] = {
+	[BENCH_CREATE] = "create",
+	[BENCH_SETATTR] = "setattr",
+	[BENCH_SETATTR_BATCH] = "setattr_batch",
+	[BENCH_GETATTR] = "getattr",
+	[BENCH_GETATTR_MANY] = "getattr_many",
+	[BENCH_READ] = "read",
+	[BENCH_SYNC] = "fsync",
+	[BENCH_APPEND] = "append",
+	[BENCH_REMOVE] = "remove",
+};
+
+struct bench_cfg {
+	struct bench_sweep count;
+	struct bench_sweep batch;
+	struct bench_sweep threads;
+	int reps;
+	uint64_t base_ino;
+	size_t cache_bytes;
+	enum md_atime_policy atime;
+	int window_ms;
+	bool legacy;
+	bool json;
+};
+
+/* Parameters of one point in the sweep. */
+struct bench_run {
+	int count;
+	int batch;
+	int threads;
+	int reps;
+	uint64_t base_ino;
+	struct bench_clock clock;
+};
+
+struct bench_thread {
+	int index;
+	struct bench_run *run;
+	struct bench_stats stats[BENCH_OP_NR];
+};
+
+/* Per-thread inodes and the arrays handed to batched calls. */
+struct bench_set {
+	uint64_t *inos;
+	struct stat *st;
+	int *flags;
+	int *rcs;
+	struct md_fh **fh;
+	time_t mtime;
+	time_t atime;
+};
+
+static const struct md_cred bench_cred = {
+	.uid = BENCH_UID,
+	.gid = BENCH_GID,
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+"Usage: %s [-n counts] [-b batches] [-t threads] [-c bytes] [-L]\n"
+"          [-a policy] [-w ms] [-r reps] [-i ino] [-f csv|json]\n"
+"  -n  inodes per thread, default 1000\n"
+"  -b  inodes per batched call, default 256\n"
+"  -t  threads, each on its own inodes, default 1\n"
+"  -c  cache attributes in md_acache, with this memory budget\n"
+"  -L  write attribute records in the old struct stat format\n"
+"  -a  atime policy of reads: strict, noatime, relatime or lazytime,\n"
+"      default strict\n"
+"  -w  merge attribute updates of WRITEs for up to this many ms,\n"
+"      default 0, which writes each at once\n"
+"  -r  repetitions merged into each result row, default 1\n"
+"  -i  first inode number, default %llu\n"
+"  -f  output format, default csv\n"
+"  -n, -b and -t take comma separated lists which are swept.\n",
+		prog, DEFAULT_INO);
+}
+
+static int parse_args(int argc, char **argv, struct bench_cfg *cfg)
+{
+	int opt;
+	int rc = 0;
+
+	memset(cfg, 0, sizeof(*cfg));
+	bench_sweep_parse("1000", &cfg->count);
+	bench_sweep_parse("256", &cfg->batch);
+	bench_sweep_parse("1", &cfg->threads);
+	cfg->reps = 1;
+	cfg->base_ino = DEFAULT_INO;
+
+	while (rc == 0 && (opt = getopt(argc, argv, "n:b:t:c:La:w:r:i:f:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			rc = bench_sweep_parse(optarg, &cfg->count);
+			break;
+		case 'b':
+			rc = bench_sweep_parse(optarg, &cfg->batch);
+			break;
+		case 't':
+			rc = bench_sweep_parse(optarg, &cfg->threads);
+			break;
+		case 'c':
+			cfg->cache_bytes = strtoul(optarg, NULL, 0);
+			if (cfg->cache_bytes == 0)
+				rc = -EINVAL;
+			break;
+		case 'L':
+			cfg->legacy = true;
+			break;
+		case 'a':
+			rc = md_atime_policy_parse(optarg, &cfg->atime);
+			break;
+		case 'w':
+			cfg->window_ms = atoi(optarg);
+			if (cfg->window_ms < 0)
+				rc = -EINVAL;
+			break;
+		case 'r':
+			cfg->reps = atoi(optarg);
+			break;
+		case 'i':
+			cfg->base_ino = strtoull(optarg, NULL, 0);
+			break;
+		case 'f':
+			if (strcmp(optarg, "json") == 0)
+				cfg->json = true;
+			else if (strcmp(optarg, "csv") != 0)
+				rc = -EINVAL;
+			break;
+		default:
+			rc = -EINVAL;
+			break;
+		}
+	}
+
+	if (rc == 0 && bench_sweep_max(&cfg->threads) > BENCH_THREADS_MAX)
+		rc = -EINVAL;
+
+	if (rc == 0 && cfg->reps <= 0)
+		rc = -EINVAL;
+
+	return rc;
+}
+
+static void bench_stat_init(struct stat *st, uint64_t ino)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	memset(st, 0, sizeof(*st));
+	st->st_ino = ino;
+	st->st_mode = S_IFREG | 0644;
+	st->st_nlink = 1;
+	st->st_uid = BENCH_UID;
+	st->st_gid = 0;
+	st->st_blksize = 4096;
+	st->st_atim = now;
+	st->st_mtim = now;
+	st->st_ctim = now;
+}
+
+/* Checks a handle against the last setattr and setattr_batch phases. */
+static int bench_check(const struct bench_set *set, struct md_fh *fh)
+{
+	const struct stat *st = md_fh_stat(fh);
+
+	if (st->st_mtim.tv_sec != set->mtime ||
+	    st->st_atim.tv_sec != set->atime || st->st_gid != BENCH_GID)
+		return -EIO;
+	return 0;
+}
+
+/* Counts the entries of a batched call which failed. */
+static int batch_errors(const int *rcs, int nr)
+{
+	int errors = 0;
+	int i;
+
+	for (i = 0; i < nr; i++)
+		if (rcs[i])
+			errors++;
+
+	return errors;
+}
+
+static void bench_phase(struct bench_thread *bt, enum bench_op op,
+			struct bench_set *set)
+{
+	struct bench_run *run = bt->run;
+	struct bench_stats *stats = &bt->stats[op];
+	struct stat stat_in;
+	struct md_fh *fh;
+	uint64_t t0;
+	int cnt, rc, i, j;
+
+	switch (op) {
+	case BENCH_CREATE:
+		for (i = 0; i < run->count; i += cnt) {
+			cnt = run->count - i < run->batch ? run->count - i :
+							   run->batch;
+			for (j = 0; j < cnt; j++)
+				bench_stat_init(&set->st[i + j],
+						set->inos[i + j]);
+			t0 = perf_now_ns();
+			rc = md_stat_put_many(set->inos + i, set->st + i,
+					      set->rcs + i, cnt);
+			bench_record(stats, cnt, rc, t0);
+			if (rc == 0)
+				stats->errors += batch_errors(set->rcs + i,
+							      cnt);
+		}
+		break;
+	case BENCH_SETATTR:
+		memset(&stat_in, 0, sizeof(stat_in));
+		stat_in.st_mtim.tv_sec = set->mtime;
+		for (i = 0; i < run->count; i++) {
+			t0 = perf_now_ns();
+			rc = md_setattr(&bench_cred, set->inos[i], &stat_in,
+					MD_STAT_MTIME_SET);
+			bench_record(stats, 1, rc, t0);
+		}
+		break;
+	case BENCH_SETATTR_BATCH:
+		for (i = 0; i < run->count; i++) {
+			memset(&set->st[i], 0, sizeof(set->st[i]));
+			set->st[i].st_atim.tv_sec = set->atime;
+			set->st[i].st_gid = BENCH_GID;
+			set->flags[i] = MD_STAT_ATIME_SET | MD_STAT_GID_SET;
+		}
+		for (i = 0; i < run->count; i += cnt) {
+			cnt = run->count - i < run->batch ? run->count - i :
+							   run->batch;
+			t0 = perf_now_ns();
+			rc = md_setattr_batch(&bench_cred, set->inos + i,
+					      set->st + i, set->flags + i,
+					      set->rcs + i, cnt);
+			bench_record(stats, cnt, rc, t0);
+			if (rc == 0)
+				stats->errors += batch_errors(set->rcs + i,
+							      cnt);
+		}
+		break;
+	case BENCH_GETATTR:
+		for (i = 0; i < run->count; i++) {
+			t0 = perf_now_ns();
+			rc = md_fh_from_ino(set->inos[i], &fh);
+			bench_record(stats, 1, rc, t0);
+			if (rc == 0) {
+				if (bench_check(set, fh))
+					stats->errors++;
+				md_fh_destroy(fh);
+			}
+		}
+		break;
+	case BENCH_GETATTR_MANY:
+		for (i = 0; i < run->count; i += cnt) {
+			cnt = run->count - i < run->batch ? run->count - i :
+							   run->batch;
+			t0 = perf_now_ns();
+			rc = md_fh_from_ino_many(set->inos + i, set->fh + i,
+						 set->rcs + i, cnt);
+			bench_record(stats, cnt, rc, t0);
+			for (j = 0; j < cnt; j++) {
+				fh = set->fh[i + j];
+				if (rc == 0 && (set->rcs[i + j] != 0 ||
+						bench_check(set, fh) != 0))
+					stats->errors++;
+				if (fh != NULL)
+					md_fh_destroy(fh);
+			}
+		}
+		break;
+	case BENCH_READ:
+		for (i = 0; i < 2 * run->count; i++) {
+			t0 = perf_now_ns();
+			rc = md_fh_from_ino(set->inos[i / 2], &fh);
+			if (rc == 0) {
+				rc = md_atime_touch(fh);
+				md_fh_destroy(fh);
+			}
+			bench_record(stats, 1, rc, t0);
+		}
+		break;
+	case BENCH_SYNC:
+		for (i = 0; i < run->count; i++) {
+			t0 = perf_now_ns();
+			rc = md_wb_sync(set->inos[i]);
+			bench_record(stats, 1, rc, t0);
+		}
+		break;
+	case BENCH_APPEND:
+		for (i = 0; i < run->count; i++) {
+			t0 = perf_now_ns();
+			rc = md_fh_from_ino(set->inos[i], &fh);
+			if (rc == 0) {
+				for (j = 0; rc == 0 && j < BENCH_APPENDS; j++)
+					rc = md_wb_write(fh, (j + 1) *
+							 BENCH_APPEND_LEN);
+				/* close */
+				if (rc == 0)
+					rc = md_wb_sync(set->inos[i]);
+				md_fh_destroy(fh);
+			}
+			bench_record(stats, BENCH_APPENDS, rc, t0);
+			if (rc == 0 && (md_stat_get(set->inos[i], &stat_in) ||
+					stat_in.st_size !=
+					BENCH_APPENDS * BENCH_APPEND_LEN))
+				stats->errors++;
+		}
+		break;
+	case BENCH_REMOVE:
+		for (i = 0; i < run->count; i++) {
+			t0 = perf_now_ns();
+			rc = md_stat_del(set->inos[i]);
+			bench_record(stats, 1, rc, t0);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static void *bench_thread_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	struct bench_run *run = bt->run;
+	struct bench_set set;
+	int rep, op, rc, i;
+
+	set.inos = calloc(run->count, sizeof(*set.inos));
+	set.st = calloc(run->count, sizeof(*set.st));
+	set.flags = calloc(run->count, sizeof(*set.flags));
+	set.rcs = calloc(run->count, sizeof(*set.rcs));
+	set.fh = calloc(run->count, sizeof(*set.fh));
+	if (set.inos == NULL || set.st == NULL || set.flags == NULL ||
+	    set.rcs == NULL || set.fh == NULL) {
+		fprintf(stderr, "thread %d: out of memory\n", bt->index);
+		exit(-ENOMEM);
+	}
+
+	rc = xattr_kvs_thread_init();
+	if (rc)
+		exit(rc);
+
+	for (i = 0; i < run->count; i++)
+		set.inos[i] = run->base_ino +
+			      (uint64_t)bt->index * run->count + i;
+
+	for (rep = 0; rep < run->reps; rep++) {
+		/* Distinct times per repetition, so stale records show */
+		set.mtime = 1000000 + rep;
+		set.atime = 2000000 + rep;
+		for (op = 0; op < BENCH_OP_NR; op++) {
+			bench_phase_begin(&run->clock, bt->index);
+			bench_phase(bt, op, &set);
+			bench_phase_end(&run->clock, bt->index, op);
+		}
+	}
+
+	xattr_kvs_thread_fini();
+	free(set.fh);
+	free(set.rcs);
+	free(set.flags);
+	free(set.st);
+	free(set.inos);
+	return NULL;
+}
+
+static void print_row(const struct bench_cfg *cfg, const struct bench_run *run,
+		      enum bench_op op, const struct bench_stats *stats)
+{
+	struct bench_row row;
+
+	bench_row_init(&row, cfg->json);
+	bench_row_str(&row, "op", bench_op_name[op]);
+	bench_row_int(&row, "inodes", run->count);
+	bench_row_int(&row, "batch", run->batch);
+	bench_row_int(&row, "threads", run->threads);
+	bench_row_stats(&row, stats, run->clock.elapsed[op]);
+	bench_row_int(&row, "errors", stats->errors);
+	bench_row_print(&row);
+}
+
+static int bench_run(const struct bench_cfg *cfg, struct bench_run *run)
+{
+	struct bench_thread *bt;
+	struct bench_stats *stats;
+	int rc = 0;
+	int op, i;
+
+	bt = calloc(run->threads, sizeof(*bt));
+	stats = malloc(sizeof(*stats));
+	if (bt == NULL || stats == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	bench_clock_init(&run->clock, run->threads);
+
+	for (i = 0; i < run->threads; i++) {
+		bt[i].index = i;
+		bt[i].run = run;
+		for (op = 0; op < BENCH_OP_NR; op++)
+			bench_stats_init(&bt[i].stats[op]);
+	}
+
+	rc = bench_threads_run(bt, sizeof(*bt), run->threads, bench_thread_fn);
+	bench_clock_fini(&run->clock);
+	if (rc)
+		goto out;
+
+	for (op = 0; op < BENCH_OP_NR; op++) {
+		bench_stats_init(stats);
+		for (i = 0; i < run->threads; i++)
+			bench_stats_merge(stats, &bt[i].stats[op]);
+		print_row(cfg, run, op, stats);
+	}
+
+out:
+	free(stats);
+	free(bt);
+	return rc;
+}
+
+/* main */
+int main(int argc, char **argv)
+{
+	struct bench_cfg cfg;
+	struct bench_run run;
+	uint64_t hits, misses, evictions;
+	uint64_t touches, updates, writes;
+	int n, b, t;
+	int rc;
+
+	if (parse_args(argc, argv, &cfg) != 0) {
+		usage(basename(argv[0]));
+		return -1;
+	}
+
+	/* time in */
+	c0appz_timein();
+
+	/* c0rcfile
+	 * overwrite .cappzrc to a .[app]rc file.
+	 */
+	char str[256];
+	sprintf(str, ".%src", basename(argv[0]));
+	c0appz_setrc(str);
+	c0appz_putrc();
+
+	/* initialize resources */
+	if (c0appz_init(0) != 0) {
+		fprintf(stderr, "error! motr initialization failed.\n");
+		return -2;
+	}
+
+	rc = xattr_kvs_init();
+	if (rc != 0) {
+		fprintf(stderr, "error in fid initialization\n");
+		goto out;
+	}
+
+	if (cfg.cache_bytes != 0) {
+		rc = md_acache_init(cfg.cache_bytes);
+		if (rc != 0) {
+			fprintf(stderr, "error(%d): md_acache_init\n", rc);
+			goto out;
+		}
+	}
+
+	rc = md_wb_init(cfg.window_ms);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): md_wb_init\n", rc);
+		goto out;
+	}
+
+	md_atime_init(cfg.atime, 0);
+
+	md_stat_set_legacy(cfg.legacy);
+
+	for (n = 0; n < cfg.count.nr; n++)
+	for (b = 0; b < cfg.batch.nr; b++)
+	for (t = 0; t < cfg.threads.nr; t++) {
+		memset(&run, 0, sizeof(run));
+		run.count = cfg.count.val[n];
+		run.batch = cfg.batch.val[b];
+		run.threads = cfg.threads.val[t];
+		run.reps = cfg.reps;
+		run.base_ino = cfg.base_ino;
+
+		rc = bench_run(&cfg, &run);
+		if (rc != 0)
+			goto out;
+	}
+
+out:
+	/* Pending updates count as writes of this run */
+	md_wb_flush();
+	md_atime_stats(&touches, &updates);
+	fprintf(stderr, "md_atime: %llu reads, %llu atime updates\n",
+		(unsigned long long)touches, (unsigned long long)updates);
+	md_wb_stats(&updates, &writes);
+	fprintf(stderr, "md_wb: %llu updates, %llu attribute writes\n",
+		(unsigned long long)updates, (unsigned long long)writes);
+	md_atime_fini();
+	md_wb_fini();
+
+	if (cfg.cache_bytes != 0) {
+		md_acache_stats(&hits, &misses, &evictions);
+		fprintf(stderr, "md_acache: %llu hits, %llu misses, "
+			"%llu evictions\n", (unsigned long long)hits,
+			(unsigned long long)misses,
+			(unsigned long long)evictions);
+		md_acache_fini();
+	}
+
+	/* free resources*/
+	c0appz_free();
+
+	if (rc == 0)
+		fprintf(stderr, "%s success\n", basename(argv[0]));
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
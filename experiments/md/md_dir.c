@@ -0,0 +1,1068 @@
+/*
+ * Filename:         md_dir.c
+ * Description:      Directory entries and listings of the metadata experiments
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "../xattr/xattr_kvs.h"
+#include "md_acache.h"
+#include "md_wb.h"
+#include "md_kvs.h"
+#include "md_rec.h"
+#include "md_dir.h"
+#include "md_lcache.h"
+
+static enum md_dirent_layout dirent_layout = MD_DIRENT_NAME;
+
+void md_dirent_set_layout(enum md_dirent_layout layout)
+{
+	dirent_layout = layout;
+}
+
+/* Offset of the name_len byte in a dirent key */
+static size_t name_off(void)
+{
+	return MD_PREFIX_LEN +
+		(dirent_layout == MD_DIRENT_HASH ? MD_HASH_LEN : 0);
+}
+
+static size_t key_name_len(const char *key)
+{
+	return (uint8_t)key[name_off()];
+}
+
+static const char *key_name(const char *key)
+{
+	return key + name_off() + 1;
+}
+
+/* Allocates the key of the entry @name of @dir in a bufvec of one. */
+static int dirent_key(struct m0_bufvec *key, uint64_t dir, const char *name)
+{
+	int rc;
+
+	rc = m0_bufvec_alloc(key, 1, MD_KEY_MAX);
+	if (rc)
+		return rc;
+
+	rc = md_dirent_key(key->ov_buf[0], dir, name, dirent_layout);
+	if (rc < 0) {
+		m0_bufvec_free(key);
+		return rc;
+	}
+
+	key->ov_vec.v_count[0] = rc;
+	return 0;
+}
+
+/* One PUT of the entry @name -> @ino of @dir, with @flags of the op. */
+static int dirent_write(uint64_t dir, const char *name, uint64_t ino,
+			uint32_t flags)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	uint64_t be_ino = htobe64(ino);
+	int32_t rcs[1];
+	int rc;
+
+	rc = dirent_key(&key, dir, name);
+	if (rc)
+		return rc;
+
+	rc = m0_bufvec_empty_alloc(&val, 1);
+	if (rc)
+		goto free_key;
+
+	val.ov_buf[0] = &be_ino;
+	val.ov_vec.v_count[0] = sizeof(be_ino);
+
+	rc = md_kvs_op(M0_IC_PUT, &key, &val, rcs, flags);
+	if (rc == 0)
+		rc = rcs[0];
+	md_lcache_bump(dir);
+
+	val.ov_buf[0] = NULL;
+	m0_bufvec_free(&val);
+free_key:
+	m0_bufvec_free(&key);
+	return rc;
+}
+
+int md_dirent_put(uint64_t dir, const char *name, uint64_t ino)
+{
+	/* No M0_OIF_OVERWRITE: a name which is taken fails the record */
+	return dirent_write(dir, name, ino, 0);
+}
+
+int md_dirent_lookup(uint64_t dir, const char *name, uint64_t *ino)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	int32_t rcs[1];
+	int rc;
+
+	rc = dirent_key(&key, dir, name);
+	if (rc)
+		return rc;
+
+	rc = m0_bufvec_empty_alloc(&val, 1);
+	if (rc)
+		goto free_key;
+
+	rc = md_kvs_op(M0_IC_GET, &key, &val, rcs, 0);
+	if (rc == 0)
+		rc = rcs[0];
+	if (rc == 0 && val.ov_vec.v_count[0] != sizeof(*ino))
+		rc = -EIO;
+	if (rc == 0) {
+		memcpy(ino, val.ov_buf[0], sizeof(*ino));
+		*ino = be64toh(*ino);
+	}
+
+	m0_bufvec_free(&val);
+free_key:
+	m0_bufvec_free(&key);
+	return rc;
+}
+
+int md_dirent_del(uint64_t dir, const char *name)
+{
+	struct m0_bufvec key;
+	int32_t rcs[1];
+	int rc;
+
+	rc = dirent_key(&key, dir, name);
+	if (rc)
+		return rc;
+
+	rc = md_kvs_op(M0_IC_DEL, &key, NULL, rcs, 0);
+	if (rc == 0)
+		rc = rcs[0];
+	md_lcache_bump(dir);
+
+	m0_bufvec_free(&key);
+	return rc;
+}
+
+int md_dirent_rename(uint64_t dir, const char *name, uint64_t new_dir,
+		     const char *new_name)
+{
+	uint64_t ino, old;
+	int rc;
+
+	rc = md_dirent_lookup(dir, name, &ino);
+	if (rc)
+		return rc;
+
+	/* As rename(2), nothing to do when both name the same inode */
+	if (dir == new_dir && strcmp(name, new_name) == 0)
+		return 0;
+	rc = md_dirent_lookup(new_dir, new_name, &old);
+	if (rc == 0 && old == ino)
+		return 0;
+	if (rc && rc != -ENOENT)
+		return rc;
+
+	/* Replaces @new_name in place, so a failure keeps the old entry */
+	rc = dirent_write(new_dir, new_name, ino, M0_OIF_OVERWRITE);
+	if (rc)
+		return rc;
+
+	return md_dirent_del(dir, name);
+}
+
+static mode_t create_mode(mode_t mode)
+{
+	return (mode & S_IFMT) != 0 ? mode : S_IFREG | mode;
+}
+
+static void create_stat(struct stat *st, const struct md_cred *cred,
+			uint64_t ino, mode_t mode, const struct timespec *now)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_ino = ino;
+	st->st_mode = create_mode(mode);
+	st->st_nlink = S_ISDIR(st->st_mode) ? 2 : 1;
+	st->st_uid = cred->uid;
+	st->st_gid = cred->gid;
+	st->st_blksize = MD_REC_BLKSIZE;
+	st->st_atim = *now;
+	st->st_mtim = *now;
+	st->st_ctim = *now;
+}
+
+/* After the PUT of md_create_batch() failed as a whole, finds out with
+ * one GET which of its records landed: sets @op_rcs of an attribute
+ * record which exists, or of an entry which links the inode of the batch,
+ * to 0, and of every other record to -ENOENT.
+ */
+static int create_landed(struct m0_bufvec *key, const uint64_t *be_inos,
+			 int32_t *op_rcs, int n)
+{
+	struct m0_bufvec val;
+	int rc, j;
+
+	rc = m0_bufvec_empty_alloc(&val, 2 * n);
+	if (rc)
+		return rc;
+
+	rc = md_kvs_op(M0_IC_GET, key, &val, op_rcs, 0);
+	for (j = 0; rc == 0 && j < 2 * n; j++) {
+		if (op_rcs[j] != 0 || j % 2 == 0)
+			continue;
+		/* An entry of that name which was there before */
+		if (val.ov_vec.v_count[j] != sizeof(be_inos[0]) ||
+		    memcmp(val.ov_buf[j], &be_inos[j / 2],
+			   sizeof(be_inos[0])) != 0)
+			op_rcs[j] = -ENOENT;
+	}
+
+	m0_bufvec_free(&val);
+	if (rc)
+		fprintf(stderr, "error(%d): md_create_batch undo\n", rc);
+	return rc;
+}
+
+/* Removes the records which the PUT of md_create_batch() wrote for names
+ * whose other record failed, or with @all every record it wrote, with one
+ * DEL. Records come in pairs, the attributes and then the entry of each
+ * name.
+ */
+static void create_undo(struct m0_bufvec *key, const int32_t *op_rcs, int n,
+			bool all)
+{
+	struct m0_bufvec del;
+	int32_t *del_rcs;
+	int nr = 0;
+	int rc, j;
+
+	for (j = 0; j < 2 * n; j++)
+		if (op_rcs[j] == 0 && (all || op_rcs[j ^ 1] != 0))
+			nr++;
+	if (nr == 0)
+		return;
+
+	M0_ALLOC_ARR(del_rcs, nr);
+	rc = del_rcs == NULL ? -ENOMEM : m0_bufvec_empty_alloc(&del, nr);
+	if (rc)
+		goto out;
+
+	/* Keys point into @key */
+	nr = 0;
+	for (j = 0; j < 2 * n; j++) {
+		if (op_rcs[j] != 0 || (!all && op_rcs[j ^ 1] == 0))
+			continue;
+		del.ov_buf[nr] = key->ov_buf[j];
+		del.ov_vec.v_count[nr] = key->ov_vec.v_count[j];
+		nr++;
+	}
+
+	rc = md_kvs_op(M0_IC_DEL, &del, NULL, del_rcs, 0);
+
+	for (j = 0; j < nr; j++)
+		del.ov_buf[j] = NULL;
+	m0_bufvec_free(&del);
+out:
+	if (rc)
+		fprintf(stderr, "error(%d): md_create_batch undo\n", rc);
+	m0_free(del_rcs);
+}
+
+/* Updates the times and link count of @dir for a batch which created
+ * @subdirs directories in it. @dir is held in md_wb from its GET to its
+ * PUT, so that batches into the same directory, md_wb and md_setattr()
+ * do not lose each other's changes.
+ */
+static int create_parent(uint64_t dir, int subdirs)
+{
+	struct stat parent;
+	uint64_t held;
+	int rc;
+
+	rc = md_wb_hold(&dir, 1, &held);
+	if (rc)
+		return rc;
+
+	rc = md_stat_get(dir, &parent);
+	if (rc == 0) {
+		clock_gettime(CLOCK_REALTIME, &parent.st_mtim);
+		parent.st_ctim = parent.st_mtim;
+		parent.st_nlink += subdirs;
+		rc = md_stat_put(dir, &parent);
+	}
+
+	md_wb_release(held);
+	return rc;
+}
+
+int md_create_batch(const struct md_cred *cred, uint64_t dir,
+		    const char *const *names, const mode_t *modes,
+		    uint64_t *inos, int *rcs, int nr)
+{
+	char scratch[MD_KEY_MAX];
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	struct timespec now;
+	struct stat parent;
+	struct stat st;
+	uint64_t *be_inos = NULL;
+	int32_t *op_rcs = NULL;
+	char *recs = NULL;
+	uint64_t first;
+	int subdirs = 0;
+	int created = 0;
+	int n = 0;
+	int rc, i, k;
+
+	if (nr <= 0 || nr > MD_CREATE_BATCH_MAX)
+		return -EINVAL;
+
+	rc = md_stat_get(dir, &parent);
+	if (rc)
+		return rc;
+	if (!S_ISDIR(parent.st_mode))
+		return -ENOTDIR;
+
+	for (i = 0; i < nr; i++) {
+		inos[i] = 0;
+		rcs[i] = md_dirent_key((struct md_key *)scratch, dir, names[i],
+				       dirent_layout);
+		if (rcs[i] < 0)
+			continue;
+		rcs[i] = 0;
+		n++;
+	}
+	if (n == 0)
+		return 0;
+
+	rc = md_ino_reserve(n, &first);
+	if (rc)
+		return rc;
+
+	M0_ALLOC_ARR(be_inos, n);
+	M0_ALLOC_ARR(op_rcs, 2 * n);
+	recs = m0_alloc(n * MD_REC_MAX);
+	if (be_inos == NULL || op_rcs == NULL || recs == NULL) {
+		rc = -ENOMEM;
+		goto free;
+	}
+
+	rc = m0_bufvec_alloc(&key, 2 * n, MD_KEY_MAX);
+	if (rc)
+		goto free;
+
+	/* Values point into @recs and @be_inos */
+	rc = m0_bufvec_empty_alloc(&val, 2 * n);
+	if (rc)
+		goto free_key;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	for (i = 0, k = 0; i < nr; i++) {
+		if (rcs[i] != 0)
+			continue;
+		inos[i] = first + k / 2;
+
+		create_stat(&st, cred, inos[i], modes[i], &now);
+		key.ov_vec.v_count[k] = md_stat_key(key.ov_buf[k], inos[i]);
+		val.ov_buf[k] = recs + k / 2 * MD_REC_MAX;
+		val.ov_vec.v_count[k] = md_rec_encode(val.ov_buf[k], &st,
+						      inos[i], false);
+		k++;
+
+		be_inos[k / 2] = htobe64(inos[i]);
+		key.ov_vec.v_count[k] = md_dirent_key(key.ov_buf[k], dir,
+						      names[i], dirent_layout);
+		val.ov_buf[k] = &be_inos[k / 2];
+		val.ov_vec.v_count[k] = sizeof(be_inos[0]);
+		k++;
+	}
+
+	/* No M0_OIF_OVERWRITE: a name which is taken fails its entry */
+	rc = md_kvs_op(M0_IC_PUT, &key, &val, op_rcs, 0);
+	for (i = 0, k = 0; i < nr; i++) {
+		if (rcs[i] != 0)
+			continue;
+		if (rc)
+			rcs[i] = rc;
+		else if (op_rcs[k] != 0)
+			rcs[i] = op_rcs[k];
+		else
+			rcs[i] = op_rcs[k + 1];
+		if (rcs[i] == 0) {
+			created++;
+			if (S_ISDIR(create_mode(modes[i])))
+				subdirs++;
+		}
+		k += 2;
+	}
+	if (rc == 0)
+		create_undo(&key, op_rcs, n, false);
+	else if (create_landed(&key, be_inos, op_rcs, n) == 0)
+		create_undo(&key, op_rcs, n, true);
+	md_lcache_bump(dir);
+
+	for (i = 0; i < nr; i++)
+		if (rcs[i] != 0)
+			inos[i] = 0;
+
+	/* One update of @dir for the whole batch */
+	if (rc == 0 && created > 0)
+		rc = create_parent(dir, subdirs);
+
+	for (k = 0; k < 2 * n; k++)
+		val.ov_buf[k] = NULL;
+	m0_bufvec_free(&val);
+free_key:
+	m0_bufvec_free(&key);
+free:
+	m0_free(recs);
+	m0_free(op_rcs);
+	m0_free(be_inos);
+	return rc;
+}
+
+/* One M0_IC_NEXT over the entries of a directory. */
+struct dir_page {
+	struct m0_bufvec keys;
+	struct m0_bufvec vals;
+	int32_t *rcs;
+	/* In flight when not NULL */
+	struct m0_op *op;
+	void *start;
+	/* Records requested, and the leading ones which are entries of the
+	 * directory
+	 */
+	int nr;
+	int valid;
+};
+
+/* One multi-key GET of the attributes of the entries of a dir_page which
+ * missed md_acache.
+ */
+struct attr_page {
+	struct m0_bufvec keys;
+	struct m0_bufvec vals;
+	int32_t *rcs;
+	struct m0_op *op;
+	char (*kbuf)[MD_PREFIX_LEN];
+	/* Per entry of the page */
+	uint64_t *ino;
+	uint64_t *gen;
+	struct stat *st;
+	int *st_rc;
+	/* Entry of each record */
+	int *index;
+	int nr;
+};
+
+static int page_alloc(struct dir_page *pg, int cap)
+{
+	int rc;
+
+	memset(pg, 0, sizeof(*pg));
+
+	M0_ALLOC_ARR(pg->rcs, cap);
+	if (pg->rcs == NULL)
+		return -ENOMEM;
+
+	rc = m0_bufvec_empty_alloc(&pg->keys, cap);
+	if (rc)
+		return rc;
+
+	return m0_bufvec_empty_alloc(&pg->vals, cap);
+}
+
+/* Launches a NEXT of @nr records which follow the entry @after of the
+ * directory of @prefix, or start at it when @alen is 0.
+ */
+static int page_launch(struct dir_page *pg, const void *prefix,
+		       const void *after, size_t alen, int nr)
+{
+	int rc;
+
+	pg->start = m0_alloc(MD_KEY_MAX);
+	if (pg->start == NULL)
+		return -ENOMEM;
+
+	memcpy(pg->start, prefix, MD_PREFIX_LEN);
+	memcpy((char *)pg->start + MD_PREFIX_LEN, after, alen);
+
+	pg->nr = nr;
+	pg->valid = 0;
+	pg->keys.ov_vec.v_nr = nr;
+	pg->vals.ov_vec.v_nr = nr;
+	pg->keys.ov_buf[0] = pg->start;
+	pg->keys.ov_vec.v_count[0] = MD_PREFIX_LEN + alen;
+
+	/* The entry @after itself was handed out already */
+	rc = m0_idx_op(&xattr_idx, M0_IC_NEXT, &pg->keys, &pg->vals,
+		       pg->rcs, alen != 0 ? M0_OIF_EXCLUDE_START_KEY : 0,
+		       &pg->op);
+	if (rc) {
+		fprintf(stderr, "error(%d): m0_idx_op NEXT\n", rc);
+		pg->keys.ov_buf[0] = NULL;
+		m0_free(pg->start);
+		pg->start = NULL;
+		pg->op = NULL;
+		return rc;
+	}
+
+	m0_op_launch(&pg->op, 1);
+	return 0;
+}
+
+/* Waits for the NEXT in flight and counts its leading records which are
+ * entries of the directory of @prefix.
+ */
+static int page_wait(struct dir_page *pg, const void *prefix)
+{
+	const char *key;
+	size_t klen;
+	int rc, i;
+
+	rc = m0_op_wait(pg->op, M0_BITS(M0_OS_STABLE), M0_TIME_NEVER);
+	if (rc == 0)
+		rc = m0_rc(pg->op);
+	m0_op_fini(pg->op);
+	m0_op_free(pg->op);
+	pg->op = NULL;
+
+	/* Motr replaces the start key with the first returned one */
+	if (pg->keys.ov_buf[0] != pg->start)
+		m0_free(pg->start);
+	pg->start = NULL;
+
+	if (rc == -ENOENT)
+		rc = 0;
+	if (rc)
+		return rc;
+
+	for (i = 0; i < pg->nr; i++) {
+		key = pg->keys.ov_buf[i];
+		klen = pg->keys.ov_vec.v_count[i];
+		if (pg->rcs[i] != 0 || klen <= name_off() + 1 ||
+		    memcmp(key, prefix, MD_PREFIX_LEN) != 0)
+			break;
+		if (key_name_len(key) != klen - name_off() - 1 ||
+		    pg->vals.ov_vec.v_count[i] != sizeof(uint64_t))
+			return -EIO;
+	}
+
+	pg->valid = i;
+	return 0;
+}
+
+/* Frees the records Motr returned for the last NEXT. */
+static void page_release(struct dir_page *pg)
+{
+	int i;
+
+	for (i = 0; i < pg->nr; i++) {
+		m0_free(pg->keys.ov_buf[i]);
+		m0_free(pg->vals.ov_buf[i]);
+		pg->keys.ov_buf[i] = NULL;
+		pg->vals.ov_buf[i] = NULL;
+	}
+	pg->nr = pg->valid = 0;
+}
+
+static void page_free(struct dir_page *pg)
+{
+	if (pg->op != NULL) {
+		m0_op_wait(pg->op, M0_BITS(M0_OS_STABLE, M0_OS_FAILED),
+			   M0_TIME_NEVER);
+		m0_op_fini(pg->op);
+		m0_op_free(pg->op);
+		if (pg->keys.ov_buf[0] != pg->start)
+			m0_free(pg->start);
+	}
+
+	if (pg->keys.ov_buf != NULL && pg->vals.ov_buf != NULL)
+		page_release(pg);
+	if (pg->keys.ov_buf != NULL)
+		m0_bufvec_free(&pg->keys);
+	if (pg->vals.ov_buf != NULL)
+		m0_bufvec_free(&pg->vals);
+	m0_free(pg->rcs);
+}
+
+/* Entry @i of a page which page_wait() counted as valid. */
+static void page_entry(const struct dir_page *pg, int i, char *name,
+		       uint64_t *ino)
+{
+	const char *key = pg->keys.ov_buf[i];
+
+	memcpy(name, key_name(key), key_name_len(key));
+	name[key_name_len(key)] = '\0';
+	memcpy(ino, pg->vals.ov_buf[i], sizeof(*ino));
+	*ino = be64toh(*ino);
+}
+
+/* Moves @cookie to entry @i of @pg. */
+static void cookie_set(struct md_cookie *cookie, const struct dir_page *pg,
+		       int i)
+{
+	cookie->len = pg->keys.ov_vec.v_count[i] - MD_PREFIX_LEN;
+	memcpy(cookie->key, (const char *)pg->keys.ov_buf[i] + MD_PREFIX_LEN,
+	       cookie->len);
+}
+
+/* Clamps the entries of a call to what @max_bytes can hold at @min_cost
+ * per entry.
+ */
+static int call_entries(int max_entries, size_t max_bytes, size_t min_cost)
+{
+	if (max_entries > MD_READDIR_MAX)
+		max_entries = MD_READDIR_MAX;
+	if (max_bytes != 0 && (size_t)max_entries > max_bytes / min_cost)
+		max_entries = max_bytes / min_cost;
+	return max_entries > 0 ? max_entries : 1;
+}
+
+/* Lists @dir from the index: one NEXT of the call. */
+static int readdir_scan(uint64_t dir, struct md_cookie *cookie,
+			int max_entries, size_t max_bytes, md_readdir_cb_t cb,
+			void *ctx, bool *eof)
+{
+	char prefix[MD_KEY_MAX];
+	char name[MD_NAME_MAX + 1];
+	struct dir_page pg;
+	size_t bytes = 0;
+	size_t cost;
+	uint64_t ino;
+	int done = 0;
+	int rc, nr, i;
+
+	/* One more, to see whether the directory ends with this call */
+	nr = max_entries + 1;
+	md_dirent_key((struct md_key *)prefix, dir, NULL, dirent_layout);
+
+	rc = page_alloc(&pg, nr);
+	if (rc == 0)
+		rc = page_launch(&pg, prefix, cookie->key, cookie->len, nr);
+	if (rc == 0)
+		rc = page_wait(&pg, prefix);
+
+	for (i = 0; rc == 0 && i < pg.valid && i < max_entries; i++) {
+		cost = MD_DIRENT_COST(key_name_len(pg.keys.ov_buf[i]));
+		if (max_bytes != 0 && bytes + cost > max_bytes) {
+			if (done == 0)
+				rc = -EINVAL;
+			break;
+		}
+
+		page_entry(&pg, i, name, &ino);
+		if (!cb(ctx, name, ino))
+			break;
+
+		bytes += cost;
+		done++;
+		cookie_set(cookie, &pg, i);
+	}
+
+	/* Ran past the last entry of @dir */
+	if (rc == 0 && i == pg.valid && pg.valid < nr)
+		*eof = true;
+
+	page_free(&pg);
+	return rc < 0 ? rc : done;
+}
+
+/* Reads the MD_LCACHE_PAGE entries of @dir which follow @cookie into a
+ * page of md_lcache, and inserts it unless @dir changed since @version.
+ */
+static int lcache_fill(uint64_t dir, const struct md_cookie *cookie,
+		       uint64_t version, struct md_lcache_page **lp)
+{
+	char prefix[MD_KEY_MAX];
+	const char *key;
+	struct dir_page pg;
+	size_t key_bytes = 0;
+	uint64_t ino;
+	int rc, n, i;
+
+	md_dirent_key((struct md_key *)prefix, dir, NULL, dirent_layout);
+
+	rc = page_alloc(&pg, MD_LCACHE_PAGE + 1);
+	if (rc == 0)
+		rc = page_launch(&pg, prefix, cookie->key, cookie->len,
+				 MD_LCACHE_PAGE + 1);
+	if (rc == 0)
+		rc = page_wait(&pg, prefix);
+	if (rc)
+		goto out;
+
+	n = pg.valid < MD_LCACHE_PAGE ? pg.valid : MD_LCACHE_PAGE;
+	for (i = 0; i < n; i++)
+		key_bytes += pg.keys.ov_vec.v_count[i] - MD_PREFIX_LEN;
+
+	*lp = md_lcache_page_alloc(dir, version, cookie, n, key_bytes);
+	if (*lp == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < n; i++) {
+		key = pg.keys.ov_buf[i];
+		memcpy(&ino, pg.vals.ov_buf[i], sizeof(ino));
+		md_lcache_page_add(*lp, key + MD_PREFIX_LEN,
+				   pg.keys.ov_vec.v_count[i] - MD_PREFIX_LEN,
+				   key_name_len(key), be64toh(ino));
+	}
+	(*lp)->eof = pg.valid < pg.nr;
+
+	md_lcache_put(*lp);
+out:
+	page_free(&pg);
+	return rc;
+}
+
+/* Lists @dir from pages of md_lcache, reading those which miss. */
+static int readdir_cached(uint64_t dir, struct md_cookie *cookie,
+			  int max_entries, size_t max_bytes,
+			  md_readdir_cb_t cb, void *ctx, bool *eof)
+{
+	char name[MD_NAME_MAX + 1];
+	const struct md_lcache_ent *e;
+	struct md_lcache_page *lp;
+	uint64_t version;
+	bool stop = false;
+	size_t bytes = 0;
+	size_t cost;
+	int done = 0;
+	int rc = 0;
+	int pos;
+
+	while (!stop && !*eof && done < max_entries) {
+		if (md_lcache_get(dir, cookie, &lp, &pos, &version) != 0) {
+			rc = lcache_fill(dir, cookie, version, &lp);
+			if (rc)
+				break;
+			pos = 0;
+		}
+
+		for (; pos < lp->nr && done < max_entries; pos++) {
+			e = md_lcache_entry(lp, pos);
+			cost = MD_DIRENT_COST(e->name_len);
+			if (max_bytes != 0 && bytes + cost > max_bytes) {
+				if (done == 0)
+					rc = -EINVAL;
+				stop = true;
+				break;
+			}
+
+			/* The name ends the key */
+			memcpy(name, e->key + e->klen - e->name_len,
+			       e->name_len);
+			name[e->name_len] = '\0';
+			if (!cb(ctx, name, e->ino)) {
+				stop = true;
+				break;
+			}
+
+			bytes += cost;
+			done++;
+			cookie->len = e->klen;
+			memcpy(cookie->key, e->key, e->klen);
+		}
+
+		if (pos == lp->nr && lp->eof)
+			*eof = true;
+		/* Only the next call goes on from the middle of a page */
+		if (pos < lp->nr)
+			stop = true;
+		md_lcache_release(lp);
+	}
+
+	return rc < 0 ? rc : done;
+}
+
+int md_readdir(uint64_t dir, struct md_cookie *cookie, int max_entries,
+	       size_t max_bytes, md_readdir_cb_t cb, void *ctx, bool *eof)
+{
+	*eof = false;
+	if (max_entries <= 0 || cookie->len > MD_COOKIE_MAX)
+		return -EINVAL;
+
+	max_entries = call_entries(max_entries, max_bytes,
+				   MD_DIRENT_COST(1));
+	if (md_lcache_enabled())
+		return readdir_cached(dir, cookie, max_entries, max_bytes, cb,
+				      ctx, eof);
+	return readdir_scan(dir, cookie, max_entries, max_bytes, cb, ctx,
+			    eof);
+}
+
+static int attr_alloc(struct attr_page *ap, int cap)
+{
+	int i;
+
+	M0_ALLOC_ARR(ap->rcs, cap);
+	M0_ALLOC_ARR(ap->kbuf, cap);
+	M0_ALLOC_ARR(ap->ino, cap);
+	M0_ALLOC_ARR(ap->gen, cap);
+	M0_ALLOC_ARR(ap->st, cap);
+	M0_ALLOC_ARR(ap->st_rc, cap);
+	M0_ALLOC_ARR(ap->index, cap);
+	M0_ALLOC_ARR(ap->keys.ov_buf, cap);
+	M0_ALLOC_ARR(ap->keys.ov_vec.v_count, cap);
+	if (ap->rcs == NULL || ap->kbuf == NULL || ap->ino == NULL ||
+	    ap->gen == NULL || ap->st == NULL || ap->st_rc == NULL ||
+	    ap->index == NULL || ap->keys.ov_buf == NULL ||
+	    ap->keys.ov_vec.v_count == NULL)
+		return -ENOMEM;
+
+	/* Keys point into @kbuf; values are allocated by Motr */
+	for (i = 0; i < cap; i++) {
+		ap->keys.ov_buf[i] = ap->kbuf[i];
+		ap->keys.ov_vec.v_count[i] = MD_PREFIX_LEN;
+	}
+
+	return m0_bufvec_empty_alloc(&ap->vals, cap);
+}
+
+/* Takes the attributes of the first @n entries of @pg from md_acache and
+ * launches one GET for those which miss it.
+ */
+static int attr_launch(struct attr_page *ap, const struct dir_page *pg,
+		       int n)
+{
+	uint64_t be_ino;
+	int rc, i;
+
+	ap->nr = 0;
+	for (i = 0; i < n; i++) {
+		memcpy(&be_ino, pg->vals.ov_buf[i], sizeof(be_ino));
+		ap->ino[i] = be64toh(be_ino);
+		ap->st_rc[i] = md_acache_get(ap->ino[i], &ap->st[i],
+					     &ap->gen[i]);
+		if (ap->st_rc[i] == 0)
+			continue;
+
+		md_stat_key((struct md_key *)ap->kbuf[ap->nr], ap->ino[i]);
+		ap->index[ap->nr++] = i;
+	}
+
+	if (ap->nr == 0)
+		return 0;
+
+	ap->keys.ov_vec.v_nr = ap->nr;
+	ap->vals.ov_vec.v_nr = ap->nr;
+	rc = m0_idx_op(&xattr_idx, M0_IC_GET, &ap->keys, &ap->vals, ap->rcs,
+		       0, &ap->op);
+	if (rc) {
+		fprintf(stderr, "error(%d): m0_idx_op GET\n", rc);
+		ap->op = NULL;
+		ap->nr = 0;
+		return rc;
+	}
+
+	m0_op_launch(&ap->op, 1);
+	return 0;
+}
+
+/* Waits for the GET in flight, if any, and fills in the attributes of
+ * every entry, with the updates pending in md_wb on top.
+ */
+static int attr_wait(struct attr_page *ap, int n)
+{
+	int rc = 0;
+	int i, j;
+
+	if (ap->op != NULL) {
+		rc = m0_op_wait(ap->op, M0_BITS(M0_OS_STABLE), M0_TIME_NEVER);
+		if (rc == 0)
+			rc = m0_rc(ap->op);
+		m0_op_fini(ap->op);
+		m0_op_free(ap->op);
+		ap->op = NULL;
+	}
+
+	for (j = 0; j < ap->nr; j++) {
+		i = ap->index[j];
+		if (rc)
+			ap->st_rc[i] = rc;
+		else if (ap->rcs[j])
+			ap->st_rc[i] = ap->rcs[j];
+		else
+			ap->st_rc[i] = md_rec_decode(ap->vals.ov_buf[j],
+						     ap->vals.ov_vec.v_count[j],
+						     ap->ino[i], &ap->st[i]);
+		if (ap->st_rc[i] == 0)
+			md_acache_put(ap->ino[i], &ap->st[i], ap->gen[i]);
+
+		m0_free(ap->vals.ov_buf[j]);
+		ap->vals.ov_buf[j] = NULL;
+	}
+
+	for (i = 0; i < n; i++)
+		if (ap->st_rc[i] == 0)
+			md_wb_peek(ap->ino[i], &ap->st[i]);
+
+	return rc;
+}
+
+static void attr_free(struct attr_page *ap, int cap)
+{
+	if (ap->op != NULL)
+		attr_wait(ap, 0);
+
+	if (ap->vals.ov_buf != NULL) {
+		ap->vals.ov_vec.v_nr = cap;
+		m0_bufvec_free(&ap->vals);
+	}
+	m0_free(ap->keys.ov_vec.v_count);
+	m0_free(ap->keys.ov_buf);
+	m0_free(ap->index);
+	m0_free(ap->st_rc);
+	m0_free(ap->st);
+	m0_free(ap->gen);
+	m0_free(ap->ino);
+	m0_free(ap->kbuf);
+	m0_free(ap->rcs);
+}
+
+int md_readdirplus(uint64_t dir, struct md_cookie *cookie, int max_entries,
+		   size_t max_bytes, md_readdirplus_cb_t cb, void *ctx,
+		   bool *eof)
+{
+	char prefix[MD_KEY_MAX];
+	char name[MD_NAME_MAX + 1];
+	const char *key;
+	struct dir_page page[2];
+	struct dir_page *pg;
+	struct attr_page ap;
+	bool more = false;
+	size_t bytes = 0;
+	size_t planned;
+	uint64_t ino;
+	int done = 0;
+	int cur = 0;
+	int rc, rc2;
+	int want, n, i;
+
+	*eof = false;
+	if (max_entries <= 0 || cookie->len > MD_COOKIE_MAX)
+		return -EINVAL;
+
+	memset(page, 0, sizeof(page));
+	memset(&ap, 0, sizeof(ap));
+	max_entries = call_entries(max_entries, max_bytes,
+				   MD_DIRENTPLUS_COST(1));
+	md_dirent_key((struct md_key *)prefix, dir, NULL, dirent_layout);
+
+	rc = page_alloc(&page[0], MD_READDIRPLUS_PAGE + 1);
+	if (rc == 0)
+		rc = page_alloc(&page[1], MD_READDIRPLUS_PAGE + 1);
+	if (rc == 0)
+		rc = attr_alloc(&ap, MD_READDIRPLUS_PAGE);
+
+	want = max_entries < MD_READDIRPLUS_PAGE ? max_entries :
+						   MD_READDIRPLUS_PAGE;
+	if (rc == 0)
+		rc = page_launch(&page[0], prefix, cookie->key, cookie->len,
+				 want + 1);
+
+	while (rc == 0) {
+		pg = &page[cur];
+		rc = page_wait(pg, prefix);
+		if (rc)
+			break;
+
+		/* Entries of this page which the call returns, as far as the
+		 * byte budget goes; only the callback may stop it earlier.
+		 */
+		planned = bytes;
+		for (n = 0; n < pg->valid && n < want; n++) {
+			key = pg->keys.ov_buf[n];
+			planned += MD_DIRENTPLUS_COST(key_name_len(key));
+			if (max_bytes != 0 && planned > max_bytes)
+				break;
+		}
+		if (n == 0 && done == 0 && pg->valid > 0) {
+			rc = -EINVAL;
+			break;
+		}
+
+		/* The dirents of the next page are read while the attributes
+		 * of this one are
+		 */
+		more = n == want && pg->valid > n && done + n < max_entries;
+		if (more) {
+			want = max_entries - done - n;
+			if (want > MD_READDIRPLUS_PAGE)
+				want = MD_READDIRPLUS_PAGE;
+			key = pg->keys.ov_buf[n - 1];
+			rc = page_launch(&page[!cur], prefix,
+					 key + MD_PREFIX_LEN,
+					 pg->keys.ov_vec.v_count[n - 1] -
+					 MD_PREFIX_LEN, want + 1);
+			if (rc)
+				break;
+		}
+
+		rc = attr_launch(&ap, pg, n);
+		rc2 = attr_wait(&ap, n);
+		if (rc == 0)
+			rc = rc2;
+		if (rc)
+			break;
+
+		for (i = 0; i < n; i++) {
+			page_entry(pg, i, name, &ino);
+			if (!cb(ctx, name, ino,
+				ap.st_rc[i] == 0 ? &ap.st[i] : NULL))
+				break;
+			bytes += MD_DIRENTPLUS_COST(strlen(name));
+			done++;
+			cookie_set(cookie, pg, i);
+		}
+
+		/* Ran past the last entry of @dir */
+		if (i == pg->valid && pg->valid < pg->nr)
+			*eof = true;
+
+		page_release(pg);
+		if (i < n || !more)
+			break;
+		cur = !cur;
+	}
+
+	attr_free(&ap, MD_READDIRPLUS_PAGE);
+	page_free(&page[1]);
+	page_free(&page[0]);
+	return rc < 0 ? rc : done;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
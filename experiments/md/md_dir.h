@@ -0,0 +1,160 @@
+/*
+ * Filename:         md_dir.h
+ * Description:      Directory entries and listings of the metadata experiments
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _MD_DIR_H
+#define _MD_DIR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "md_kvs.h"
+
+/* Selects the layout of the dirent keys, see md_kvs.h, for every following
+ * call. Chosen per process for the experiments; a directory which outlives
+ * them has to record its layout in its inode, since entries of one layout
+ * are not found under the other.
+ */
+void md_dirent_set_layout(enum md_dirent_layout layout);
+
+/* Adds the entry @name -> @ino to @dir; -EEXIST if the name is taken.
+ * Create and link both come down to this. Every change of a directory
+ * bumps its version in md_lcache.
+ */
+int md_dirent_put(uint64_t dir, const char *name, uint64_t ino);
+int md_dirent_lookup(uint64_t dir, const char *name, uint64_t *ino);
+int md_dirent_del(uint64_t dir, const char *name);
+
+/* Moves the entry @name of @dir to @new_name of @new_dir, replacing an
+ * entry of that name with one overwriting PUT. Does nothing when both
+ * names are the same entry or link the same inode, as rename(2). Not
+ * atomic: a failure can leave the entry in both directories, but never
+ * loses the one it replaces.
+ */
+int md_dirent_rename(uint64_t dir, const char *name, uint64_t new_dir,
+		     const char *new_name);
+
+/* Largest batch of md_create_batch(), which writes two records a name */
+#define MD_CREATE_BATCH_MAX	(MD_BATCH_MAX / 2)
+
+/* Creates the entries @names of @dir, each linking a new inode of
+ * @modes[i] owned by @cred, as untar, rsync and other ingest workloads
+ * create many files in one directory. A mode without a file type makes a
+ * regular file.
+ *
+ * Where @nr creates one by one would each reserve an inode number, write
+ * the inode and the entry and update @dir, the batch reads @dir once,
+ * reserves all inode numbers with one md_ino_reserve(), writes every
+ * attribute record and entry with one multi-key PUT and then updates the
+ * times and link count of @dir with one more GET and PUT. @dir is held in
+ * md_wb between those, so concurrent batches into one directory do not
+ * lose each other's link counts. Bumps the version of @dir in md_lcache
+ * once.
+ *
+ * @rcs returns the result of each name: 0 with its new inode in @inos,
+ * -EINVAL for a bad name, -EEXIST when it is taken, or the error of its
+ * records; @inos of a name which failed is 0, and its records are removed
+ * again. Should the PUT fail as a whole, one GET finds the records of the
+ * batch which landed anyway, and they are removed. The call returns 0
+ * when the batch ran, -ENOTDIR if @dir is no directory, or the error of
+ * an op as a whole, which the names it covered get as well.
+ */
+int md_create_batch(const struct md_cred *cred, uint64_t dir,
+		    const char *const *names, const mode_t *modes,
+		    uint64_t *inos, int *rcs, int nr);
+
+/* Where a listing resumes: the dirent key of the last entry handed out,
+ * past the directory prefix. Opaque to the caller, who only keeps it
+ * between calls; all zero is the start of the directory.
+ */
+#define MD_COOKIE_MAX	(MD_KEY_MAX - MD_PREFIX_LEN)
+
+struct md_cookie {
+	uint16_t len;
+	char key[MD_COOKIE_MAX];
+};
+
+static inline void md_cookie_init(struct md_cookie *cookie)
+{
+	cookie->len = 0;
+}
+
+/* Bytes an entry takes in a READDIR reply, as an NFSv3 entry3: fileid,
+ * name, cookie and the link to the next entry.
+ */
+#define MD_DIRENT_COST(name_len)	(24 + (((name_len) + 3) & ~3))
+
+/* Largest number of entries one md_readdir() call returns */
+#define MD_READDIR_MAX	1024
+
+/* As cfs_readdir_cb_t. @name is only valid during the call. Returning
+ * false stops the listing before the entry, which the next call starts
+ * with.
+ */
+typedef bool (*md_readdir_cb_t)(void *ctx, const char *name, uint64_t ino);
+
+/* Hands the entries of @dir which follow @cookie to @cb, in key order, at
+ * most @max_entries of them, capped at MD_READDIR_MAX, and as many as fit
+ * in @max_bytes by MD_DIRENT_COST(), 0 for no limit. @cookie is moved
+ * past each entry handed out, and @eof is set when no entry follows.
+ *
+ * Costs a single M0_IC_NEXT of one record more than the call may return,
+ * so the end of the directory is seen without another round trip. An
+ * entry removed after it was handed out is still a valid cookie: the
+ * listing goes on with the next key.
+ *
+ * Once md_lcache_init() was called, entries come from pages of md_lcache
+ * instead, and a call reads a page of MD_LCACHE_PAGE entries on a miss.
+ *
+ * Returns the number of entries handed out, -EINVAL if not even the first
+ * one fits in @max_bytes, or the error of the op.
+ */
+int md_readdir(uint64_t dir, struct md_cookie *cookie, int max_entries,
+	       size_t max_bytes, md_readdir_cb_t cb, void *ctx, bool *eof);
+
+/* Bytes an entry takes in a READDIRPLUS reply, as an NFSv3 entryplus3:
+ * the entry3 fields, post_op_attr and a post_op_fh3 of a 32 byte handle.
+ */
+#define MD_DIRENTPLUS_COST(name_len)	(MD_DIRENT_COST(name_len) + 88 + 40)
+
+/* Entries per NEXT and attribute GET of md_readdirplus() */
+#define MD_READDIRPLUS_PAGE	128
+
+/* As md_readdir_cb_t, with the attributes of the entry, NULL when they
+ * could not be read, e.g. because the inode was just removed.
+ */
+typedef bool (*md_readdirplus_cb_t)(void *ctx, const char *name,
+				    uint64_t ino, const struct stat *st);
+
+/* Same as md_readdir(), but hands each entry to @cb together with the
+ * attributes of its inode, the way md_fh_from_ino() reads them: from
+ * md_acache if cached, with updates pending in md_wb on top. Entries are
+ * counted against @max_bytes by MD_DIRENTPLUS_COST().
+ *
+ * The call works through pages of MD_READDIRPLUS_PAGE entries. The
+ * attributes of a page are read with one multi-key GET, for the inodes
+ * missing from md_acache, which is in flight together with the NEXT of
+ * the following page; so a listing with attributes costs about the round
+ * trips of the dirent scan alone, instead of one GET per entry. Entries
+ * always come from the index, not from md_lcache.
+ */
+int md_readdirplus(uint64_t dir, struct md_cookie *cookie, int max_entries,
+		   size_t max_bytes, md_readdirplus_cb_t cb, void *ctx,
+		   bool *eof);
+
+#endif /* _MD_DIR_H */
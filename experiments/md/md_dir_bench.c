@@ -0,0 +1,774 @@
+/*
+ * Filename:         md_dir_bench.c
+ * Description:      Throughput and latency of directory operations
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This driver runs the following experiment for every combination of the
+ * swept parameters:
+ * - selects the dirent key layout of md_kvs.h, -l
+ * - each thread owns a directory and creates N files in it: for each
+ *   reserves an inode number, writes the attribute record and the entry
+ *   and updates the times of the directory, or with -c creates them in
+ *   batches with md_create_batch, as an ingest workload would
+ * - looks up every entry by name, in an order which jumps over the whole
+ *   directory, and checks its inode
+ * - lists the directory as an NFS server does for READDIR: one md_readdir
+ *   per reply, of at most -b entries and -B bytes, each resuming from the
+ *   cookie of the one before; checks that every entry shows up exactly
+ *   once and with its current name
+ * - lists it BENCH_RELISTS more times, as a hot directory is; with -d the
+ *   listings are served from md_lcache
+ * - renames every entry, which must invalidate the cached listing
+ * - lists it again and makes a handle of every entry, as ls -l does today
+ *   with cfs_fh_from_ino; latencies are per reply
+ * - lists it with md_readdirplus, which returns the same attributes
+ * - removes the files
+ * -o leaves out the phases between create and unlink which are not
+ * listed. For each phase one result row is printed with throughput
+ * (entries/s), the time spent per entry and per-call latency percentiles,
+ * merged over all threads and repetitions. Sweeping -n shows how the cost
+ * of each operation grows with the size of the directory.
+ *
+ * Build together with md_acache.c, md_dir.c, md_fh.c, md_kvs.c,
+ * md_lcache.c, md_rec.c, md_wb.c, ../xattr/xattr_kvs.c,
+ * ../xattr/xattr_kvs_async.c, ../common/bench.c and ../common/perf_hist.c
+ * against Motr and liburcu-bp.
+ *
+ * Examples:
+ *   md_dir_bench -n 1000,100000 -b 64,1024 -B 4096 -t 1,8 -d 67108864
+ *   md_dir_bench -l name,hash -n 10000,100000,1000000,10000000 -b 1024 \
+ *       -o create,lookup,readdir,unlink
+ *   md_dir_bench -n 100000 -c 128 -o create,readdirplus,unlink
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "../common/bench.h"
+#include "../xattr/xattr_kvs.h"
+#include "md_kvs.h"
+#include "md_dir.h"
+#include "md_fh.h"
+#include "md_lcache.h"
+
+#define DEFAULT_INO 0x20000000ULL
+#define BENCH_NAME_LEN 32
+#define BENCH_RELISTS 4
+
+enum bench_op {
+	BENCH_CREATE,
+	BENCH_LOOKUP,
+	BENCH_READDIR,
+	BENCH_RELIST,
+	BENCH_RENAME,
+	BENCH_READDIR_STAT,
+	BENCH_READDIRPLUS,
+	BENCH_UNLINK,
+	BENCH_OP_NR,
+};
+
+static const char *bench_op_name[BENCH_OP_NR] = {
+	[BENCH_CREATE] = "create",
+	[BENCH_LOOKUP] = "lookup",
+	[BENCH_READDIR] = "readdir",
+	[BENCH_RELIST] = "relist",
+	[BENCH_RENAME] = "rename",
+	[BENCH_READDIR_STAT] = "readdir_stat",
+	[BENCH_READDIRPLUS] = "readdirplus",
+	[BENCH_UNLINK] = "unlink",
+};
+
+static const char *bench_layout_name[] = {
+	[MD_DIRENT_NAME] = "name",
+	[MD_DIRENT_HASH] = "hash",
+};
+
+#define NR_LAYOUTS \
+	(int)(sizeof(bench_layout_name) / sizeof(bench_layout_name[0]))
+
+struct bench_cfg {
+	enum md_dirent_layout layout[NR_LAYOUTS];
+	int nr_layouts;
+	unsigned int ops;
+	struct bench_sweep count;
+	struct bench_sweep page;
+	struct bench_sweep threads;
+	size_t page_bytes;
+	size_t lcache_bytes;
+	int batch;
+	int reps;
+	uint64_t base_ino;
+	bool json;
+};
+
+/* Parameters of one point in the sweep. */
+struct bench_run {
+	enum md_dirent_layout layout;
+	unsigned int ops;
+	int count;
+	int page;
+	int threads;
+	size_t page_bytes;
+	int batch;
+	int reps;
+	uint64_t base_ino;
+	struct bench_clock clock;
+};
+
+struct bench_thread {
+	int index;
+	struct bench_run *run;
+	struct bench_stats stats[BENCH_OP_NR];
+};
+
+/* The directory of a thread. Entry i is named after i with the current
+ * prefix and links inode inos[i], reserved by the create phase.
+ */
+struct bench_dir {
+	uint64_t ino;
+	uint64_t *inos;
+	const char *prefix;
+};
+
+/* State of one listing, carried over the md_readdir calls. The order of
+ * the entries depends on the layout, so they are checked off in @seen.
+ */
+struct bench_list {
+	const struct bench_dir *dir;
+	int count;
+	uint8_t *seen;
+	int nr;
+	uint64_t errors;
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+"Usage: %s [-l layouts] [-n counts] [-b entries] [-B bytes] [-t threads]\n"
+"          [-c batch] [-d bytes] [-o ops] [-r reps] [-i ino]\n"
+"          [-f csv|json]\n"
+"  -l  dirent key layouts (name,hash), default name\n"
+"  -n  entries per directory, default 1000\n"
+"  -b  entries per readdir call, default 256\n"
+"  -B  bytes per readdir call, as NFSv3 entries, default 0 for no limit\n"
+"  -t  threads, each on its own directory, default 1\n"
+"  -c  create files with md_create_batch, this many a call, up to %d\n"
+"  -d  cache listings in md_lcache, with this memory budget\n"
+"  -o  comma separated operations to run, default all of\n"
+"      create,lookup,readdir,relist,rename,readdir_stat,readdirplus,\n"
+"      unlink; create and unlink always run\n"
+"  -r  repetitions merged into each result row, default 1\n"
+"  -i  inode number of the first directory, default %llu\n"
+"  -f  output format, default csv\n"
+"  -l, -n, -b and -t take comma separated lists which are swept.\n",
+		prog, MD_CREATE_BATCH_MAX, DEFAULT_INO);
+}
+
+static int parse_layouts(const char *arg, struct bench_cfg *cfg)
+{
+	char *copy = strdup(arg);
+	char *save = NULL;
+	char *tok;
+	int i;
+
+	cfg->nr_layouts = 0;
+	for (tok = strtok_r(copy, ",", &save); tok != NULL;
+	     tok = strtok_r(NULL, ",", &save)) {
+		for (i = 0; i < NR_LAYOUTS; i++)
+			if (strcmp(tok, bench_layout_name[i]) == 0)
+				break;
+		if (i == NR_LAYOUTS || cfg->nr_layouts == NR_LAYOUTS) {
+			fprintf(stderr, "unknown layout %s\n", tok);
+			free(copy);
+			return -EINVAL;
+		}
+		cfg->layout[cfg->nr_layouts++] = i;
+	}
+
+	free(copy);
+	return cfg->nr_layouts > 0 ? 0 : -EINVAL;
+}
+
+static int parse_args(int argc, char **argv, struct bench_cfg *cfg)
+{
+	int opt;
+	int rc = 0;
+
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->layout[0] = MD_DIRENT_NAME;
+	cfg->nr_layouts = 1;
+	cfg->ops = (1U << BENCH_OP_NR) - 1;
+	bench_sweep_parse("1000", &cfg->count);
+	bench_sweep_parse("256", &cfg->page);
+	bench_sweep_parse("1", &cfg->threads);
+	cfg->reps = 1;
+	cfg->base_ino = DEFAULT_INO;
+
+	while (rc == 0 &&
+	       (opt = getopt(argc, argv, "l:n:b:B:t:c:d:o:r:i:f:h")) != -1) {
+		switch (opt) {
+		case 'l':
+			rc = parse_layouts(optarg, cfg);
+			break;
+		case 'n':
+			rc = bench_sweep_parse(optarg, &cfg->count);
+			break;
+		case 'b':
+			rc = bench_sweep_parse(optarg, &cfg->page);
+			break;
+		case 'B':
+			cfg->page_bytes = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			rc = bench_sweep_parse(optarg, &cfg->threads);
+			break;
+		case 'c':
+			cfg->batch = atoi(optarg);
+			if (cfg->batch <= 0 || cfg->batch > MD_CREATE_BATCH_MAX)
+				rc = -EINVAL;
+			break;
+		case 'd':
+			cfg->lcache_bytes = strtoul(optarg, NULL, 0);
+			if (cfg->lcache_bytes == 0)
+				rc = -EINVAL;
+			break;
+		case 'o':
+			rc = bench_ops_parse(optarg, bench_op_name, BENCH_OP_NR,
+					     &cfg->ops);
+			break;
+		case 'r':
+			cfg->reps = atoi(optarg);
+			break;
+		case 'i':
+			cfg->base_ino = strtoull(optarg, NULL, 0);
+			break;
+		case 'f':
+			if (strcmp(optarg, "json") == 0)
+				cfg->json = true;
+			else if (strcmp(optarg, "csv") != 0)
+				rc = -EINVAL;
+			break;
+		default:
+			rc = -EINVAL;
+			break;
+		}
+	}
+
+	if (rc == 0 && (bench_sweep_max(&cfg->threads) > BENCH_THREADS_MAX ||
+			bench_sweep_max(&cfg->page) > MD_READDIR_MAX))
+		rc = -EINVAL;
+
+	if (rc == 0 && cfg->reps <= 0)
+		rc = -EINVAL;
+
+	/* The other phases need the entries, and leave them for the next */
+	cfg->ops |= 1U << BENCH_CREATE | 1U << BENCH_UNLINK;
+
+	return rc;
+}
+
+/* Fixed width, so that name order is the order of @i. */
+static void bench_name(char *name, const char *prefix, int i)
+{
+	snprintf(name, BENCH_NAME_LEN, "%s%010d", prefix, i);
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+	uint64_t t;
+
+	while (b != 0) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* Stride of the lookup order of @n entries, i -> i * stride % n. Since
+ * gcd(stride, n) = 1 it visits every entry once, and near n times the
+ * golden ratio consecutive lookups land far apart in the directory.
+ */
+static uint64_t bench_stride(uint64_t n)
+{
+	uint64_t stride = n * 0.6180339887 + 1;
+
+	while (gcd(stride, n) != 1)
+		stride++;
+	return stride;
+}
+
+static uint64_t bench_ino(const struct bench_dir *dir, int i)
+{
+	return dir->inos[i];
+}
+
+static bool bench_list_cb(void *ctx, const char *name, uint64_t ino)
+{
+	struct bench_list *list = ctx;
+	size_t len = strlen(list->dir->prefix);
+	char *end;
+	long i;
+
+	/* The name carries the index of the entry */
+	if (strncmp(name, list->dir->prefix, len) != 0) {
+		list->errors++;
+		return true;
+	}
+
+	i = strtol(name + len, &end, 10);
+	if (*end != '\0' || i < 0 || i >= list->count ||
+	    list->seen[i / 8] & (1U << i % 8) ||
+	    ino != bench_ino(list->dir, i)) {
+		list->errors++;
+		return true;
+	}
+
+	list->seen[i / 8] |= 1U << i % 8;
+	list->nr++;
+	return true;
+}
+
+static bool bench_list_stat_cb(void *ctx, const char *name, uint64_t ino)
+{
+	struct bench_list *list = ctx;
+	struct md_fh *fh;
+
+	if (md_fh_from_ino(ino, &fh) != 0) {
+		list->errors++;
+	} else {
+		if (md_fh_stat(fh)->st_ino != ino)
+			list->errors++;
+		md_fh_destroy(fh);
+	}
+	return bench_list_cb(ctx, name, ino);
+}
+
+static bool bench_listplus_cb(void *ctx, const char *name, uint64_t ino,
+			      const struct stat *st)
+{
+	struct bench_list *list = ctx;
+
+	if (st == NULL || st->st_ino != ino)
+		list->errors++;
+	return bench_list_cb(ctx, name, ino);
+}
+
+static void bench_stat_init(struct stat *st, uint64_t ino)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	memset(st, 0, sizeof(*st));
+	st->st_ino = ino;
+	st->st_mode = S_IFREG | 0644;
+	st->st_nlink = 1;
+	st->st_blksize = 4096;
+	st->st_atim = now;
+	st->st_mtim = now;
+	st->st_ctim = now;
+}
+
+/* Creates the entries of @dir with md_create_batch(), -c at a time. */
+static void bench_create_batch(struct bench_thread *bt, struct bench_dir *dir)
+{
+	struct bench_run *run = bt->run;
+	struct md_cred cred = { .uid = 0, .gid = 0 };
+	char names[MD_CREATE_BATCH_MAX][BENCH_NAME_LEN];
+	const char *np[MD_CREATE_BATCH_MAX];
+	mode_t modes[MD_CREATE_BATCH_MAX];
+	int rcs[MD_CREATE_BATCH_MAX];
+	int base, created, rc, n, i;
+	uint64_t t0;
+
+	for (base = 0; base < run->count; base += run->batch) {
+		n = run->count - base;
+		if (n > run->batch)
+			n = run->batch;
+		for (i = 0; i < n; i++) {
+			bench_name(names[i], dir->prefix, base + i);
+			np[i] = names[i];
+			modes[i] = S_IFREG | 0644;
+		}
+
+		t0 = perf_now_ns();
+		rc = md_create_batch(&cred, dir->ino, np, modes,
+				     dir->inos + base, rcs, n);
+		created = 0;
+		for (i = 0; rc == 0 && i < n; i++)
+			if (rcs[i] == 0)
+				created++;
+		bench_record(&bt->stats[BENCH_CREATE], created,
+			     rc || created != n, t0);
+	}
+}
+
+/* Creates the entries of @dir one by one, as the batch replaces: reserves
+ * the inode number, writes the attributes and the entry, and updates the
+ * times of @dir with a GET and a PUT.
+ */
+static int bench_create_one(struct bench_dir *dir, const char *name,
+			    uint64_t *ino)
+{
+	struct stat st;
+	int rc;
+
+	rc = md_ino_reserve(1, ino);
+	if (rc)
+		return rc;
+
+	bench_stat_init(&st, *ino);
+	rc = md_stat_put(*ino, &st);
+	if (rc == 0)
+		rc = md_dirent_put(dir->ino, name, *ino);
+	if (rc == 0)
+		rc = md_stat_get(dir->ino, &st);
+	if (rc == 0) {
+		clock_gettime(CLOCK_REALTIME, &st.st_mtim);
+		st.st_ctim = st.st_mtim;
+		rc = md_stat_put(dir->ino, &st);
+	}
+	return rc;
+}
+
+/* Lists the whole directory, one call per reply. */
+static void bench_list(struct bench_thread *bt, enum bench_op op,
+		       const struct bench_dir *dir)
+{
+	struct bench_run *run = bt->run;
+	struct md_cookie cookie;
+	struct bench_list list;
+	uint64_t t0;
+	bool eof;
+	int rc;
+
+	md_cookie_init(&cookie);
+	list.dir = dir;
+	list.count = run->count;
+	list.seen = calloc((run->count + 7) / 8, 1);
+	list.nr = 0;
+	list.errors = 0;
+	if (list.seen == NULL) {
+		bt->stats[op].errors++;
+		return;
+	}
+
+	do {
+		t0 = perf_now_ns();
+		if (op == BENCH_READDIRPLUS)
+			rc = md_readdirplus(dir->ino, &cookie, run->page,
+					    run->page_bytes, bench_listplus_cb,
+					    &list, &eof);
+		else
+			rc = md_readdir(dir->ino, &cookie, run->page,
+					run->page_bytes,
+					op == BENCH_READDIR_STAT ?
+					bench_list_stat_cb : bench_list_cb,
+					&list, &eof);
+		bench_record(&bt->stats[op], rc > 0 ? rc : 0, rc < 0, t0);
+	} while (rc >= 0 && !eof);
+
+	if (list.nr != run->count)
+		list.errors++;
+	bt->stats[op].errors += list.errors;
+	free(list.seen);
+}
+
+static void bench_phase(struct bench_thread *bt, enum bench_op op,
+			struct bench_dir *dir)
+{
+	struct bench_run *run = bt->run;
+	struct bench_stats *stats = &bt->stats[op];
+	char name[BENCH_NAME_LEN];
+	char new_name[BENCH_NAME_LEN];
+	uint64_t t0, ino, stride;
+	int rc, i, j;
+
+	switch (op) {
+	case BENCH_CREATE:
+		dir->prefix = "file.";
+		if (run->batch != 0) {
+			bench_create_batch(bt, dir);
+			break;
+		}
+		for (i = 0; i < run->count; i++) {
+			bench_name(name, dir->prefix, i);
+			t0 = perf_now_ns();
+			rc = bench_create_one(dir, name, &dir->inos[i]);
+			bench_record(stats, 1, rc, t0);
+		}
+		break;
+	case BENCH_LOOKUP:
+		stride = bench_stride(run->count);
+		for (i = 0; i < run->count; i++) {
+			j = (uint64_t)i * stride % run->count;
+			bench_name(name, dir->prefix, j);
+			t0 = perf_now_ns();
+			rc = md_dirent_lookup(dir->ino, name, &ino);
+			bench_record(stats, 1, rc, t0);
+			if (rc == 0 && ino != bench_ino(dir, j))
+				stats->errors++;
+		}
+		break;
+	case BENCH_READDIR:
+	case BENCH_READDIR_STAT:
+	case BENCH_READDIRPLUS:
+		bench_list(bt, op, dir);
+		break;
+	case BENCH_RELIST:
+		for (i = 0; i < BENCH_RELISTS; i++)
+			bench_list(bt, op, dir);
+		break;
+	case BENCH_RENAME:
+		for (i = 0; i < run->count; i++) {
+			bench_name(name, dir->prefix, i);
+			bench_name(new_name, "moved.", i);
+			t0 = perf_now_ns();
+			rc = md_dirent_rename(dir->ino, name, dir->ino,
+					      new_name);
+			bench_record(stats, 1, rc, t0);
+		}
+		dir->prefix = "moved.";
+		break;
+	case BENCH_UNLINK:
+		for (i = 0; i < run->count; i++) {
+			bench_name(name, dir->prefix, i);
+			t0 = perf_now_ns();
+			rc = md_dirent_del(dir->ino, name);
+			if (rc == 0)
+				rc = md_stat_del(bench_ino(dir, i));
+			bench_record(stats, 1, rc, t0);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static void *bench_thread_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	struct bench_run *run = bt->run;
+	struct bench_dir dir;
+	struct stat st;
+	int rep, op, rc;
+
+	rc = xattr_kvs_thread_init();
+	if (rc)
+		exit(rc);
+
+	/* Entries get their inodes from md_ino_reserve() */
+	dir.ino = run->base_ino + bt->index;
+	dir.inos = calloc(run->count, sizeof(*dir.inos));
+	if (dir.inos == NULL) {
+		fprintf(stderr, "thread %d: out of memory\n", bt->index);
+		exit(-ENOMEM);
+	}
+
+	/* md_create_batch() updates the attributes of the directory */
+	bench_stat_init(&st, dir.ino);
+	st.st_mode = S_IFDIR | 0755;
+	st.st_nlink = 2;
+	rc = md_stat_put(dir.ino, &st);
+	if (rc) {
+		fprintf(stderr, "error(%d): md_stat_put\n", rc);
+		exit(-rc);
+	}
+
+	for (rep = 0; rep < run->reps; rep++) {
+		for (op = 0; op < BENCH_OP_NR; op++) {
+			if (!(run->ops & (1U << op)))
+				continue;
+			bench_phase_begin(&run->clock, bt->index);
+			bench_phase(bt, op, &dir);
+			bench_phase_end(&run->clock, bt->index, op);
+		}
+	}
+
+	md_stat_del(dir.ino);
+	free(dir.inos);
+	xattr_kvs_thread_fini();
+	return NULL;
+}
+
+static void print_row(const struct bench_cfg *cfg, const struct bench_run *run,
+		      enum bench_op op, const struct bench_stats *stats)
+{
+	/* Time the threads spent in the phase per entry */
+	double per_item = stats->items ?
+			  (double)stats->hist.sum / stats->items : 0;
+	struct bench_row row;
+
+	bench_row_init(&row, cfg->json);
+	bench_row_str(&row, "op", bench_op_name[op]);
+	bench_row_str(&row, "layout", bench_layout_name[run->layout]);
+	bench_row_int(&row, "entries", run->count);
+	bench_row_int(&row, "page", run->page);
+	bench_row_int(&row, "page_bytes", run->page_bytes);
+	bench_row_int(&row, "batch", run->batch);
+	bench_row_int(&row, "threads", run->threads);
+	bench_row_stats(&row, stats, run->clock.elapsed[op]);
+	bench_row_num(&row, "us_per_item", per_item / 1e3, 3);
+	bench_row_int(&row, "errors", stats->errors);
+	bench_row_print(&row);
+}
+
+static int bench_run(const struct bench_cfg *cfg, struct bench_run *run)
+{
+	struct bench_thread *bt;
+	struct bench_stats *stats;
+	int rc = 0;
+	int op, i;
+
+	bt = calloc(run->threads, sizeof(*bt));
+	stats = malloc(sizeof(*stats));
+	if (bt == NULL || stats == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	bench_clock_init(&run->clock, run->threads);
+
+	for (i = 0; i < run->threads; i++) {
+		bt[i].index = i;
+		bt[i].run = run;
+		for (op = 0; op < BENCH_OP_NR; op++)
+			bench_stats_init(&bt[i].stats[op]);
+	}
+
+	rc = bench_threads_run(bt, sizeof(*bt), run->threads, bench_thread_fn);
+	bench_clock_fini(&run->clock);
+	if (rc)
+		goto out;
+
+	for (op = 0; op < BENCH_OP_NR; op++) {
+		if (!(run->ops & (1U << op)))
+			continue;
+		bench_stats_init(stats);
+		for (i = 0; i < run->threads; i++)
+			bench_stats_merge(stats, &bt[i].stats[op]);
+		print_row(cfg, run, op, stats);
+	}
+
+out:
+	free(stats);
+	free(bt);
+	return rc;
+}
+
+/* main */
+int main(int argc, char **argv)
+{
+	struct bench_cfg cfg;
+	struct bench_run run;
+	uint64_t hits, misses, evictions;
+	int l, n, b, t;
+	int rc;
+
+	if (parse_args(argc, argv, &cfg) != 0) {
+		usage(basename(argv[0]));
+		return -1;
+	}
+
+	/* time in */
+	c0appz_timein();
+
+	/* c0rcfile
+	 * overwrite .cappzrc to a .[app]rc file.
+	 */
+	char str[256];
+	sprintf(str, ".%src", basename(argv[0]));
+	c0appz_setrc(str);
+	c0appz_putrc();
+
+	/* initialize resources */
+	if (c0appz_init(0) != 0) {
+		fprintf(stderr, "error! motr initialization failed.\n");
+		return -2;
+	}
+
+	rc = xattr_kvs_init();
+	if (rc != 0) {
+		fprintf(stderr, "error in fid initialization\n");
+		goto out;
+	}
+
+	if (cfg.lcache_bytes != 0) {
+		rc = md_lcache_init(cfg.lcache_bytes);
+		if (rc != 0) {
+			fprintf(stderr, "error(%d): md_lcache_init\n", rc);
+			goto out;
+		}
+	}
+
+	for (l = 0; l < cfg.nr_layouts; l++)
+	for (n = 0; n < cfg.count.nr; n++)
+	for (b = 0; b < cfg.page.nr; b++)
+	for (t = 0; t < cfg.threads.nr; t++) {
+		md_dirent_set_layout(cfg.layout[l]);
+		memset(&run, 0, sizeof(run));
+		run.layout = cfg.layout[l];
+		run.ops = cfg.ops;
+		run.count = cfg.count.val[n];
+		run.page = cfg.page.val[b];
+		run.threads = cfg.threads.val[t];
+		run.page_bytes = cfg.page_bytes;
+		run.batch = cfg.batch;
+		run.reps = cfg.reps;
+		run.base_ino = cfg.base_ino;
+
+		rc = bench_run(&cfg, &run);
+		if (rc != 0)
+			goto out;
+	}
+
+out:
+	if (cfg.lcache_bytes != 0) {
+		md_lcache_stats(&hits, &misses, &evictions);
+		fprintf(stderr, "md_lcache: %llu hits, %llu misses, "
+			"%llu evictions\n", (unsigned long long)hits,
+			(unsigned long long)misses,
+			(unsigned long long)evictions);
+		md_lcache_fini();
+	}
+
+	/* free resources*/
+	c0appz_free();
+
+	if (rc == 0)
+		fprintf(stderr, "%s success\n", basename(argv[0]));
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,306 @@
+/*
+ * Filename:         md_fh.c
+ * Description:      Inode handles of the metadata experiments
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "../xattr/xattr_kvs_async.h"
+#include "md_acache.h"
+#include "md_wb.h"
+#include "md_kvs.h"
+#include "md_rec.h"
+#include "md_fh.h"
+
+/* One GET op worth of inodes, starting at entry @base of the call. The
+ * keys point into @keys; values are allocated by Motr.
+ */
+struct get_slot {
+	struct xattr_kvs_aop aop;
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	int base;
+	char keys[MD_BATCH_MAX][MD_PREFIX_LEN];
+};
+
+int md_fh_from_ino(uint64_t ino, struct md_fh **fh)
+{
+	struct md_fh *new;
+	uint64_t gen;
+	int rc;
+
+	new = malloc(sizeof(*new));
+	if (new == NULL)
+		return -ENOMEM;
+
+	if (md_acache_get(ino, &new->st, &gen) != 0) {
+		rc = md_stat_get(ino, &new->st);
+		if (rc) {
+			free(new);
+			return rc;
+		}
+		md_acache_put(ino, &new->st, gen);
+	}
+
+	/* The cache holds the record, the handle sees pending updates too */
+	md_wb_peek(ino, &new->st);
+	new->ino = ino;
+	*fh = new;
+	return 0;
+}
+
+void md_fh_destroy(struct md_fh *fh)
+{
+	free(fh);
+}
+
+/* Hands out the records of a completed GET and frees the values Motr
+ * allocated for them.
+ */
+static int slot_reap(struct get_slot *slot, const uint64_t *inos,
+		     struct md_fh **fh, int *rcs)
+{
+	struct m0_bufvec *val = &slot->val;
+	uint32_t j;
+	int i;
+
+	for (j = 0; j < val->ov_vec.v_nr; j++) {
+		i = slot->base + j;
+		if (slot->aop.rc)
+			rcs[i] = slot->aop.rc;
+		else if (slot->aop.rcs[j])
+			rcs[i] = slot->aop.rcs[j];
+		else if ((fh[i] = malloc(sizeof(*fh[i]))) == NULL)
+			rcs[i] = -ENOMEM;
+		else {
+			fh[i]->ino = inos[i];
+			rcs[i] = md_rec_decode(val->ov_buf[j],
+					       val->ov_vec.v_count[j], inos[i],
+					       &fh[i]->st);
+			if (rcs[i]) {
+				free(fh[i]);
+				fh[i] = NULL;
+			}
+		}
+
+		m0_free(val->ov_buf[j]);
+		val->ov_buf[j] = NULL;
+		val->ov_vec.v_count[j] = 0;
+	}
+
+	return slot->aop.rc;
+}
+
+/* Fetches the records of all @nr inodes, bypassing the cache. */
+static int fetch_many(const uint64_t *inos, struct md_fh **fh, int *rcs,
+		      int nr)
+{
+	struct get_slot slots[MD_FH_WINDOW];
+	struct get_slot *free_slot[MD_FH_WINDOW];
+	struct xattr_kvs_async engine;
+	struct xattr_kvs_aop *aop;
+	struct get_slot *slot;
+	int nfree = 0;
+	int base = 0;
+	int per, nslots;
+	int rc, rc2, i, j, n;
+
+	for (i = 0; i < nr; i++) {
+		fh[i] = NULL;
+		rcs[i] = -EAGAIN;
+	}
+
+	/* No more slots and records than the call needs */
+	per = nr < MD_BATCH_MAX ? nr : MD_BATCH_MAX;
+	nslots = per > 0 ? (nr + per - 1) / per : 0;
+	if (nslots > MD_FH_WINDOW)
+		nslots = MD_FH_WINDOW;
+
+	memset(slots, 0, sizeof(slots));
+	for (i = 0; i < nslots; i++) {
+		M0_ALLOC_ARR(slots[i].key.ov_buf, per);
+		M0_ALLOC_ARR(slots[i].key.ov_vec.v_count, per);
+		rc = m0_bufvec_empty_alloc(&slots[i].val, per);
+		if (rc == 0 && (slots[i].key.ov_buf == NULL ||
+				slots[i].key.ov_vec.v_count == NULL))
+			rc = -ENOMEM;
+		if (rc)
+			goto free_slots;
+		for (j = 0; j < per; j++) {
+			slots[i].key.ov_buf[j] = slots[i].keys[j];
+			slots[i].key.ov_vec.v_count[j] = MD_PREFIX_LEN;
+		}
+		slots[i].aop.opcode = M0_IC_GET;
+		slots[i].aop.key = &slots[i].key;
+		slots[i].aop.val = &slots[i].val;
+		slots[i].aop.datum = &slots[i];
+		free_slot[nfree++] = &slots[i];
+	}
+
+	rc = xattr_kvs_async_init(&engine, MD_FH_WINDOW);
+	if (rc)
+		goto free_slots;
+
+	while (base < nr) {
+		/* Reuse the slot of the oldest GET once all are in flight */
+		if (nfree == 0) {
+			aop = xattr_kvs_async_wait(&engine);
+			rc = slot_reap(aop->datum, inos, fh, rcs);
+			free_slot[nfree++] = aop->datum;
+			if (rc)
+				break;
+		}
+
+		slot = free_slot[--nfree];
+		n = nr - base < per ? nr - base : per;
+		for (j = 0; j < n; j++)
+			md_stat_key(slot->key.ov_buf[j], inos[base + j]);
+		slot->key.ov_vec.v_nr = n;
+		slot->val.ov_vec.v_nr = n;
+		slot->base = base;
+
+		rc = xattr_kvs_async_submit(&engine, &slot->aop, true);
+		if (rc)
+			break;
+		base += n;
+	}
+
+	while ((aop = xattr_kvs_async_wait(&engine)) != NULL) {
+		rc2 = slot_reap(aop->datum, inos, fh, rcs);
+		if (rc == 0)
+			rc = rc2;
+	}
+
+	xattr_kvs_async_fini(&engine);
+free_slots:
+	for (i = 0; i < nslots; i++) {
+		xattr_kvs_aop_fini(&slots[i].aop);
+		m0_free(slots[i].key.ov_buf);
+		m0_free(slots[i].key.ov_vec.v_count);
+		if (slots[i].val.ov_buf != NULL) {
+			slots[i].val.ov_vec.v_nr = per;
+			m0_bufvec_free(&slots[i].val);
+		}
+	}
+
+	for (i = 0; rc && i < nr; i++)
+		if (rcs[i] == -EAGAIN)
+			rcs[i] = rc;
+
+	return rc;
+}
+
+/* Per-call arrays for the inodes which missed the cache. */
+struct fetch_set {
+	uint64_t *ino;
+	uint64_t *gen;
+	struct md_fh **fh;
+	int *rcs;
+	/* Entry of the caller's arrays */
+	int *index;
+};
+
+int md_fh_from_ino_many(const uint64_t *inos, struct md_fh **fh, int *rcs,
+			int nr)
+{
+	struct fetch_set miss;
+	struct stat st;
+	uint64_t gen;
+	int nmiss = 0;
+	int rc, i, j;
+
+	memset(&miss, 0, sizeof(miss));
+	for (i = 0; i < nr; i++) {
+		fh[i] = NULL;
+		rcs[i] = -EAGAIN;
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (md_acache_get(inos[i], &st, &gen) != 0) {
+			/* The first miss sizes the arrays for the rest */
+			if (miss.ino == NULL) {
+				miss.ino = calloc(nr - i, sizeof(*miss.ino));
+				miss.gen = calloc(nr - i, sizeof(*miss.gen));
+				miss.fh = calloc(nr - i, sizeof(*miss.fh));
+				miss.rcs = calloc(nr - i, sizeof(*miss.rcs));
+				miss.index = calloc(nr - i,
+						    sizeof(*miss.index));
+				if (miss.ino == NULL || miss.gen == NULL ||
+				    miss.fh == NULL || miss.rcs == NULL ||
+				    miss.index == NULL) {
+					rc = -ENOMEM;
+					goto out;
+				}
+			}
+			miss.ino[nmiss] = inos[i];
+			miss.gen[nmiss] = gen;
+			miss.index[nmiss++] = i;
+			continue;
+		}
+
+		fh[i] = malloc(sizeof(*fh[i]));
+		if (fh[i] == NULL) {
+			rcs[i] = -ENOMEM;
+			continue;
+		}
+		fh[i]->ino = inos[i];
+		fh[i]->st = st;
+		rcs[i] = 0;
+	}
+
+	rc = nmiss > 0 ? fetch_many(miss.ino, miss.fh, miss.rcs, nmiss) : 0;
+	for (j = 0; j < nmiss; j++) {
+		i = miss.index[j];
+		fh[i] = miss.fh[j];
+		rcs[i] = miss.rcs[j];
+		if (rcs[i] == 0)
+			md_acache_put(inos[i], &fh[i]->st, miss.gen[j]);
+	}
+
+	for (i = 0; i < nr; i++)
+		if (rcs[i] == 0)
+			md_wb_peek(inos[i], &fh[i]->st);
+
+out:
+	for (i = 0; rc && i < nr; i++) {
+		if (fh[i] == NULL && rcs[i] == -EAGAIN)
+			rcs[i] = rc;
+	}
+	free(miss.index);
+	free(miss.rcs);
+	free(miss.fh);
+	free(miss.gen);
+	free(miss.ino);
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
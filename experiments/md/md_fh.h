@@ -0,0 +1,63 @@
+/*
+ * Filename:         md_fh.h
+ * Description:      Inode handles of the metadata experiments
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _MD_FH_H
+#define _MD_FH_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+/* A handle holds the attributes of an inode as read when it was made, as
+ * struct cfs_fh does.
+ */
+struct md_fh {
+	uint64_t ino;
+	struct stat st;
+};
+
+/* GET ops of MD_BATCH_MAX inodes in flight in md_fh_from_ino_many() */
+#define MD_FH_WINDOW	4
+
+/* Same as cfs_fh_from_ino: one GET of the attributes of @ino, unless they
+ * are in md_acache. Updates pending in md_wb show in the handle.
+ */
+int md_fh_from_ino(uint64_t ino, struct md_fh **fh);
+
+/* Makes handles for @nr inodes. Inodes found in md_acache cost no index
+ * op; the attribute records of the others are fetched with multi-key GETs
+ * of up to MD_BATCH_MAX inodes, MD_FH_WINDOW of them in flight at once,
+ * so a listing of N inodes costs about N / MD_BATCH_MAX / MD_FH_WINDOW
+ * round trips instead of N.
+ *
+ * @rcs returns the result of each inode and @fh its handle, NULL unless
+ * the result is 0. The call returns 0 when every op ran, else the error of
+ * the first op which failed as a whole; the inodes without a result get
+ * that error.
+ */
+int md_fh_from_ino_many(const uint64_t *inos, struct md_fh **fh, int *rcs,
+			int nr);
+
+static inline struct stat *md_fh_stat(struct md_fh *fh)
+{
+	return &fh->st;
+}
+
+void md_fh_destroy(struct md_fh *fh);
+
+#endif /* _MD_FH_H */
@@ -0,0 +1,292 @@
+/*
+ * Filename:         md_kvs.c
+ * Description:      Inode and dirent records of the metadata experiments
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "../xattr/xattr_kvs.h"
+#include "md_acache.h"
+#include "md_kvs.h"
+#include "md_rec.h"
+
+static bool stat_legacy;
+
+static pthread_mutex_t ino_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Next free inode number, 0 until the counter record was read */
+static uint64_t ino_next;
+
+void md_stat_set_legacy(bool legacy)
+{
+	stat_legacy = legacy;
+}
+
+int md_kvs_op(enum m0_idx_opcode opcode, struct m0_bufvec *key,
+	      struct m0_bufvec *val, int32_t *rcs, uint32_t flags)
+{
+	struct m0_op *op = NULL;
+	int rc;
+
+	rc = m0_idx_op(&xattr_idx, opcode, key, val, rcs, flags, &op);
+	if (rc) {
+		fprintf(stderr, "error(%d): m0_idx_op\n", rc);
+		return rc;
+	}
+
+	m0_op_launch(&op, 1);
+	rc = m0_op_wait(op, M0_BITS(M0_OS_STABLE), M0_TIME_NEVER);
+	if (rc == 0)
+		rc = m0_rc(op);
+
+	m0_op_fini(op);
+	m0_op_free(op);
+	return rc;
+}
+
+/* Reads the inode counter into ino_next, under ino_lock. */
+static int ino_counter_get(struct m0_bufvec *key)
+{
+	struct m0_bufvec val;
+	int32_t rcs[1];
+	int rc;
+
+	rc = m0_bufvec_empty_alloc(&val, 1);
+	if (rc)
+		return rc;
+
+	rc = md_kvs_op(M0_IC_GET, key, &val, rcs, 0);
+	if (rc == 0)
+		rc = rcs[0];
+	if (rc == 0 && val.ov_vec.v_count[0] != sizeof(ino_next))
+		rc = -EIO;
+	if (rc == 0) {
+		memcpy(&ino_next, val.ov_buf[0], sizeof(ino_next));
+		ino_next = be64toh(ino_next);
+	} else if (rc == -ENOENT) {
+		ino_next = MD_INO_FIRST;
+		rc = 0;
+	}
+
+	m0_bufvec_free(&val);
+	return rc;
+}
+
+int md_ino_reserve(int nr, uint64_t *ino)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	struct md_key *k;
+	uint64_t be_next;
+	int32_t rcs[1];
+	int rc;
+
+	if (nr <= 0)
+		return -EINVAL;
+
+	rc = m0_bufvec_alloc(&key, 1, MD_PREFIX_LEN);
+	if (rc)
+		return rc;
+
+	rc = m0_bufvec_empty_alloc(&val, 1);
+	if (rc)
+		goto free_key;
+
+	k = key.ov_buf[0];
+	k->ino = htobe64(MD_INO_COUNTER);
+	k->type = MD_COUNTER_TYPE;
+
+	pthread_mutex_lock(&ino_lock);
+	if (ino_next == 0)
+		rc = ino_counter_get(&key);
+	if (rc)
+		goto unlock;
+
+	be_next = htobe64(ino_next + nr);
+	val.ov_buf[0] = &be_next;
+	val.ov_vec.v_count[0] = sizeof(be_next);
+
+	rc = md_kvs_op(M0_IC_PUT, &key, &val, rcs, M0_OIF_OVERWRITE);
+	if (rc == 0)
+		rc = rcs[0];
+	if (rc == 0) {
+		*ino = ino_next;
+		ino_next += nr;
+	}
+unlock:
+	pthread_mutex_unlock(&ino_lock);
+
+	val.ov_buf[0] = NULL;
+	m0_bufvec_free(&val);
+free_key:
+	m0_bufvec_free(&key);
+	return rc;
+}
+
+/* Allocates @nr stat keys in one bufvec. */
+static int stat_keys(struct m0_bufvec *key, const uint64_t *inos, int nr)
+{
+	int rc, i;
+
+	rc = m0_bufvec_alloc(key, nr, MD_PREFIX_LEN);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < nr; i++)
+		md_stat_key(key->ov_buf[i], inos[i]);
+	return 0;
+}
+
+int md_stat_get_many(const uint64_t *inos, struct stat *st, int *rcs,
+		     int nr)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	int32_t *op_rcs;
+	int rc, i;
+
+	M0_ALLOC_ARR(op_rcs, nr);
+	if (op_rcs == NULL)
+		return -ENOMEM;
+
+	rc = stat_keys(&key, inos, nr);
+	if (rc)
+		goto free_rcs;
+
+	rc = m0_bufvec_empty_alloc(&val, nr);
+	if (rc)
+		goto free_key;
+
+	rc = md_kvs_op(M0_IC_GET, &key, &val, op_rcs, 0);
+	for (i = 0; rc == 0 && i < nr; i++) {
+		rcs[i] = op_rcs[i];
+		if (rcs[i] == 0)
+			rcs[i] = md_rec_decode(val.ov_buf[i],
+					       val.ov_vec.v_count[i], inos[i],
+					       &st[i]);
+	}
+
+	m0_bufvec_free(&val);
+free_key:
+	m0_bufvec_free(&key);
+free_rcs:
+	m0_free(op_rcs);
+	return rc;
+}
+
+int md_stat_put_many(const uint64_t *inos, const struct stat *st, int *rcs,
+		     int nr)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	int32_t *op_rcs;
+	char *recs;
+	int rc, i;
+
+	M0_ALLOC_ARR(op_rcs, nr);
+	/* Room for either format */
+	recs = m0_alloc(nr * sizeof(*st));
+	if (op_rcs == NULL || recs == NULL) {
+		rc = -ENOMEM;
+		goto free_rcs;
+	}
+
+	rc = stat_keys(&key, inos, nr);
+	if (rc)
+		goto free_rcs;
+
+	/* Values point into @recs */
+	rc = m0_bufvec_empty_alloc(&val, nr);
+	if (rc)
+		goto free_key;
+
+	for (i = 0; i < nr; i++) {
+		val.ov_buf[i] = recs + i * sizeof(*st);
+		val.ov_vec.v_count[i] = md_rec_encode(val.ov_buf[i], &st[i],
+						      inos[i], stat_legacy);
+	}
+
+	rc = md_kvs_op(M0_IC_PUT, &key, &val, op_rcs, M0_OIF_OVERWRITE);
+	for (i = 0; rc == 0 && i < nr; i++)
+		rcs[i] = op_rcs[i];
+
+	/* Even a failed op may have written some of the records */
+	for (i = 0; i < nr; i++)
+		md_acache_invalidate(inos[i]);
+
+	for (i = 0; i < nr; i++)
+		val.ov_buf[i] = NULL;
+	m0_bufvec_free(&val);
+free_key:
+	m0_bufvec_free(&key);
+free_rcs:
+	m0_free(recs);
+	m0_free(op_rcs);
+	return rc;
+}
+
+int md_stat_get(uint64_t ino, struct stat *st)
+{
+	int rc, rc2;
+
+	rc = md_stat_get_many(&ino, st, &rc2, 1);
+	return rc ? rc : rc2;
+}
+
+int md_stat_put(uint64_t ino, const struct stat *st)
+{
+	int rc, rc2;
+
+	rc = md_stat_put_many(&ino, st, &rc2, 1);
+	return rc ? rc : rc2;
+}
+
+int md_stat_del(uint64_t ino)
+{
+	struct m0_bufvec key;
+	int32_t rcs[1];
+	int rc;
+
+	rc = stat_keys(&key, &ino, 1);
+	if (rc)
+		return rc;
+
+	rc = md_kvs_op(M0_IC_DEL, &key, NULL, rcs, 0);
+	if (rc == 0)
+		rc = rcs[0];
+	md_acache_invalidate(ino);
+
+	m0_bufvec_free(&key);
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,170 @@
+/*
+ * Filename:         md_kvs.h
+ * Description:      Inode and dirent records of the metadata experiments
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _MD_KVS_H
+#define _MD_KVS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <endian.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "motr/client.h"
+
+/* The metadata experiments model the inode and dirent records of cortxfs
+ * on the index of the xattr experiments, set up by xattr_kvs_init(). Keys
+ * share the {be64 ino, type} prefix of struct cortxfs_xattr, so all records
+ * of an inode are adjacent and those of a directory can be walked with
+ * M0_IC_NEXT.
+ */
+
+/* {parent, '1', name_len, name} -> be64 ino of the entry, see below */
+#define MD_DIRENT_TYPE	'1'
+/* {ino, '2'} -> attributes of the inode, see md_rec.h */
+#define MD_STAT_TYPE	'2'
+/* {MD_INO_COUNTER, '3'} -> be64 next free inode number */
+#define MD_COUNTER_TYPE	'3'
+#define MD_INO_COUNTER	0ULL
+/* First inode number handed out while the counter record is missing */
+#define MD_INO_FIRST	0x100000000ULL
+
+#define MD_NAME_MAX	255
+
+struct md_key {
+	uint64_t ino;
+	char type;
+	uint8_t name_len;
+	char name[];
+} __attribute((packed));
+
+/* How the dirent keys of a directory are laid out past the prefix.
+ *
+ * MD_DIRENT_NAME is {name_len, name}: entries are in name order, so names
+ * with a common prefix, e.g. those a program creates in sequence, all go
+ * to the same leaf of the index.
+ *
+ * MD_DIRENT_HASH is {be32 hash of the name, name_len, name}: entries are
+ * in hash order, which spreads a huge directory evenly over its key range
+ * and lets it be split or scanned in parallel by ranges of hash. A lookup
+ * is still a single GET of the exact key, and the name keeps keys unique
+ * when hashes collide, so the order of a listing never changes while the
+ * directory does not.
+ */
+enum md_dirent_layout {
+	MD_DIRENT_NAME,
+	MD_DIRENT_HASH,
+};
+
+#define MD_HASH_LEN	sizeof(uint32_t)
+#define MD_PREFIX_LEN	offsetof(struct md_key, name_len)
+#define MD_KEY_MAX	(sizeof(struct md_key) + MD_HASH_LEN + MD_NAME_MAX)
+
+/* Largest number of records one batched op carries */
+#define MD_BATCH_MAX	256
+
+/* Credentials a request is checked against, as cfs_cred_t. */
+struct md_cred {
+	uid_t uid;
+	gid_t gid;
+};
+
+static inline int md_stat_key(struct md_key *key, uint64_t ino)
+{
+	key->ino = htobe64(ino);
+	key->type = MD_STAT_TYPE;
+	return MD_PREFIX_LEN;
+}
+
+/* 32 bit FNV-1a */
+static inline uint32_t md_name_hash(const char *name, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* Returns the key length, or -EINVAL for a bad name. A NULL @name gives
+ * the prefix of all dirents of @parent.
+ */
+static inline int md_dirent_key(struct md_key *key, uint64_t parent,
+				const char *name, enum md_dirent_layout layout)
+{
+	char *p = (char *)key + MD_PREFIX_LEN;
+	uint32_t hash;
+	size_t len;
+
+	key->ino = htobe64(parent);
+	key->type = MD_DIRENT_TYPE;
+	if (name == NULL)
+		return MD_PREFIX_LEN;
+
+	len = strlen(name);
+	if (len == 0 || len > MD_NAME_MAX)
+		return -EINVAL;
+
+	if (layout == MD_DIRENT_HASH) {
+		hash = htobe32(md_name_hash(name, len));
+		memcpy(p, &hash, sizeof(hash));
+		p += sizeof(hash);
+	}
+	*p++ = len;
+	memcpy(p, name, len);
+	return p + len - (char *)key;
+}
+
+/* Index op over all records of @key/@val. Returns the result of the op as
+ * a whole; per-record results are left in @rcs for the caller.
+ */
+int md_kvs_op(enum m0_idx_opcode opcode, struct m0_bufvec *key,
+	      struct m0_bufvec *val, int32_t *rcs, uint32_t flags);
+
+/* Reserves @nr consecutive inode numbers, the first returned in @ino,
+ * with one write of the counter record. The counter is read once and then
+ * kept in memory, so only this process may hand out numbers.
+ */
+int md_ino_reserve(int nr, uint64_t *ino);
+
+/* Makes every following attribute write use the old struct stat record,
+ * for experiments on inodes which were not migrated yet.
+ */
+void md_stat_set_legacy(bool legacy);
+
+int md_stat_get(uint64_t ino, struct stat *st);
+int md_stat_put(uint64_t ino, const struct stat *st);
+int md_stat_del(uint64_t ino);
+
+/* Reads the attributes of @nr inodes with one multi-key GET. Returns 0 if
+ * the op ran, with the result of each inode in @rcs, -ENOENT for one which
+ * does not exist, or the error of the op as a whole.
+ */
+int md_stat_get_many(const uint64_t *inos, struct stat *st, int *rcs,
+		     int nr);
+
+/* Writes @nr attribute records with one multi-key PUT, same results. */
+int md_stat_put_many(const uint64_t *inos, const struct stat *st, int *rcs,
+		     int nr);
+
+#endif /* _MD_KVS_H */
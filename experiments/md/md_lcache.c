@@ -0,0 +1,452 @@
+/*
+ * Filename:         md_lcache.c
+ * Description:      Listing cache of directory entry pages
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <pthread.h>
+#include "md_lcache.h"
+
+/* Directories are found by hash and kept in a list of the order they were
+ * last listed, hottest first.
+ */
+struct lc_dir {
+	struct lc_dir *next;
+	struct lc_dir *lru_prev;
+	struct lc_dir *lru_next;
+	uint64_t ino;
+	uint64_t version;
+	/* Sorted by start cookie */
+	struct md_lcache_page **page;
+	int nr;
+	int cap;
+};
+
+struct lc_shard {
+	pthread_mutex_t lock;
+	/* Moves on every change of a directory of the shard */
+	uint64_t clock;
+	struct lc_dir **bucket;
+	uint32_t bucket_mask;
+	/* Sentinel of the LRU list */
+	struct lc_dir lru;
+	size_t bytes;
+	size_t max_bytes;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+} __attribute__((aligned(64)));
+
+static struct lc_shard *shards;
+
+static uint64_t ino_hash(uint64_t ino)
+{
+	return ino * 0x9E3779B97F4A7C15ULL;
+}
+
+static struct lc_shard *shard_of(uint64_t ino)
+{
+	return &shards[(ino_hash(ino) >> 32) % MD_LCACHE_SHARDS];
+}
+
+static struct lc_dir **bucket_of(struct lc_shard *sh, uint64_t ino)
+{
+	return &sh->bucket[ino_hash(ino) & sh->bucket_mask];
+}
+
+static struct lc_dir *dir_find(struct lc_shard *sh, uint64_t ino)
+{
+	struct lc_dir *d;
+
+	for (d = *bucket_of(sh, ino); d != NULL; d = d->next)
+		if (d->ino == ino)
+			return d;
+
+	return NULL;
+}
+
+static void lru_unlink(struct lc_dir *d)
+{
+	d->lru_prev->lru_next = d->lru_next;
+	d->lru_next->lru_prev = d->lru_prev;
+}
+
+static void lru_push(struct lc_shard *sh, struct lc_dir *d)
+{
+	d->lru_prev = &sh->lru;
+	d->lru_next = sh->lru.lru_next;
+	sh->lru.lru_next->lru_prev = d;
+	sh->lru.lru_next = d;
+}
+
+/* Cookies order as their keys do in the index. */
+static int cookie_cmp(const char *a, size_t alen, const char *b, size_t blen)
+{
+	int c = memcmp(a, b, alen < blen ? alen : blen);
+
+	if (c != 0)
+		return c;
+	return alen < blen ? -1 : alen > blen;
+}
+
+/* Index of the last page of @d which starts at or before @cookie, -1 if
+ * none does.
+ */
+static int page_find(const struct lc_dir *d, const struct md_cookie *cookie)
+{
+	const struct md_cookie *start;
+	int lo = 0;
+	int hi = d->nr;
+	int mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		start = &d->page[mid]->start;
+		if (cookie_cmp(start->key, start->len, cookie->key,
+			       cookie->len) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo - 1;
+}
+
+/* Index of the first entry of @pg past @cookie. */
+static int entry_find(const struct md_lcache_page *pg,
+		      const struct md_cookie *cookie)
+{
+	const struct md_lcache_ent *e;
+	int lo = 0;
+	int hi = pg->nr;
+	int mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		e = md_lcache_entry(pg, mid);
+		if (cookie_cmp(e->key, e->klen, cookie->key,
+			       cookie->len) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+void md_lcache_release(struct md_lcache_page *pg)
+{
+	if (__atomic_sub_fetch(&pg->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		free(pg);
+}
+
+/* Drops every page of @d. */
+static void dir_clear(struct lc_shard *sh, struct lc_dir *d)
+{
+	int i;
+
+	for (i = 0; i < d->nr; i++) {
+		sh->bytes -= d->page[i]->bytes;
+		md_lcache_release(d->page[i]);
+	}
+	d->nr = 0;
+}
+
+static void dir_evict(struct lc_shard *sh, struct lc_dir *d)
+{
+	struct lc_dir **p = bucket_of(sh, d->ino);
+
+	while (*p != d)
+		p = &(*p)->next;
+	*p = d->next;
+
+	lru_unlink(d);
+	dir_clear(sh, d);
+	free(d->page);
+	free(d);
+	sh->evictions++;
+}
+
+int md_lcache_get(uint64_t dir, const struct md_cookie *cookie,
+		  struct md_lcache_page **pg, int *pos, uint64_t *version)
+{
+	struct lc_shard *sh;
+	struct md_lcache_page *p;
+	struct lc_dir *d;
+	int i;
+
+	if (shards == NULL)
+		return -EAGAIN;
+
+	sh = shard_of(dir);
+	pthread_mutex_lock(&sh->lock);
+
+	d = dir_find(sh, dir);
+	*version = d != NULL ? d->version : sh->clock;
+
+	i = d != NULL ? page_find(d, cookie) : -1;
+	if (i >= 0) {
+		p = d->page[i];
+		*pos = entry_find(p, cookie);
+		/* The cookie is past the range of the page */
+		if (*pos == p->nr && !p->eof)
+			i = -1;
+	}
+
+	if (i < 0) {
+		sh->misses++;
+		pthread_mutex_unlock(&sh->lock);
+		return -EAGAIN;
+	}
+
+	__atomic_add_fetch(&p->refs, 1, __ATOMIC_RELAXED);
+	lru_unlink(d);
+	lru_push(sh, d);
+	sh->hits++;
+	pthread_mutex_unlock(&sh->lock);
+
+	*pg = p;
+	return 0;
+}
+
+struct md_lcache_page *md_lcache_page_alloc(uint64_t dir, uint64_t version,
+					    const struct md_cookie *start,
+					    int nr, size_t key_bytes)
+{
+	struct md_lcache_page *pg;
+	size_t size;
+
+	if (nr > MD_LCACHE_PAGE)
+		return NULL;
+
+	size = sizeof(*pg) + nr * sizeof(struct md_lcache_ent) + key_bytes;
+	pg = malloc(size);
+	if (pg == NULL)
+		return NULL;
+
+	pg->dir = dir;
+	pg->version = version;
+	pg->start.len = start->len;
+	memcpy(pg->start.key, start->key, start->len);
+	pg->eof = false;
+	pg->nr = 0;
+	pg->refs = 1;
+	pg->bytes = size;
+	pg->used = 0;
+	return pg;
+}
+
+void md_lcache_page_add(struct md_lcache_page *pg, const void *key,
+			size_t klen, size_t name_len, uint64_t ino)
+{
+	struct md_lcache_ent *e;
+
+	e = (struct md_lcache_ent *)(pg->blob + pg->used);
+
+	e->ino = ino;
+	e->klen = klen;
+	e->name_len = name_len;
+	memcpy(e->key, key, klen);
+
+	pg->off[pg->nr++] = pg->used;
+	pg->used += sizeof(*e) + klen;
+}
+
+/* Makes room for @bytes in @sh by evicting the coldest directories other
+ * than @keep. Returns false if that is not enough.
+ */
+static bool shard_reserve(struct lc_shard *sh, struct lc_dir *keep,
+			  size_t bytes)
+{
+	struct lc_dir *d;
+
+	while (sh->bytes + bytes > sh->max_bytes) {
+		d = sh->lru.lru_prev;
+		if (d == keep)
+			d = d->lru_prev;
+		if (d == &sh->lru)
+			return false;
+		dir_evict(sh, d);
+	}
+
+	return true;
+}
+
+void md_lcache_put(struct md_lcache_page *pg)
+{
+	struct md_lcache_page **page;
+	struct lc_shard *sh;
+	struct lc_dir *d;
+	int i;
+
+	if (shards == NULL)
+		return;
+
+	sh = shard_of(pg->dir);
+	pthread_mutex_lock(&sh->lock);
+
+	d = dir_find(sh, pg->dir);
+	/* The directory changed since the page was read */
+	if ((d != NULL && d->version != pg->version) ||
+	    (d == NULL && sh->clock != pg->version))
+		goto out;
+
+	if (d == NULL) {
+		d = calloc(1, sizeof(*d));
+		if (d == NULL)
+			goto out;
+		d->ino = pg->dir;
+		d->version = pg->version;
+		d->next = *bucket_of(sh, pg->dir);
+		*bucket_of(sh, pg->dir) = d;
+		lru_push(sh, d);
+	}
+
+	/* Another listing read the same page */
+	i = page_find(d, &pg->start) + 1;
+	if (i > 0 && cookie_cmp(d->page[i - 1]->start.key,
+				d->page[i - 1]->start.len, pg->start.key,
+				pg->start.len) == 0)
+		goto out;
+
+	if (!shard_reserve(sh, d, pg->bytes))
+		goto out;
+
+	if (d->nr == d->cap) {
+		page = realloc(d->page, (d->cap ? d->cap * 2 : 4) *
+				       sizeof(*page));
+		if (page == NULL)
+			goto out;
+		d->page = page;
+		d->cap = d->cap ? d->cap * 2 : 4;
+	}
+
+	memmove(&d->page[i + 1], &d->page[i], (d->nr - i) * sizeof(*page));
+	d->page[i] = pg;
+	d->nr++;
+	sh->bytes += pg->bytes;
+	__atomic_add_fetch(&pg->refs, 1, __ATOMIC_RELAXED);
+	lru_unlink(d);
+	lru_push(sh, d);
+out:
+	pthread_mutex_unlock(&sh->lock);
+}
+
+void md_lcache_bump(uint64_t dir)
+{
+	struct lc_shard *sh;
+	struct lc_dir *d;
+
+	if (shards == NULL)
+		return;
+
+	sh = shard_of(dir);
+	pthread_mutex_lock(&sh->lock);
+	sh->clock++;
+	d = dir_find(sh, dir);
+	if (d != NULL) {
+		d->version = sh->clock;
+		dir_clear(sh, d);
+	}
+	pthread_mutex_unlock(&sh->lock);
+}
+
+int md_lcache_init(size_t max_bytes)
+{
+	uint32_t nbuckets;
+	size_t per;
+	int i;
+
+	if (max_bytes == 0)
+		max_bytes = MD_LCACHE_BYTES;
+
+	per = max_bytes / MD_LCACHE_SHARDS;
+	/* About one directory per few pages */
+	for (nbuckets = 16; nbuckets < per / (16 << 10); nbuckets *= 2)
+		;
+
+	shards = calloc(MD_LCACHE_SHARDS, sizeof(*shards));
+	if (shards == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < MD_LCACHE_SHARDS; i++) {
+		pthread_mutex_init(&shards[i].lock, NULL);
+		shards[i].bucket = calloc(nbuckets, sizeof(struct lc_dir *));
+		if (shards[i].bucket == NULL) {
+			md_lcache_fini();
+			return -ENOMEM;
+		}
+		shards[i].bucket_mask = nbuckets - 1;
+		shards[i].lru.lru_next = &shards[i].lru;
+		shards[i].lru.lru_prev = &shards[i].lru;
+		shards[i].max_bytes = per;
+	}
+
+	return 0;
+}
+
+void md_lcache_fini(void)
+{
+	struct lc_shard *sh;
+	int i;
+
+	if (shards == NULL)
+		return;
+
+	for (i = 0; i < MD_LCACHE_SHARDS; i++) {
+		sh = &shards[i];
+		while (sh->bucket != NULL && sh->lru.lru_next != &sh->lru)
+			dir_evict(sh, sh->lru.lru_next);
+		free(sh->bucket);
+		pthread_mutex_destroy(&sh->lock);
+	}
+
+	free(shards);
+	shards = NULL;
+}
+
+bool md_lcache_enabled(void)
+{
+	return shards != NULL;
+}
+
+void md_lcache_stats(uint64_t *hits, uint64_t *misses, uint64_t *evictions)
+{
+	int i;
+
+	*hits = *misses = *evictions = 0;
+	for (i = 0; shards != NULL && i < MD_LCACHE_SHARDS; i++) {
+		pthread_mutex_lock(&shards[i].lock);
+		*hits += shards[i].hits;
+		*misses += shards[i].misses;
+		*evictions += shards[i].evictions;
+		pthread_mutex_unlock(&shards[i].lock);
+	}
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,125 @@
+/*
+ * Filename:         md_lcache.h
+ * Description:      Listing cache of directory entry pages
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _MD_LCACHE_H
+#define _MD_LCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "md_dir.h"
+
+/* Caches the entries of directories in pages, as md_readdir() scans them,
+ * so that hot directories which rarely change are listed from memory
+ * instead of by a scan of the index.
+ *
+ * A page holds up to MD_LCACHE_PAGE entries which follow a start cookie,
+ * in key order, and whether the directory ends with them. A listing which
+ * resumes at any cookie in the range of a cached page is served from it.
+ *
+ * Every directory has a change version, which md_dirent_put(),
+ * md_dirent_del() and md_dirent_rename(), so create, link, unlink and
+ * rename, bump after their write. A page carries the version its
+ * directory had before the scan which read it, and is only inserted and
+ * served while the directory still has that version; a page which raced
+ * with a change is dropped instead of served stale. A bump frees the pages
+ * of the directory at once. Versions come from a clock per shard, which
+ * also moves for directories that are not cached, so a directory which is
+ * evicted and cached again never gets back a version from before a
+ * change.
+ *
+ * Pages count towards the byte budget, split evenly between shards. The
+ * directories of a shard are kept in the order they were last listed, and
+ * an insert into a full shard evicts the coldest directories whole.
+ *
+ * Pages are never changed once inserted; readers hold a reference, so
+ * entries are handed out without the lock of the shard. Only changes made
+ * through this process are seen. Until md_lcache_init() is called every
+ * listing scans the index.
+ */
+
+#define MD_LCACHE_SHARDS	64
+#define MD_LCACHE_BYTES		(64 << 20)
+#define MD_LCACHE_PAGE		256
+
+struct md_lcache_ent {
+	uint64_t ino;
+	/* The dirent key past the directory prefix, which ends with the
+	 * name
+	 */
+	uint16_t klen;
+	uint8_t name_len;
+	char key[];
+} __attribute((packed));
+
+struct md_lcache_page {
+	uint64_t dir;
+	uint64_t version;
+	/* Entries follow this cookie */
+	struct md_cookie start;
+	/* No entry follows the last one */
+	bool eof;
+	int nr;
+	int refs;
+	size_t bytes;
+	/* Entry i starts at blob + off[i] */
+	uint32_t off[MD_LCACHE_PAGE];
+	size_t used;
+	char blob[];
+};
+
+/* @max_bytes of 0 selects MD_LCACHE_BYTES. */
+int md_lcache_init(size_t max_bytes);
+void md_lcache_fini(void);
+bool md_lcache_enabled(void);
+
+/* Returns 0 with a reference to a page of @dir which holds the entries
+ * following @cookie, from entry @pos on, or -EAGAIN on a miss with the
+ * @version a page read now has to carry.
+ */
+int md_lcache_get(uint64_t dir, const struct md_cookie *cookie,
+		  struct md_lcache_page **pg, int *pos, uint64_t *version);
+
+/* Makes a page for @nr entries of @key_bytes of keys in all, with one
+ * reference held by the caller.
+ */
+struct md_lcache_page *md_lcache_page_alloc(uint64_t dir, uint64_t version,
+					    const struct md_cookie *start,
+					    int nr, size_t key_bytes);
+void md_lcache_page_add(struct md_lcache_page *pg, const void *key,
+			size_t klen, size_t name_len, uint64_t ino);
+
+/* Inserts @pg if its directory still has its version; the caller keeps
+ * its reference either way.
+ */
+void md_lcache_put(struct md_lcache_page *pg);
+void md_lcache_release(struct md_lcache_page *pg);
+
+static inline const struct md_lcache_ent *
+md_lcache_entry(const struct md_lcache_page *pg, int i)
+{
+	return (const struct md_lcache_ent *)(pg->blob + pg->off[i]);
+}
+
+/* Marks a change of @dir, which drops its pages. */
+void md_lcache_bump(uint64_t dir);
+
+void md_lcache_stats(uint64_t *hits, uint64_t *misses, uint64_t *evictions);
+
+#endif /* _MD_LCACHE_H */
@@ -0,0 +1,161 @@
+/*
+ * Filename:         md_rec.c
+ * Description:      Versioned on-disk inode attribute record
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include "md_rec.h"
+
+/* The version byte must overlay the top byte of st_dev in old records */
+_Static_assert(offsetof(struct md_rec, version) ==
+	       offsetof(struct stat, st_dev) + sizeof(dev_t) - 1 &&
+	       __BYTE_ORDER == __LITTLE_ENDIAN,
+	       "the version byte must overlay the top byte of st_dev");
+
+static int64_t ts_to_ns(const struct timespec *ts)
+{
+	return (int64_t)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void ns_to_ts(int64_t ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / 1000000000LL;
+	ts->tv_nsec = ns % 1000000000LL;
+	/* Round towards minus infinity for times before the epoch */
+	if (ts->tv_nsec < 0) {
+		ts->tv_sec--;
+		ts->tv_nsec += 1000000000LL;
+	}
+}
+
+size_t md_rec_encode(void *buf, const struct stat *st, uint64_t ino,
+		     bool legacy)
+{
+	struct md_rec *rec = buf;
+	uint8_t *ext = (uint8_t *)(rec + 1);
+	uint64_t rdev;
+
+	if (legacy) {
+		memcpy(buf, st, sizeof(*st));
+		((struct stat *)buf)->st_ino = ino;
+		return sizeof(*st);
+	}
+
+	rec->version = MD_REC_VERSION;
+	rec->pad = 0;
+	rec->mode = htole32(st->st_mode);
+	rec->uid = htole32(st->st_uid);
+	rec->gid = htole32(st->st_gid);
+	rec->nlink = htole32(st->st_nlink);
+	rec->size = htole64(st->st_size);
+	rec->blocks = htole64(st->st_blocks);
+	rec->atime = htole64(ts_to_ns(&st->st_atim));
+	rec->mtime = htole64(ts_to_ns(&st->st_mtim));
+	rec->ctime = htole64(ts_to_ns(&st->st_ctim));
+
+	if (st->st_rdev != 0) {
+		rdev = htole64(st->st_rdev);
+		*ext++ = MD_REC_EXT_RDEV;
+		*ext++ = sizeof(rdev);
+		memcpy(ext, &rdev, sizeof(rdev));
+		ext += sizeof(rdev);
+	}
+
+	rec->ext_len = htole16(ext - (uint8_t *)(rec + 1));
+	return ext - (uint8_t *)buf;
+}
+
+static int decode_ext(const uint8_t *ext, size_t len, struct stat *st)
+{
+	const uint8_t *end = ext + len;
+	uint64_t rdev;
+	uint8_t tag, tlen;
+
+	while (ext < end) {
+		if (end - ext < 2)
+			return -EIO;
+		tag = ext[0];
+		tlen = ext[1];
+		ext += 2;
+		if (end - ext < tlen)
+			return -EIO;
+
+		switch (tag) {
+		case MD_REC_EXT_RDEV:
+			if (tlen != sizeof(rdev))
+				return -EIO;
+			memcpy(&rdev, ext, sizeof(rdev));
+			st->st_rdev = le64toh(rdev);
+			break;
+		default:
+			/* Written by a newer version */
+			break;
+		}
+		ext += tlen;
+	}
+
+	return 0;
+}
+
+int md_rec_decode(const void *buf, size_t len, uint64_t ino,
+		  struct stat *st)
+{
+	const struct md_rec *rec = buf;
+
+	if (len < sizeof(*rec))
+		return -EIO;
+
+	if (rec->version == MD_REC_LEGACY) {
+		if (len != sizeof(*st))
+			return -EIO;
+		memcpy(st, buf, sizeof(*st));
+		return 0;
+	}
+
+	if (rec->version != MD_REC_VERSION ||
+	    sizeof(*rec) + le16toh(rec->ext_len) != len)
+		return -EIO;
+
+	memset(st, 0, sizeof(*st));
+	st->st_ino = ino;
+	st->st_blksize = MD_REC_BLKSIZE;
+	st->st_mode = le32toh(rec->mode);
+	st->st_uid = le32toh(rec->uid);
+	st->st_gid = le32toh(rec->gid);
+	st->st_nlink = le32toh(rec->nlink);
+	st->st_size = le64toh(rec->size);
+	st->st_blocks = le64toh(rec->blocks);
+	ns_to_ts(le64toh(rec->atime), &st->st_atim);
+	ns_to_ts(le64toh(rec->mtime), &st->st_mtim);
+	ns_to_ts(le64toh(rec->ctime), &st->st_ctim);
+
+	return decode_ext((const uint8_t *)(rec + 1), le16toh(rec->ext_len),
+			  st);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,94 @@
+/*
+ * Filename:         md_rec.h
+ * Description:      Versioned on-disk inode attribute record
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _MD_REC_H
+#define _MD_REC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+/* Value of an {ino, MD_STAT_TYPE} record.
+ *
+ * The old value was the struct stat of the inode as it sits in memory:
+ * 144 bytes on x86_64, with padding, st_ino which is already in the key,
+ * and st_dev and st_blksize which are the same for every inode. A version
+ * 1 record keeps only what varies, as little-endian fixed-width fields, in
+ * 60 bytes. Times are signed nanoseconds since the epoch.
+ *
+ * Fields which most inodes do not need follow the fixed part as
+ * {tag, len, data} extensions. Readers skip tags they do not know, so new
+ * optional fields need no new version; the version only changes when the
+ * fixed part does.
+ *
+ * Old records are told apart by the version byte, not by their length,
+ * which extensions may grow: it sits where an old record holds the top
+ * byte of st_dev, which is always 0, as the kernel encodes device numbers
+ * in 32 bits. Old records are still read. Every write uses the new format,
+ * so an inode migrates the first time its attributes change.
+ */
+
+/* Version byte of an old record */
+#define MD_REC_LEGACY	0
+#define MD_REC_VERSION	1
+
+struct md_rec {
+	uint32_t mode;
+	/* Bytes of extensions after the fixed part */
+	uint16_t ext_len;
+	uint8_t pad;
+	uint8_t version;
+	uint32_t uid;
+	uint32_t gid;
+	uint32_t nlink;
+	uint64_t size;
+	uint64_t blocks;
+	int64_t atime;
+	int64_t mtime;
+	int64_t ctime;
+} __attribute((packed));
+
+/* Extension tags */
+enum md_rec_ext {
+	/* le64 device number of a device special file */
+	MD_REC_EXT_RDEV = 1,
+};
+
+/* Largest record md_rec_encode() produces */
+#define MD_REC_MAX	(sizeof(struct md_rec) + 2 + sizeof(uint64_t))
+
+/* st_blksize of every inode, filled in on decode */
+#define MD_REC_BLKSIZE	4096
+
+/* Encodes @st into @buf, which has room for MD_REC_MAX bytes, and returns
+ * the record length. With @legacy the old struct stat value is written
+ * instead, for experiments on unmigrated inodes; @buf must then have room
+ * for a struct stat.
+ */
+size_t md_rec_encode(void *buf, const struct stat *st, uint64_t ino,
+		     bool legacy);
+
+/* Decodes a record of either format into @st. Returns 0, or -EIO for a
+ * malformed record or an unknown version.
+ */
+int md_rec_decode(const void *buf, size_t len, uint64_t ino,
+		  struct stat *st);
+
+#endif /* _MD_REC_H */
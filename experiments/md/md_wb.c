@@ -0,0 +1,687 @@
+/*
+ * Filename:         md_wb.c
+ * Description:      Write-back of inode attribute updates
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "../xattr/xattr_kvs.h"
+#include "md_kvs.h"
+#include "md_attr.h"
+#include "md_wb.h"
+
+#define WB_BUCKETS	256
+#define WB_FLAGS	(MD_STAT_SIZE_SET | MD_STAT_ATIME_SET | \
+			 MD_STAT_MTIME_SET | MD_STAT_CTIME_SET)
+
+/* Merged fields of the updates of an inode */
+struct wb_upd {
+	int flags;
+	off_t size;
+	struct timespec atime;
+	struct timespec mtime;
+	struct timespec ctime;
+	/* Bumped by every merge, so a flush knows whether it wrote the last */
+	uint64_t seq;
+};
+
+struct wb_entry {
+	struct wb_entry *next;
+	uint64_t ino;
+	struct wb_upd upd;
+	/* CLOCK_MONOTONIC ns by which the update is written */
+	uint64_t due;
+	/* Last flush pass which took the entry */
+	uint64_t pass;
+};
+
+struct wb_shard {
+	pthread_mutex_t lock;
+	/* Held by a flush of the shard for its whole pass, and by a holder
+	 * from the sync of its inodes to md_wb_release(). Entries are only
+	 * dropped with it held.
+	 */
+	pthread_mutex_t flush_lock;
+	uint64_t pass;
+	struct wb_entry *bucket[WB_BUCKETS];
+	int nr;
+	uint64_t updates;
+	uint64_t writes;
+} __attribute__((aligned(64)));
+
+/* One GET and one PUT worth of pending updates, of one shard unless they
+ * are synced for md_wb_hold()
+ */
+struct wb_batch {
+	uint64_t ino[MD_BATCH_MAX];
+	struct wb_upd upd[MD_BATCH_MAX];
+	struct stat st[MD_BATCH_MAX];
+	int rcs[MD_BATCH_MAX];
+	/* Record of the PUT the entry goes to, -1 if none */
+	int slot[MD_BATCH_MAX];
+	uint64_t put_ino[MD_BATCH_MAX];
+	int put_rcs[MD_BATCH_MAX];
+	int nr;
+};
+
+static struct wb_shard *shards;
+static int wb_window_ms;
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	bool running;
+	bool stop;
+} flusher = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* md_wb_hold() keeps the shards it holds in a mask */
+_Static_assert(MD_WB_SHARDS <= 64, "too many shards for a uint64_t mask");
+
+static int shard_index(uint64_t ino)
+{
+	return ((ino * 0x9E3779B97F4A7C15ULL) >> 32) % MD_WB_SHARDS;
+}
+
+static struct wb_shard *shard_of(uint64_t ino)
+{
+	return &shards[shard_index(ino)];
+}
+
+static struct wb_entry **bucket_of(struct wb_shard *sh, uint64_t ino)
+{
+	return &sh->bucket[ino % WB_BUCKETS];
+}
+
+static struct wb_entry **entry_find(struct wb_shard *sh, uint64_t ino)
+{
+	struct wb_entry **p;
+
+	for (p = bucket_of(sh, ino); *p != NULL; p = &(*p)->next)
+		if ((*p)->ino == ino)
+			return p;
+
+	return NULL;
+}
+
+static void entry_remove(struct wb_shard *sh, struct wb_entry **p)
+{
+	struct wb_entry *e = *p;
+
+	*p = e->next;
+	sh->nr--;
+	free(e);
+}
+
+static void upd_merge(struct wb_upd *upd, const struct stat *st, int flags)
+{
+	if (flags & MD_STAT_SIZE_SET) {
+		if (!(upd->flags & MD_STAT_SIZE_SET) ||
+		    st->st_size > upd->size)
+			upd->size = st->st_size;
+	}
+	if (flags & MD_STAT_ATIME_SET)
+		upd->atime = st->st_atim;
+	if (flags & MD_STAT_MTIME_SET)
+		upd->mtime = st->st_mtim;
+	if (flags & MD_STAT_CTIME_SET)
+		upd->ctime = st->st_ctim;
+
+	upd->flags |= flags & WB_FLAGS;
+	upd->seq++;
+}
+
+/* Clears the fields of @upd which still hold what @done wrote, so that an
+ * update merged into during its write does not write them again, on top
+ * of a later md_setattr(). Returns true when no field is left.
+ */
+static bool upd_written(struct wb_upd *upd, const struct wb_upd *done)
+{
+	int written = done->flags;
+
+	if (upd->size != done->size)
+		written &= ~MD_STAT_SIZE_SET;
+	if (memcmp(&upd->atime, &done->atime, sizeof(upd->atime)))
+		written &= ~MD_STAT_ATIME_SET;
+	if (memcmp(&upd->mtime, &done->mtime, sizeof(upd->mtime)))
+		written &= ~MD_STAT_MTIME_SET;
+	if (memcmp(&upd->ctime, &done->ctime, sizeof(upd->ctime)))
+		written &= ~MD_STAT_CTIME_SET;
+
+	upd->flags &= ~written;
+	return upd->flags == 0;
+}
+
+static void upd_apply(const struct wb_upd *upd, struct stat *st)
+{
+	if ((upd->flags & MD_STAT_SIZE_SET) && upd->size > st->st_size)
+		st->st_size = upd->size;
+	if (upd->flags & MD_STAT_ATIME_SET)
+		st->st_atim = upd->atime;
+	if (upd->flags & MD_STAT_MTIME_SET)
+		st->st_mtim = upd->mtime;
+	if (upd->flags & MD_STAT_CTIME_SET)
+		st->st_ctim = upd->ctime;
+}
+
+/* Writes the updates of a batch, with the flush_lock of their shards
+ * held: one GET of the records, one PUT of those which still exist, with
+ * the merged fields changed on top of what was read. Sets each entry's rcs
+ * to its result, and returns 0 when both ops ran, else the error of the op
+ * which failed.
+ */
+static int batch_write(struct wb_batch *b)
+{
+	int put_nr = 0;
+	int rc, i;
+
+	rc = md_stat_get_many(b->ino, b->st, b->rcs, b->nr);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < b->nr; i++) {
+		b->slot[i] = -1;
+		if (b->rcs[i])
+			continue;
+		upd_apply(&b->upd[i], &b->st[i]);
+		/* Compact in place, put_nr never passes i */
+		b->st[put_nr] = b->st[i];
+		b->put_ino[put_nr] = b->ino[i];
+		b->slot[i] = put_nr++;
+	}
+
+	if (put_nr == 0)
+		return 0;
+
+	rc = md_stat_put_many(b->put_ino, b->st, b->put_rcs, put_nr);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < b->nr; i++)
+		if (b->slot[i] >= 0)
+			b->rcs[i] = b->put_rcs[b->slot[i]];
+
+	for (i = 0; i < put_nr; i++)
+		__atomic_add_fetch(&shard_of(b->put_ino[i])->writes, 1,
+				   __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* Drops the entries of a written batch, or what they still have of the
+ * written fields if they were merged into meanwhile. An inode which is
+ * gone needs no update. Returns the first error of an entry, whose update
+ * stays pending.
+ */
+static int batch_done(struct wb_batch *b)
+{
+	struct wb_shard *locked = NULL;
+	struct wb_shard *sh;
+	struct wb_entry **p;
+	int rc = 0;
+	int i;
+
+	for (i = 0; i < b->nr; i++) {
+		if (b->rcs[i] != 0 && b->rcs[i] != -ENOENT) {
+			if (rc == 0)
+				rc = b->rcs[i];
+			continue;
+		}
+		sh = shard_of(b->ino[i]);
+		if (sh != locked) {
+			if (locked != NULL)
+				pthread_mutex_unlock(&locked->lock);
+			pthread_mutex_lock(&sh->lock);
+			locked = sh;
+		}
+		p = entry_find(sh, b->ino[i]);
+		if (p != NULL && ((*p)->upd.seq == b->upd[i].seq ||
+				  upd_written(&(*p)->upd, &b->upd[i])))
+			entry_remove(sh, p);
+	}
+	if (locked != NULL)
+		pthread_mutex_unlock(&locked->lock);
+
+	return rc;
+}
+
+/* Adds the pending update of @ino, if any and not in @b yet, to @b. */
+static void batch_add(struct wb_batch *b, uint64_t ino)
+{
+	struct wb_shard *sh = shard_of(ino);
+	struct wb_entry **p;
+	int i;
+
+	for (i = 0; i < b->nr; i++)
+		if (b->ino[i] == ino)
+			return;
+
+	pthread_mutex_lock(&sh->lock);
+	p = entry_find(sh, ino);
+	if (p != NULL) {
+		b->ino[b->nr] = ino;
+		b->upd[b->nr++] = (*p)->upd;
+	}
+	pthread_mutex_unlock(&sh->lock);
+}
+
+/* Writes the updates of a shard which are due by @now, a batch at a time,
+ * with its flush_lock held. Entries are marked with the pass which took
+ * them, so those which stay pending after their write are not taken again
+ * in the same pass; entries added to buckets the pass already went by
+ * wait for the next one.
+ */
+static int shard_flush(struct wb_shard *sh, struct wb_batch *b, uint64_t now)
+{
+	struct wb_entry *e;
+	uint64_t pass = ++sh->pass;
+	int bkt = 0;
+	int rc = 0;
+
+	while (rc == 0 && bkt < WB_BUCKETS) {
+		b->nr = 0;
+		pthread_mutex_lock(&sh->lock);
+		for (; bkt < WB_BUCKETS && b->nr < MD_BATCH_MAX; bkt++) {
+			for (e = sh->bucket[bkt]; e != NULL; e = e->next) {
+				if (e->pass == pass || e->due > now)
+					continue;
+				if (b->nr == MD_BATCH_MAX)
+					break;
+				e->pass = pass;
+				b->ino[b->nr] = e->ino;
+				b->upd[b->nr++] = e->upd;
+			}
+			/* A full batch goes back to the same bucket */
+			if (e != NULL)
+				break;
+		}
+		pthread_mutex_unlock(&sh->lock);
+
+		if (b->nr == 0)
+			break;
+
+		rc = batch_write(b);
+		if (rc == 0)
+			rc = batch_done(b);
+	}
+
+	return rc;
+}
+
+static int flush_due(uint64_t now)
+{
+	struct wb_batch *b;
+	int rc = 0;
+	int i, rc2;
+
+	if (shards == NULL)
+		return 0;
+
+	b = malloc(sizeof(*b));
+	if (b == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < MD_WB_SHARDS; i++) {
+		pthread_mutex_lock(&shards[i].flush_lock);
+		rc2 = shard_flush(&shards[i], b, now);
+		pthread_mutex_unlock(&shards[i].flush_lock);
+		if (rc == 0)
+			rc = rc2;
+	}
+
+	free(b);
+	return rc;
+}
+
+int md_wb_flush(void)
+{
+	return flush_due(UINT64_MAX);
+}
+
+void md_wb_release(uint64_t held)
+{
+	int i;
+
+	for (i = MD_WB_SHARDS - 1; i >= 0; i--)
+		if (held & (1ULL << i))
+			pthread_mutex_unlock(&shards[i].flush_lock);
+}
+
+int md_wb_hold(const uint64_t *inos, int nr, uint64_t *held)
+{
+	struct wb_batch *b;
+	uint64_t mask = 0;
+	int rc = 0;
+	int i;
+
+	*held = 0;
+	if (shards == NULL)
+		return 0;
+
+	b = malloc(sizeof(*b));
+	if (b == NULL)
+		return -ENOMEM;
+
+	/* In shard order, so that two holders never wait for each other */
+	for (i = 0; i < nr; i++)
+		mask |= 1ULL << shard_index(inos[i]);
+	for (i = 0; i < MD_WB_SHARDS; i++)
+		if (mask & (1ULL << i))
+			pthread_mutex_lock(&shards[i].flush_lock);
+
+	b->nr = 0;
+	for (i = 0; rc == 0 && i < nr; i++) {
+		batch_add(b, inos[i]);
+		if (b->nr == 0 || (b->nr < MD_BATCH_MAX && i < nr - 1))
+			continue;
+		rc = batch_write(b);
+		if (rc == 0)
+			rc = batch_done(b);
+		b->nr = 0;
+	}
+	free(b);
+
+	if (rc) {
+		md_wb_release(mask);
+		return rc;
+	}
+
+	*held = mask;
+	return 0;
+}
+
+int md_wb_sync(uint64_t ino)
+{
+	struct wb_shard *sh;
+	struct wb_entry **p;
+	uint64_t held;
+	int rc;
+
+	if (shards == NULL)
+		return 0;
+
+	/* An update is only dropped once written, so none means no flush
+	 * of @ino is under way either.
+	 */
+	sh = shard_of(ino);
+	pthread_mutex_lock(&sh->lock);
+	p = entry_find(sh, ino);
+	pthread_mutex_unlock(&sh->lock);
+	if (p == NULL)
+		return 0;
+
+	rc = md_wb_hold(&ino, 1, &held);
+	if (rc == 0)
+		md_wb_release(held);
+	return rc;
+}
+
+void md_wb_peek(uint64_t ino, struct stat *st)
+{
+	struct wb_shard *sh;
+	struct wb_entry **p;
+
+	if (shards == NULL)
+		return;
+
+	sh = shard_of(ino);
+	pthread_mutex_lock(&sh->lock);
+	p = entry_find(sh, ino);
+	if (p != NULL)
+		upd_apply(&(*p)->upd, st);
+	pthread_mutex_unlock(&sh->lock);
+}
+
+int md_wb_update(uint64_t ino, const struct stat *st, int flags,
+		 int delay_ms)
+{
+	struct wb_shard *sh;
+	struct wb_entry **p;
+	struct wb_entry *e;
+	struct wb_batch *b;
+	uint64_t due;
+	bool full;
+	int rc;
+
+	if (shards == NULL)
+		return md_stat_put(ino, st);
+
+	sh = shard_of(ino);
+	__atomic_add_fetch(&sh->updates, 1, __ATOMIC_RELAXED);
+
+	/* Even one written at once goes through an entry, so that only its
+	 * fields are written, on top of a fresh GET of the record.
+	 */
+	due = now_ns() + delay_ms * 1000000ULL;
+	pthread_mutex_lock(&sh->lock);
+	p = entry_find(sh, ino);
+	if (p == NULL) {
+		e = calloc(1, sizeof(*e));
+		if (e == NULL) {
+			pthread_mutex_unlock(&sh->lock);
+			return -ENOMEM;
+		}
+		e->ino = ino;
+		e->due = due;
+		p = bucket_of(sh, ino);
+		e->next = *p;
+		*p = e;
+		sh->nr++;
+	}
+	/* Due by the earliest delay of the updates merged */
+	if (due < (*p)->due)
+		(*p)->due = due;
+	upd_merge(&(*p)->upd, st, flags);
+	full = sh->nr >= MD_WB_SHARD_MAX;
+	pthread_mutex_unlock(&sh->lock);
+
+	if (delay_ms == 0)
+		return md_wb_sync(ino);
+
+	if (!full)
+		return 0;
+
+	/* A thread already flushing the shard will take this entry too */
+	if (pthread_mutex_trylock(&sh->flush_lock) != 0)
+		return 0;
+
+	rc = 0;
+	b = malloc(sizeof(*b));
+	if (b != NULL)
+		rc = shard_flush(sh, b, UINT64_MAX);
+	pthread_mutex_unlock(&sh->flush_lock);
+
+	free(b);
+	return rc;
+}
+
+int md_wb_write(struct md_fh *fh, off_t end)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	fh->st.st_mtim = now;
+	fh->st.st_ctim = now;
+	if (end > fh->st.st_size)
+		fh->st.st_size = end;
+
+	return md_wb_update(fh->ino, &fh->st, MD_STAT_SIZE_SET |
+			    MD_STAT_MTIME_SET | MD_STAT_CTIME_SET,
+			    wb_window_ms);
+}
+
+static void *flusher_fn(void *arg)
+{
+	struct timespec deadline;
+
+	(void)arg;
+	xattr_kvs_thread_init();
+
+	pthread_mutex_lock(&flusher.lock);
+	while (!flusher.stop) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_nsec += MD_WB_TICK_MS * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+
+		while (!flusher.stop &&
+		       pthread_cond_timedwait(&flusher.cond, &flusher.lock,
+					      &deadline) != ETIMEDOUT)
+			;
+		if (flusher.stop)
+			break;
+
+		pthread_mutex_unlock(&flusher.lock);
+		flush_due(now_ns());
+		pthread_mutex_lock(&flusher.lock);
+	}
+	pthread_mutex_unlock(&flusher.lock);
+
+	xattr_kvs_thread_fini();
+	return NULL;
+}
+
+static int flusher_start(void)
+{
+	pthread_condattr_t attr;
+	int rc;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&flusher.cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	pthread_mutex_lock(&flusher.lock);
+	flusher.stop = false;
+	rc = pthread_create(&flusher.thread, NULL, flusher_fn, NULL);
+	flusher.running = rc == 0;
+	pthread_mutex_unlock(&flusher.lock);
+
+	return -rc;
+}
+
+static void flusher_stop(void)
+{
+	pthread_mutex_lock(&flusher.lock);
+	if (!flusher.running) {
+		pthread_mutex_unlock(&flusher.lock);
+		return;
+	}
+	flusher.stop = true;
+	pthread_cond_broadcast(&flusher.cond);
+	pthread_mutex_unlock(&flusher.lock);
+
+	pthread_join(flusher.thread, NULL);
+
+	pthread_mutex_lock(&flusher.lock);
+	flusher.running = false;
+	pthread_mutex_unlock(&flusher.lock);
+	pthread_cond_destroy(&flusher.cond);
+}
+
+int md_wb_init(int window_ms)
+{
+	int rc, i;
+
+	shards = aligned_alloc(64, MD_WB_SHARDS * sizeof(*shards));
+	if (shards == NULL)
+		return -ENOMEM;
+	memset(shards, 0, MD_WB_SHARDS * sizeof(*shards));
+	for (i = 0; i < MD_WB_SHARDS; i++) {
+		pthread_mutex_init(&shards[i].lock, NULL);
+		pthread_mutex_init(&shards[i].flush_lock, NULL);
+	}
+
+	rc = flusher_start();
+	if (rc) {
+		free(shards);
+		shards = NULL;
+		return rc;
+	}
+
+	wb_window_ms = window_ms > 0 ? window_ms : 0;
+	return 0;
+}
+
+void md_wb_fini(void)
+{
+	struct wb_entry *e;
+	int i, j;
+
+	if (shards == NULL)
+		return;
+
+	flusher_stop();
+	md_wb_flush();
+	wb_window_ms = 0;
+
+	/* Whatever could not be written */
+	for (i = 0; i < MD_WB_SHARDS; i++) {
+		for (j = 0; j < WB_BUCKETS; j++) {
+			while ((e = shards[i].bucket[j]) != NULL) {
+				shards[i].bucket[j] = e->next;
+				free(e);
+			}
+		}
+		pthread_mutex_destroy(&shards[i].flush_lock);
+		pthread_mutex_destroy(&shards[i].lock);
+	}
+
+	free(shards);
+	shards = NULL;
+}
+
+void md_wb_stats(uint64_t *updates, uint64_t *writes)
+{
+	int i;
+
+	*updates = *writes = 0;
+	if (shards == NULL)
+		return;
+
+	for (i = 0; i < MD_WB_SHARDS; i++) {
+		*updates += __atomic_load_n(&shards[i].updates,
+					    __ATOMIC_RELAXED);
+		*writes += __atomic_load_n(&shards[i].writes,
+					   __ATOMIC_RELAXED);
+	}
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,103 @@
+/*
+ * Filename:         md_wb.h
+ * Description:      Write-back of inode attribute updates
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _MD_WB_H
+#define _MD_WB_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "md_fh.h"
+
+/* Holds attribute updates of inodes in memory and writes them later, so
+ * that a stream of WRITEs to a file, each of which sets mtime, ctime and
+ * maybe size, costs one attribute record write instead of one per call.
+ *
+ * Updates of an inode merge into one pending update: the latest times,
+ * and the largest size, since a WRITE only grows the file. A pending
+ * update is written when it is due, its delay after it was first made,
+ * by a flusher which looks every MD_WB_TICK_MS; by md_wb_sync(), which a
+ * server calls on COMMIT, fsync and close; and when a shard holds
+ * MD_WB_SHARD_MAX of them. Writes are batched per shard, one multi-key
+ * GET and one PUT for up to MD_BATCH_MAX inodes, and only change the
+ * merged fields of the record.
+ *
+ * Close-to-open: close syncs the inode, so a client which opens it after
+ * the close reads the updated record. Handles made in this process
+ * overlay the pending update anyway.
+ *
+ * md_setattr() and md_setattr_batch() hold the inodes with md_wb_hold(),
+ * which syncs them first, so explicit times and sizes are applied on top
+ * of the pending update, and no write of md_wb runs between their GET and
+ * PUT and is lost. Fields written by a flush are dropped from an update
+ * merged into during the flush, so they are not written again on top of
+ * a later setattr.
+ *
+ * Until md_wb_init() is called, and with a window of 0, WRITEs are
+ * written at once.
+ */
+
+#define MD_WB_SHARDS		64
+#define MD_WB_TICK_MS		10
+/* Pending updates per shard before an update flushes the shard itself */
+#define MD_WB_SHARD_MAX		4096
+
+/* Starts the flusher. WRITEs are due @window_ms after the first one. */
+int md_wb_init(int window_ms);
+/* Stops the flusher and writes every pending update. */
+void md_wb_fini(void);
+
+/* Records a WRITE through @fh which ended at @end: sets the size, mtime
+ * and ctime of its attributes and makes them pending.
+ */
+int md_wb_write(struct md_fh *fh, off_t end);
+
+/* Makes the @flags fields of @st, as the MD_STAT_*_SET flags of md_attr,
+ * pending for @ino, due in @delay_ms. Only times and size are merged. A
+ * delay of 0 writes the update at once, merged with any pending one; as
+ * any write of md_wb it only changes those fields of the record, so the
+ * rest of @st may be stale.
+ */
+int md_wb_update(uint64_t ino, const struct stat *st, int flags,
+		 int delay_ms);
+
+/* Applies the pending update of @ino, if any, to @st. */
+void md_wb_peek(uint64_t ino, struct stat *st);
+
+/* Writes the pending update of @ino, if any, and waits for a flush of it
+ * which is under way.
+ */
+int md_wb_sync(uint64_t ino);
+
+/* For a caller which reads, changes and writes the attribute records of
+ * @inos itself: writes their pending updates, in batches of MD_BATCH_MAX,
+ * and holds off every write of md_wb and of other holders to their shards
+ * until md_wb_release(). Updates made meanwhile stay pending. Returns 0
+ * with the shards held in @held, or the error of a write with none held.
+ */
+int md_wb_hold(const uint64_t *inos, int nr, uint64_t *held);
+void md_wb_release(uint64_t held);
+
+/* Writes every pending update. */
+int md_wb_flush(void);
+
+/* Updates made, and attribute records written for them. */
+void md_wb_stats(uint64_t *updates, uint64_t *writes);
+
+#endif /* _MD_WB_H */
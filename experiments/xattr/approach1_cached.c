@@ -0,0 +1,204 @@
+/*
+ * Filename:         approach1_cached.c
+ * Description:      Per-xattr records behind an in-memory xattr cache
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Same records as approach1. get and list are answered from xattr_cache
+ * when possible, including "no such xattr" for the probes clients issue on
+ * nearly every access; misses go to the index and fill the cache. set and
+ * del write the index first and then invalidate the names they touched.
+ *
+ * kv_cache_filter also consults the per-inode xattr_filter on a cache miss
+ * and answers names which are definitely absent without a GET. Names are
+ * added to the filter before they are written.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "xattr_cache.h"
+#include "xattr_filter.h"
+#include "xattr_kvs.h"
+#include "xattr_layout.h"
+
+static bool use_filter;
+
+static void cached_invalidate(uint64_t ino, const struct xattr_entry *xe,
+			      int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		xattr_cache_invalidate(ino, xe[i].name);
+}
+
+static int cached_set(uint64_t ino, const struct xattr_entry *xe, int nr)
+{
+	int rc, i;
+
+	for (i = 0; use_filter && i < nr; i++)
+		xattr_filter_add(ino, xe[i].name);
+
+	rc = xattr_kvs_put_batch(ino, xe, nr);
+
+	for (i = 0; use_filter && i < nr; i++)
+		xattr_filter_added(ino);
+
+	cached_invalidate(ino, xe, nr);
+	return rc;
+}
+
+static int cached_del(uint64_t ino, const struct xattr_entry *xe, int nr)
+{
+	int rc, i;
+
+	rc = xattr_kvs_del_batch(ino, xe, nr);
+
+	for (i = 0; use_filter && i < nr; i++)
+		xattr_filter_remove(ino, xe[i].name);
+
+	cached_invalidate(ino, xe, nr);
+	return rc;
+}
+
+static int cached_get(uint64_t ino, const char *name, void *value,
+		      size_t *vlen)
+{
+	uint64_t gen;
+	int rc;
+
+	rc = xattr_cache_get(ino, name, value, vlen, &gen);
+	if (rc != -EAGAIN)
+		return rc;
+
+	if (use_filter && xattr_filter_check(ino, name) == -ENOENT)
+		return -ENOENT;
+
+	rc = xattr_kvs_get_one(ino, name, value, vlen);
+	if (rc == 0)
+		xattr_cache_put(ino, name, value, *vlen, gen);
+	else if (rc == -ENOENT)
+		xattr_cache_put(ino, name, NULL, 0, gen);
+
+	if (use_filter && rc == -ENOENT)
+		xattr_filter_miss(ino);
+
+	return rc;
+}
+
+static int cached_list(uint64_t ino, int *nr)
+{
+	uint64_t gen;
+	int rc;
+
+	rc = xattr_cache_list_get(ino, nr, &gen);
+	if (rc != -EAGAIN)
+		return rc;
+
+	rc = xattr_kvs_count(ino, nr);
+	if (rc == 0)
+		xattr_cache_list_put(ino, *nr, gen);
+
+	return rc;
+}
+
+static int cached_init(const struct xattr_layout_params *params)
+{
+	use_filter = false;
+	return xattr_cache_init(params->cache_bytes);
+}
+
+static int filtered_init(const struct xattr_layout_params *params)
+{
+	int rc;
+
+	rc = xattr_filter_init();
+	if (rc)
+		return rc;
+
+	rc = xattr_cache_init(params->cache_bytes);
+	if (rc) {
+		xattr_filter_fini();
+		return rc;
+	}
+
+	use_filter = true;
+	return 0;
+}
+
+static void cached_forget(uint64_t ino)
+{
+	if (use_filter)
+		xattr_filter_drop(ino);
+	xattr_cache_invalidate_ino(ino);
+}
+
+static void cached_fini(void)
+{
+	uint64_t hits, misses, negatives, builds;
+
+	xattr_cache_stats(&hits, &misses);
+	fprintf(stderr, "kv_cache: %llu hits, %llu misses\n",
+		(unsigned long long)hits, (unsigned long long)misses);
+	xattr_cache_fini();
+
+	if (!use_filter)
+		return;
+
+	xattr_filter_stats(&negatives, &builds);
+	fprintf(stderr, "kv_cache: %llu filter negatives, %llu builds\n",
+		(unsigned long long)negatives, (unsigned long long)builds);
+	xattr_filter_fini();
+}
+
+const struct xattr_layout xattr_layout_kv_cache = {
+	.name = "kv_cache",
+	.init = cached_init,
+	.fini = cached_fini,
+	.set = cached_set,
+	.get = cached_get,
+	.list = cached_list,
+	.del = cached_del,
+	.forget = cached_forget,
+};
+
+const struct xattr_layout xattr_layout_kv_cache_filter = {
+	.name = "kv_cache_filter",
+	.init = filtered_init,
+	.fini = cached_fini,
+	.set = cached_set,
+	.get = cached_get,
+	.list = cached_list,
+	.del = cached_del,
+	.forget = cached_forget,
+};
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
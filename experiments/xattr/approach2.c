@@ -1,6 +1,6 @@
 /*
  * Filename:         approach2.c
- * Description:
+ * Description:      xattr layout with one binary blob per inode
  *
  * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
  * This program is free software: you can redistribute it and/or modify
@@ -14,409 +14,251 @@
  * You should have received a copy of the GNU Affero General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  * For any questions about this software or licensing,
- * please email opensource@seagate.com or cortx-questions@seagate.com. 
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* All xattrs of an inode live in one name-sorted binary blob (xattr_blob.h)
+ * stored under the bare {ino, '6'} prefix. A get binary searches the fetched
+ * blob in place; set and del merge the sorted batch into a new blob in one
+ * pass and write it back whole.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <libgen.h>
+#include <stdbool.h>
 #include "c0appz.h"
 #include "helpers/helpers.h"
 #include "motr/client.h"
 #include "motr/client_internal.h"
 #include "motr/idx.h"
-#include "lib/thread.h"
-#include <json-c/json.h>
-#include <sys/time.h>	
-#include <unistd.h>
-#include <fnmatch.h>
-#define KLEN 256
-#define VLEN 256
-#define MAXVAL 70000
-#define VALINPUT 512 
-
-static struct m0_fid ifid;
-static struct m0_ufid_generator cortxfs_ufid_generator;
-static struct m0_idx idx;
-
-static int m0_op_kvs(enum m0_idx_opcode opcode, struct m0_bufvec *key, struct m0_bufvec *val)
+#include "xattr_blob.h"
+#include "xattr_kvs.h"
+#include "xattr_layout.h"
+
+static int blob_key(struct m0_bufvec *key, uint64_t ino)
 {
-	struct m0_op *op = NULL;
-	int rcs[1];
+	struct cortxfs_xattr *xkey;
 	int rc;
-	
-	struct m0_idx *index = NULL;
-	index = &idx;
-
-	rc = m0_idx_op(index, opcode, key, val, rcs, M0_OIF_OVERWRITE, &op);
-	if (rc)
-	{
-               printf("\nerror(%d): m0_idx_op", rc); 
-	       return rc;
-	}
-	m0_op_launch(&op, 1);
 
-	rc = m0_op_wait(op, M0_BITS(M0_OS_STABLE),
-			M0_TIME_NEVER);
-	if (rc)
-	{
-		printf("\nerror(%d): m0_op_wait", rc);
-		goto out;
+	rc = m0_bufvec_alloc(key, 1, XATTR_PREFIX_LEN);
+	if (rc) {
+		fprintf(stderr, "error(%d): m0_bufvec_alloc\n", rc);
+		return rc;
 	}
-	/* Check rcs array even if op is succesful */
-	rc = rcs[0];
-	if (rc)
-	{
-		printf("\nerror(%d):rcs array", rc);
-		goto out;
-	}
-
-out:
-	m0_op_fini(op);
-	/* it seems like 0_free(&op) is not needed */
-	return rc;
-}
 
-int parse(char *v)
-{
-	const char *tmp = v;
-
-	struct json_object *obj = json_tokener_parse(tmp);
-
-	const char *kval;
-	json_object_object_foreach(obj, key, val)
-	{
-		kval = json_object_to_json_string(val);
-	}
+	xkey = key->ov_buf[0];
+	xattr_key_init(xkey, ino, NULL);
+	xkey->type = XATTR_BLOB_TYPE;
 	return 0;
 }
 
-int json_get(char *k, char *v)
+/* Fetches the blob of @ino into @val. A missing blob is returned as an
+ * empty one, so callers can treat create and update alike.
+ */
+static int blob_get(uint64_t ino, struct m0_bufvec *val)
 {
-	size_t klen;
-	size_t vlen;
-
-	struct m0_bufvec	 key;
-	struct m0_bufvec	 val;
+	struct m0_bufvec key;
 	int rc;
 
-	klen = strnlen(k, KLEN)+1;
-
-	rc = m0_bufvec_alloc(&key, 1, klen);
+	rc = blob_key(&key, ino);
 	if (rc)
-        {
-		printf("\nerror(%d): m0_bufvec_alloc", rc);
+		return rc;
+
+	rc = m0_bufvec_empty_alloc(val, 1);
+	if (rc) {
+		fprintf(stderr, "error(%d): m0_bufvec_empty_alloc\n", rc);
 		goto out;
 	}
 
-	rc = m0_bufvec_empty_alloc(&val, 1);
-	if (rc)
-        {
-		printf("\nerror(%d): m0_bufvec_empty_alloc", rc);
+	rc = xattr_kvs_op(M0_IC_GET, &key, val, 0);
+	if (rc == -ENOENT) {
+		rc = 0;
 		goto out;
 	}
-
-	memcpy(key.ov_buf[0], k, klen);
-
-	rc = m0_op_kvs(M0_IC_GET, &key, &val);
-	if (rc)
-	{
-		printf("\nerror(%d): m0_op_kvs while json_get", rc);
+	if (rc) {
+		fprintf(stderr, "error(%d): xattr_kvs_op while blob_get\n", rc);
 		goto out;
 	}
 
-	vlen = (size_t)val.ov_vec.v_count[0];
-
-	memcpy(v, (char *)val.ov_buf[0], vlen);
-
+	rc = xattr_blob_check(val->ov_buf[0], val->ov_vec.v_count[0]);
 out:
+	if (rc)
+		m0_bufvec_free(val);
 	m0_bufvec_free(&key);
-	m0_bufvec_free(&val);
 	return rc;
-
 }
 
-int in_motr(char *k, const char *v)
+static int in_motr(uint64_t ino, struct m0_bufvec *val)
 {
-	size_t klen, vlen;
-        int rc;
 	struct m0_bufvec key;
-	struct m0_bufvec val;
-
-	klen = strnlen(k, 255) + 1;
-	vlen = strlen(v) + 1;
-
-	rc = m0_bufvec_alloc(&key, 1, klen);
-	if (rc)
-        {
-		printf("\nerror(%d): m0_bufvec_alloc", rc);
-		goto out;
-	}
+	int rc;
 
-	rc = m0_bufvec_alloc(&val, 1, vlen);
+	rc = blob_key(&key, ino);
 	if (rc)
-        {
-		printf("\nerror(%d): m0_bufvec_alloc", rc);
-		goto out;
-	}
-
-	memcpy(key.ov_buf[0], k, klen);
-        memcpy(val.ov_buf[0], v, vlen);
+		return rc;
 
-        rc = m0_op_kvs(M0_IC_PUT, &key, &val);
-  out:
-        m0_bufvec_free(&key);
-        m0_bufvec_free(&val);
-        return rc;
-}
-
-int json_store(char *k, char *v, char *ino)
-{
-	struct json_object  *obj;
-	int rc = 0;
-	int i;
-	char tmpkey[256];
-
-	obj = json_object_new_object();
-	for (i = 0; i < 100; i++)
-	{
-		snprintf(tmpkey, 256, "%s_%d", k, i);
-		json_object_object_add(obj, tmpkey, json_object_new_string(v));
-	}
-
-	const char *json_string = json_object_to_json_string(obj);
-	//printf("json string len %d\n",strlen(json_string)); 
+	if (val->ov_vec.v_count[0] == 0)
+		rc = xattr_kvs_op(M0_IC_DEL, &key, NULL, 0);
+	else
+		rc = xattr_kvs_op(M0_IC_PUT, &key, val, M0_OIF_OVERWRITE);
 
-	rc = in_motr(ino, json_string);
+	m0_bufvec_free(&key);
 	return rc;
 }
 
-int json_update(char *k, char *v, char *ino, int no_of_keys)
+/* Applies @nr changes to the blob of @ino with a single GET and PUT, or
+ * DEL once the last xattr is gone. Removing a missing name fails with
+ * -ENOENT, as in the other layouts, after the other changes are applied.
+ */
+static int blob_update(uint64_t ino, struct xattr_blob_op *ops, int nr)
 {
-	struct json_object *obj;
-	int rc = 0, i;
-
-	const char *tmp = malloc( sizeof(char) * MAXVAL);
-	char tmpkey[256];
+	struct m0_bufvec old;
+	struct m0_bufvec val;
+	const void *blob;
+	const void *v;
+	size_t len;
+	size_t vlen;
+	size_t out_len;
+	int missing = 0;
+	int rc, i;
 
-	json_get(ino, tmp);
+	rc = blob_get(ino, &old);
+	if (rc)
+		return rc;
 
-	if (tmp != NULL)
-		obj = json_tokener_parse(tmp);
+	blob = old.ov_buf[0];
+	len = old.ov_vec.v_count[0];
 
-	for (i = 0; i < no_of_keys; i++)
-	{
-		snprintf(tmpkey, 256, "%s_%d", k, i);
-		json_object_object_add(obj, k, json_object_new_string(v));
-	}
+	xattr_blob_sort_ops(ops, nr);
 
-	const char *json_string = json_object_to_json_string(obj);
+	for (i = 0; i < nr; i++)
+		if (ops[i].value == NULL &&
+		    xattr_blob_lookup(blob, len, ops[i].name, ops[i].name_len,
+				      &v, &vlen) != 0)
+			missing++;
 
-        rc = in_motr(ino, json_string);
+	rc = m0_bufvec_alloc(&val, 1, xattr_blob_bound(len, ops, nr));
+	if (rc)
+		goto free_old;
 
-	return rc;
-}
+	rc = xattr_blob_update(blob, len, ops, nr, val.ov_buf[0], &out_len);
+	if (rc)
+		goto free_val;
 
-int json_delete(char *k, char *ino)
-{
-	struct json_object *obj;
-	int rc = 0, i;
-	const char *tmp = malloc( sizeof(char) * MAXVAL);
-	char tmpkey[256];
-	json_get(ino, tmp);
-	if (tmp != NULL)
-		obj = json_tokener_parse(tmp);
-	else
-		return -ENOENT;
-	for (i = 0; i < 100; i++)
-	{
-		snprintf(tmpkey, 256, "%s_%d", k, i);
-		json_object_object_del(obj, tmpkey);
-	}
-	const char *json_string = json_object_to_json_string(obj);
+	val.ov_vec.v_count[0] = out_len;
+	if (out_len == 0 && len == 0)
+		goto free_val;
 
-        rc = in_motr(ino, json_string);
+	rc = in_motr(ino, &val);
 
+free_val:
+	if (rc == 0 && missing > 0)
+		rc = -ENOENT;
+	m0_bufvec_free(&val);
+free_old:
+	m0_bufvec_free(&old);
 	return rc;
 }
 
-int set_fid()
-{
-	 char  tmpfid[255];
-	 int rc = 0;
-
-	 // Get fid from config parameter 
-         memset(&ifid, 0, sizeof(struct m0_fid));
-         rc = m0_fid_sscanf("<0x780000000000000b:1>", &ifid);
-         if (rc != 0) {
-                 fprintf(stderr, "Failed to read ifid value from conf\n");
-                 goto err_exit;
-         }
-
-         rc = m0_fid_print(tmpfid, 255, &ifid);
-         if (rc < 0) {
-                 fprintf(stderr, "Failed to read ifid value from conf\n");
-                 goto err_exit;
-         }
-
-         m0_idx_init(&idx, &motr_container.co_realm,
-                     (struct m0_uint128 *)&ifid);
-
-         rc = m0_ufid_init(motr_instance, &cortxfs_ufid_generator);
-         if (rc != 0) {
-	 fprintf(stderr, "Failed to initialise fid generator: %d\n", rc);
-                 goto err_exit;
-         }
-
-         return 0;
-
- err_exit:
-         return rc;
-}
-
-void timer(struct timeval start1, struct timeval end1, char *msg)
-{
-	long mtime, secs, usecs;
-	secs  = end1.tv_sec  - start1.tv_sec;
-	usecs = end1.tv_usec - start1.tv_usec;
-	mtime = ((secs) * 1000 + usecs/1000.0) + 0.5;
- 	printf("Elapsed time for %s: %ld millisecs\n", msg, mtime);
-
-}
-	
-/* main */
-int main(int argc, char **argv)
+static int blob_ops(const struct xattr_entry *xe, int nr, bool remove,
+		    struct xattr_blob_op **ops)
 {
-	char *key = malloc(sizeof(char) * 255);
-	char *val = malloc(sizeof(char) * 4096);
-
-	char *ino;
-	
-	int rc = 0;
-	struct timeval start1, end1;
-
 	int i;
-	/* check input */
-	if (argc != 4) {
-		fprintf(stderr,"Usage:\n");
-		fprintf(stderr,"%s key value\n", basename(argv[0]));
-		return -1;
-	}
-
-	/* time in */
-	c0appz_timein();
-
-	/* c0rcfile
-	 * overwrite .cappzrc to a .[app]rc file.
-	 */
-	char str[256];
-	sprintf(str, ".%src", basename(argv[0]));
-	c0appz_setrc(str);
-	c0appz_putrc();
-
-	/* set input */
-	memcpy(key, argv[1], strlen(argv[1]));
-	memset(val, '*', VALINPUT);
-	ino = argv[3];
-	
-	/* initialize resources */
-	if (c0appz_init(0) != 0) {
-		fprintf(stderr, "error! motr initialization failed.\n");
-		return -2;
-	}
-
-	c0appz_timeout(0);
-	c0appz_timein();
-
- 	rc = set_fid();
-	if (rc != 0)
-		fprintf(stderr, "error in fid initialization");	
 
-	gettimeofday(&start1, NULL);
+	*ops = calloc(nr, sizeof(**ops));
+	if (*ops == NULL)
+		return -ENOMEM;
 
-	rc = json_store(key, val, ino);
-	if (rc != 0)
-	{
-		fprintf(stderr, "error in storing json value");
-		c0appz_free();
-		return -3;
+	for (i = 0; i < nr; i++) {
+		(*ops)[i].name = xe[i].name;
+		(*ops)[i].name_len = strlen(xe[i].name);
+		(*ops)[i].value = remove ? NULL : xe[i].value;
+		(*ops)[i].vlen = remove ? 0 : xe[i].vlen;
 	}
 
-	gettimeofday(&end1, NULL);
-	timer(start1, end1, "stored 100 keys in json");
+	return 0;
+}
 
-	printf("Stored successfully json object in motr");
-	
-	int no_of_keys;
-	printf("\n give no of keys to update in json\n");
-	scanf("%d", &no_of_keys);
+static int blob_store(uint64_t ino, const struct xattr_entry *xe, int nr)
+{
+	struct xattr_blob_op *ops;
+	int rc;
 
-	memset(val, '#', VALINPUT);
-	gettimeofday(&start1, NULL);
+	rc = blob_ops(xe, nr, false, &ops);
+	if (rc)
+		return rc;
 
-	rc = json_update(key, val, ino, no_of_keys);	
-	if (rc != 0)
-	{
-		fprintf(stderr, "error in updating json value");
-		c0appz_free();
-		return -3;
-	}
+	rc = blob_update(ino, ops, nr);
+	free(ops);
+	return rc;
+}
 
-	gettimeofday(&end1, NULL);
-	timer(start1, end1, "updated key in json");
+static int blob_lookup(uint64_t ino, const char *name, void *value,
+		       size_t *vlen)
+{
+	struct m0_bufvec val;
+	const void *v;
+	size_t len;
+	int rc;
 
-	char val3[MAXVAL];
-	printf("\n give ino for json value\n");
-	scanf("%s", ino);
+	rc = blob_get(ino, &val);
+	if (rc)
+		return rc;
 
-	gettimeofday(&start1, NULL);
+	rc = xattr_blob_lookup(val.ov_buf[0], val.ov_vec.v_count[0],
+			       name, strlen(name), &v, &len);
+	if (rc)
+		goto out;
 
-	rc = json_get(ino, val3);
-	if (rc != 0)
-	{
-		fprintf(stderr, "error in getting json value");
-		c0appz_free();
-		return -3;
+	if (len > *vlen) {
+		rc = -ERANGE;
+		goto out;
 	}
 
-	parse(val3);
-	//printf("json object retrieved %s", val3);
-
-	gettimeofday(&end1, NULL);
-	timer(start1, end1, "parsed 100 keys in json");
-	ino = NULL;
-	ino = malloc(256);
-	printf("\n give ino for json value\n");
-	scanf("%s", ino);
-
-
-	gettimeofday(&start1, NULL);
+	memcpy(value, v, len);
+	*vlen = len;
+out:
+	m0_bufvec_free(&val);
+	return rc;
+}
 
-	rc = json_delete(key, ino);
-	if (rc != 0)
-	{
-		fprintf(stderr, "error in deleting json value");
-		c0appz_free();
-		return -3;
-	}
+static int blob_list(uint64_t ino, int *nr)
+{
+	struct m0_bufvec val;
+	int rc;
 
-	gettimeofday(&end1, NULL);
-	timer(start1, end1, "deleted 100 keys and values in json");
+	rc = blob_get(ino, &val);
+	if (rc)
+		return rc;
 
+	*nr = xattr_blob_count(val.ov_buf[0], val.ov_vec.v_count[0]);
+	m0_bufvec_free(&val);
+	return 0;
+}
 
-	/* free resources*/
-	c0appz_free();
+static int blob_delete(uint64_t ino, const struct xattr_entry *xe, int nr)
+{
+	struct xattr_blob_op *ops;
+	int rc;
 
-	/* time out */
-	fprintf(stderr, "%4s", "free");
-	c0appz_timeout(0);
+	rc = blob_ops(xe, nr, true, &ops);
+	if (rc)
+		return rc;
 
-	/* success */
-	fprintf(stderr, "%s success\n", basename(argv[0]));
-	return 0;
+	rc = blob_update(ino, ops, nr);
+	free(ops);
+	return rc;
 }
 
+const struct xattr_layout xattr_layout_blob = {
+	.name = "blob",
+	.set = blob_store,
+	.get = blob_lookup,
+	.list = blob_list,
+	.del = blob_delete,
+};
+
 /*
  *  Local variables:
  *  c-indentation-style: "K&R"
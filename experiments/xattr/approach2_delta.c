@@ -0,0 +1,878 @@
+/*
+ * Filename:         approach2_delta.c
+ * Description:      xattr blob per inode with append-only delta records
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Same xattr_blob.h format as approach2, but set and del never rewrite the
+ * whole blob. Each call appends one small delta blob holding only the
+ * changed names, removals as tombstones, under its own key:
+ *
+ *   {be64 ino, '9', be64 seq}
+ *
+ * Deltas sort by seq after the common prefix. The base blob lives under
+ * seq DELTA_BASE_SEQ, the largest one, and lists the seqs of the deltas
+ * folded into it which may still exist:
+ *
+ *   base value  {le32 nr, nr x le64 seq ascending, xattr blob}
+ *
+ * A set is a single blind PUT with no read, so its cost depends on the
+ * size of the change only and concurrent writers of different names on
+ * the same inode no longer overwrite each other. A del first reads, so
+ * that a missing name fails with -ENOENT as in the other layouts, then
+ * appends like a set. Reads walk the prefix with one scan; get checks the
+ * deltas newest first and falls back to the base, list folds everything
+ * in memory.
+ *
+ * A background thread folds the deltas of an inode into its base once
+ * they exceed DELTA_MAX_COUNT records or DELTA_MAX_BYTES bytes. It writes
+ * the new base before deleting the folded deltas, and since the base sorts
+ * after every delta a concurrent scan either still sees a delta or already
+ * sees the base which contains it. Deltas listed in the base are ignored,
+ * so a delta left behind by an interrupted compaction is harmless; the
+ * next compaction deletes it and drops it from the list.
+ *
+ * A seq is taken before the PUT of its delta lands, so a delta with a
+ * lower seq can land after one with a higher seq was folded. It is not in
+ * the list and is still applied, on top of the base. Within this process
+ * compaction only folds deltas older than the oldest append still in
+ * flight, so the base is always a prefix of the appends in seq order and
+ * the order of a merge never changes. Deltas of other processes, whose
+ * clocks may be skewed, are never lost but may be merged after newer
+ * ones. Compaction of an inode must be owned by a single process; in this
+ * experiment that is the one running the benchmark.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <endian.h>
+#include <pthread.h>
+#include <time.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "xattr_blob.h"
+#include "xattr_kvs.h"
+#include "xattr_layout.h"
+
+#define DELTA_BASE_SEQ		UINT64_MAX
+#define DELTA_MAX_COUNT		16
+#define DELTA_MAX_BYTES		(64 * 1024)
+/* Inodes waiting for compaction and inodes with tracked appends */
+#define DELTA_QUEUE_LEN		256
+#define DELTA_TRACK_LEN		1024
+
+struct delta_key {
+	uint64_t ino;
+	char type;
+	uint64_t seq;
+} __attribute((packed));
+
+/* Followed by the folded seqs and the blob */
+struct delta_base {
+	uint32_t nr;
+} __attribute((packed));
+
+struct delta_rec {
+	uint64_t seq;
+	void *buf;
+	size_t len;
+};
+
+/* Everything stored for one inode, as returned by a single scan. */
+struct delta_view {
+	/* Seqs listed in the base, ascending */
+	uint64_t *folded;
+	int folded_nr;
+	void *base;
+	size_t base_len;
+	/* Live deltas, ascending by seq */
+	struct delta_rec *rec;
+	int nr;
+	int cap;
+	/* Deltas which still exist but are listed in the base */
+	uint64_t *stale;
+	int stale_nr;
+	/* Bytes held by the live deltas */
+	size_t bytes;
+	int rc;
+};
+
+/* An append of this process whose PUT has not completed */
+struct delta_inflight {
+	uint64_t seq;
+	struct delta_inflight *prev;
+	struct delta_inflight *next;
+};
+
+/* Appends by this process since the last compaction request of @ino */
+struct delta_track {
+	uint64_t ino;
+	int count;
+	size_t bytes;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	bool running;
+	bool stop;
+	uint64_t queue[DELTA_QUEUE_LEN];
+	int head;
+	int len;
+	struct delta_track track[DELTA_TRACK_LEN];
+} compactor = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+/* Appends in flight, oldest first, and the last seq handed out */
+static struct {
+	pthread_mutex_t lock;
+	struct delta_inflight list;
+	uint64_t last_seq;
+} inflight = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.list = { .prev = &inflight.list, .next = &inflight.list },
+};
+
+/* Strictly increasing within the process and close to wall clock time
+ * across processes, so a later write of a name wins on merge. Called
+ * under inflight.lock.
+ */
+static uint64_t delta_next_seq(void)
+{
+	struct timespec ts;
+	uint64_t now;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	now = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+	inflight.last_seq = now > inflight.last_seq ? now :
+			    inflight.last_seq + 1;
+	return inflight.last_seq;
+}
+
+/* Takes the seq of an append and tracks it until inflight_end(). */
+static void inflight_begin(struct delta_inflight *f)
+{
+	pthread_mutex_lock(&inflight.lock);
+	f->seq = delta_next_seq();
+	f->prev = inflight.list.prev;
+	f->next = &inflight.list;
+	f->prev->next = f;
+	inflight.list.prev = f;
+	pthread_mutex_unlock(&inflight.lock);
+}
+
+static void inflight_end(struct delta_inflight *f)
+{
+	pthread_mutex_lock(&inflight.lock);
+	f->prev->next = f->next;
+	f->next->prev = f->prev;
+	pthread_mutex_unlock(&inflight.lock);
+}
+
+/* Every append of this process with a seq below the horizon has landed,
+ * and every later one gets a seq above it.
+ */
+static uint64_t inflight_horizon(void)
+{
+	uint64_t horizon;
+
+	pthread_mutex_lock(&inflight.lock);
+	if (inflight.list.next != &inflight.list)
+		horizon = inflight.list.next->seq;
+	else
+		horizon = delta_next_seq();
+	pthread_mutex_unlock(&inflight.lock);
+	return horizon;
+}
+
+static void delta_key_init(struct delta_key *key, uint64_t ino, uint64_t seq)
+{
+	key->ino = htobe64(ino);
+	key->type = XATTR_DELTA_TYPE;
+	key->seq = htobe64(seq);
+}
+
+static void delta_view_fini(struct delta_view *view)
+{
+	int i;
+
+	for (i = 0; i < view->nr; i++)
+		free(view->rec[i].buf);
+	free(view->rec);
+	free(view->stale);
+	free(view->folded);
+	free(view->base);
+}
+
+static bool delta_folded(const struct delta_view *view, uint64_t seq)
+{
+	int lo = 0;
+	int hi = view->folded_nr;
+	int mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (view->folded[mid] == seq)
+			return true;
+		if (view->folded[mid] < seq)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return false;
+}
+
+static bool delta_scan_cb(void *arg, const void *key, size_t klen,
+			  const void *val, size_t vlen)
+{
+	struct delta_view *view = arg;
+	const struct delta_key *dkey = key;
+	const struct delta_base *hdr = val;
+	struct delta_rec *rec;
+	size_t off;
+	uint64_t seq;
+	int cap, i;
+
+	if (klen != sizeof(*dkey)) {
+		view->rc = -EINVAL;
+		return false;
+	}
+
+	seq = be64toh(dkey->seq);
+	if (seq == DELTA_BASE_SEQ) {
+		if (vlen < sizeof(*hdr) ||
+		    (vlen - sizeof(*hdr)) / sizeof(seq) < le32toh(hdr->nr)) {
+			view->rc = -EINVAL;
+			return false;
+		}
+
+		view->folded_nr = le32toh(hdr->nr);
+		off = sizeof(*hdr) + view->folded_nr * sizeof(seq);
+		view->base_len = vlen - off;
+		if (view->folded_nr > 0)
+			view->folded = malloc(view->folded_nr * sizeof(seq));
+		if (view->base_len > 0)
+			view->base = malloc(view->base_len);
+		if ((view->folded_nr > 0 && view->folded == NULL) ||
+		    (view->base_len > 0 && view->base == NULL)) {
+			view->rc = -ENOMEM;
+			return false;
+		}
+
+		for (i = 0; i < view->folded_nr; i++) {
+			memcpy(&seq, (const char *)(hdr + 1) + i * sizeof(seq),
+			       sizeof(seq));
+			view->folded[i] = le64toh(seq);
+		}
+		if (view->base_len > 0)
+			memcpy(view->base, (const char *)val + off,
+			       view->base_len);
+		return true;
+	}
+
+	if (view->nr == view->cap) {
+		cap = view->cap ? view->cap * 2 : DELTA_MAX_COUNT;
+		rec = realloc(view->rec, cap * sizeof(*rec));
+		if (rec == NULL) {
+			view->rc = -ENOMEM;
+			return false;
+		}
+		view->rec = rec;
+		view->cap = cap;
+	}
+
+	rec = &view->rec[view->nr];
+	rec->seq = seq;
+	rec->len = vlen;
+	rec->buf = malloc(vlen);
+	if (rec->buf == NULL) {
+		view->rc = -ENOMEM;
+		return false;
+	}
+	memcpy(rec->buf, val, vlen);
+	view->nr++;
+	return true;
+}
+
+/* Loads the base and all deltas of @ino and sets the deltas which are
+ * already folded into the base aside as stale.
+ */
+static int delta_load(uint64_t ino, struct delta_view *view)
+{
+	struct delta_key prefix;
+	int rc, i, j;
+
+	memset(view, 0, sizeof(*view));
+	delta_key_init(&prefix, ino, 0);
+
+	rc = xattr_kvs_scan(&prefix, offsetof(struct delta_key, seq),
+			    delta_scan_cb, view);
+	if (rc == 0)
+		rc = view->rc;
+	if (rc == 0)
+		rc = xattr_blob_check(view->base, view->base_len);
+
+	for (i = 0; rc == 0 && i < view->nr; i++)
+		rc = xattr_blob_check(view->rec[i].buf, view->rec[i].len);
+
+	if (rc == 0 && view->folded_nr > 0) {
+		view->stale = calloc(view->nr + 1, sizeof(*view->stale));
+		if (view->stale == NULL)
+			rc = -ENOMEM;
+	}
+
+	for (i = 0, j = 0; rc == 0 && i < view->nr; i++) {
+		if (delta_folded(view, view->rec[i].seq)) {
+			view->stale[view->stale_nr++] = view->rec[i].seq;
+			free(view->rec[i].buf);
+			continue;
+		}
+		view->bytes += view->rec[i].len;
+		view->rec[j++] = view->rec[i];
+	}
+	if (rc == 0)
+		view->nr = j;
+
+	if (rc) {
+		fprintf(stderr, "error(%d): delta_load\n", rc);
+		delta_view_fini(view);
+	}
+	return rc;
+}
+
+/* Applies the live deltas to the base in seq order. The result is returned
+ * in @blob and is NULL with @len 0 when no xattrs remain.
+ */
+static int delta_fold(const struct delta_view *view, void **blob,
+		      size_t *len)
+{
+	struct xattr_blob_op *ops;
+	void *cur = NULL;
+	void *out;
+	size_t cur_len = 0;
+	size_t out_len;
+	int rc = 0;
+	int nr, i, j;
+
+	if (view->base_len > 0) {
+		cur = malloc(view->base_len);
+		if (cur == NULL)
+			return -ENOMEM;
+		memcpy(cur, view->base, view->base_len);
+		cur_len = view->base_len;
+	}
+
+	for (i = 0; i < view->nr; i++) {
+		nr = xattr_blob_count(view->rec[i].buf, view->rec[i].len);
+		ops = calloc(nr, sizeof(*ops));
+		if (ops == NULL) {
+			rc = -ENOMEM;
+			break;
+		}
+
+		/* Delta entries are already sorted, tombstones come back
+		 * with a NULL value, i.e. as removals.
+		 */
+		for (j = 0; rc == 0 && j < nr; j++)
+			rc = xattr_blob_entry(view->rec[i].buf,
+					      view->rec[i].len, j,
+					      &ops[j].name, &ops[j].name_len,
+					      &ops[j].value, &ops[j].vlen);
+
+		out = NULL;
+		if (rc == 0) {
+			out = malloc(xattr_blob_bound(cur_len, ops, nr));
+			if (out == NULL)
+				rc = -ENOMEM;
+		}
+		if (rc == 0)
+			rc = xattr_blob_update(cur, cur_len, ops, nr, out,
+					       &out_len);
+		free(ops);
+		if (rc) {
+			free(out);
+			break;
+		}
+
+		free(cur);
+		cur = out;
+		cur_len = out_len;
+	}
+
+	if (rc == 0 && cur_len == 0) {
+		free(cur);
+		cur = NULL;
+	}
+	if (rc) {
+		free(cur);
+		return rc;
+	}
+
+	*blob = cur;
+	*len = cur_len;
+	return 0;
+}
+
+/* Queues @ino for the compactor unless it is already queued. A full queue
+ * drops the request; the next reader or writer over the threshold will
+ * queue it again.
+ */
+static void compact_request(uint64_t ino)
+{
+	int i;
+
+	pthread_mutex_lock(&compactor.lock);
+	if (!compactor.running || compactor.len == DELTA_QUEUE_LEN)
+		goto out;
+
+	for (i = 0; i < compactor.len; i++)
+		if (compactor.queue[(compactor.head + i) %
+				    DELTA_QUEUE_LEN] == ino)
+			goto out;
+
+	compactor.queue[(compactor.head + compactor.len++) % DELTA_QUEUE_LEN] =
+		ino;
+	pthread_cond_signal(&compactor.cond);
+out:
+	pthread_mutex_unlock(&compactor.lock);
+}
+
+/* Counts an append of @len bytes to @ino by this process and queues the
+ * inode once the thresholds are reached, so write-only inodes are
+ * compacted as well.
+ */
+static void compact_track(uint64_t ino, size_t len)
+{
+	struct delta_track *t;
+	bool full = false;
+
+	pthread_mutex_lock(&compactor.lock);
+	t = &compactor.track[ino % DELTA_TRACK_LEN];
+	if (t->ino != ino) {
+		t->ino = ino;
+		t->count = 0;
+		t->bytes = 0;
+	}
+
+	t->count++;
+	t->bytes += len;
+	if (t->count >= DELTA_MAX_COUNT || t->bytes >= DELTA_MAX_BYTES) {
+		t->count = 0;
+		t->bytes = 0;
+		full = true;
+	}
+	pthread_mutex_unlock(&compactor.lock);
+
+	if (full)
+		compact_request(ino);
+}
+
+static void compact_check(uint64_t ino, const struct delta_view *view)
+{
+	if (view->nr > DELTA_MAX_COUNT || view->bytes > DELTA_MAX_BYTES)
+		compact_request(ino);
+}
+
+/* Merges the stale seqs of @view with those of its first @n live deltas,
+ * both ascending, into the list of a new base.
+ */
+static uint64_t *compact_seqs(const struct delta_view *view, int n, int *nr)
+{
+	uint64_t *seqs;
+	int i = 0;
+	int j = 0;
+
+	seqs = calloc(view->stale_nr + n + 1, sizeof(*seqs));
+	if (seqs == NULL)
+		return NULL;
+
+	*nr = 0;
+	while (i < view->stale_nr || j < n) {
+		if (j == n ||
+		    (i < view->stale_nr && view->stale[i] < view->rec[j].seq))
+			seqs[(*nr)++] = view->stale[i++];
+		else
+			seqs[(*nr)++] = view->rec[j++].seq;
+	}
+	return seqs;
+}
+
+static int compact_ino(uint64_t ino)
+{
+	struct delta_view view;
+	struct delta_view fold;
+	struct delta_base *hdr;
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	uint64_t *seqs = NULL;
+	uint64_t horizon;
+	uint64_t le_seq;
+	void *blob = NULL;
+	size_t len;
+	int rc, n, nr, i;
+
+	/* Taken before the scan: what lands later is above it */
+	horizon = inflight_horizon();
+
+	rc = delta_load(ino, &view);
+	if (rc)
+		return rc;
+
+	for (n = 0; n < view.nr && view.rec[n].seq < horizon; n++)
+		;
+	if (n == 0 && view.stale_nr == 0)
+		goto free_view;
+
+	fold = view;
+	fold.nr = n;
+	rc = delta_fold(&fold, &blob, &len);
+	if (rc)
+		goto free_view;
+
+	seqs = compact_seqs(&view, n, &nr);
+	if (seqs == NULL) {
+		rc = -ENOMEM;
+		goto free_blob;
+	}
+
+	rc = m0_bufvec_alloc(&key, 1, sizeof(struct delta_key));
+	if (rc)
+		goto free_blob;
+
+	rc = m0_bufvec_alloc(&val, 1, sizeof(*hdr) + nr * sizeof(le_seq) +
+				      len);
+	if (rc)
+		goto free_key;
+
+	/* The base goes first, also when it is empty, so that readers never
+	 * see the old base without the deltas folded into the new one.
+	 */
+	hdr = val.ov_buf[0];
+	hdr->nr = htole32(nr);
+	for (i = 0; i < nr; i++) {
+		le_seq = htole64(seqs[i]);
+		memcpy((char *)(hdr + 1) + i * sizeof(le_seq), &le_seq,
+		       sizeof(le_seq));
+	}
+	if (len > 0)
+		memcpy((char *)(hdr + 1) + nr * sizeof(le_seq), blob, len);
+
+	delta_key_init(key.ov_buf[0], ino, DELTA_BASE_SEQ);
+	rc = xattr_kvs_op(M0_IC_PUT, &key, &val, M0_OIF_OVERWRITE);
+	if (rc) {
+		fprintf(stderr, "error(%d): base PUT while compact_ino\n", rc);
+		goto free_val;
+	}
+
+	for (i = 0; i < nr; i++) {
+		delta_key_init(key.ov_buf[0], ino, seqs[i]);
+		rc = xattr_kvs_op(M0_IC_DEL, &key, NULL, 0);
+		if (rc == -ENOENT)
+			rc = 0;
+		if (rc) {
+			fprintf(stderr, "error(%d): delta DEL while compact_ino\n",
+				rc);
+			goto free_val;
+		}
+	}
+
+	/* Nothing left which the list has to hide */
+	if (len == 0) {
+		delta_key_init(key.ov_buf[0], ino, DELTA_BASE_SEQ);
+		rc = xattr_kvs_op(M0_IC_DEL, &key, NULL, 0);
+		if (rc == -ENOENT)
+			rc = 0;
+	}
+
+free_val:
+	m0_bufvec_free(&val);
+free_key:
+	m0_bufvec_free(&key);
+free_blob:
+	free(seqs);
+	free(blob);
+free_view:
+	delta_view_fini(&view);
+	return rc;
+}
+
+static void *compactor_fn(void *arg)
+{
+	uint64_t ino;
+
+	(void)arg;
+	xattr_kvs_thread_init();
+
+	pthread_mutex_lock(&compactor.lock);
+	for (;;) {
+		while (compactor.len == 0 && !compactor.stop)
+			pthread_cond_wait(&compactor.cond, &compactor.lock);
+
+		/* Drain the queue before stopping */
+		if (compactor.len == 0)
+			break;
+
+		ino = compactor.queue[compactor.head];
+		compactor.head = (compactor.head + 1) % DELTA_QUEUE_LEN;
+		compactor.len--;
+		pthread_mutex_unlock(&compactor.lock);
+
+		compact_ino(ino);
+
+		pthread_mutex_lock(&compactor.lock);
+	}
+	pthread_mutex_unlock(&compactor.lock);
+
+	xattr_kvs_thread_fini();
+	return NULL;
+}
+
+/* Writes the changes of one call as a single delta record. */
+static int delta_append(uint64_t ino, const struct xattr_entry *xe, int nr,
+			bool remove)
+{
+	struct delta_inflight inflight_ent;
+	struct xattr_blob_op *ops;
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	size_t len;
+	int rc, i;
+
+	ops = calloc(nr, sizeof(*ops));
+	if (ops == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		ops[i].name = xe[i].name;
+		ops[i].name_len = strlen(xe[i].name);
+		ops[i].value = remove ? NULL : xe[i].value;
+		ops[i].vlen = remove ? 0 : xe[i].vlen;
+	}
+	xattr_blob_sort_ops(ops, nr);
+
+	rc = m0_bufvec_alloc(&key, 1, sizeof(struct delta_key));
+	if (rc)
+		goto free_ops;
+
+	rc = m0_bufvec_alloc(&val, 1, xattr_blob_bound(0, ops, nr));
+	if (rc)
+		goto free_key;
+
+	rc = xattr_blob_build(ops, nr, val.ov_buf[0], &len);
+	if (rc || len == 0)
+		goto free_val;
+
+	val.ov_vec.v_count[0] = len;
+	inflight_begin(&inflight_ent);
+	delta_key_init(key.ov_buf[0], ino, inflight_ent.seq);
+
+	rc = xattr_kvs_op(M0_IC_PUT, &key, &val, 0);
+	inflight_end(&inflight_ent);
+	if (rc) {
+		fprintf(stderr, "error(%d): xattr_kvs_op while delta_append\n",
+			rc);
+		goto free_val;
+	}
+
+	compact_track(ino, len);
+
+free_val:
+	m0_bufvec_free(&val);
+free_key:
+	m0_bufvec_free(&key);
+free_ops:
+	free(ops);
+	return rc;
+}
+
+static int delta_set(uint64_t ino, const struct xattr_entry *xe, int nr)
+{
+	return delta_append(ino, xe, nr, false);
+}
+
+/* Finds the current value of @name: in the newest delta which has it,
+ * else in the base. -ENOENT if missing or removed by a newer delta.
+ */
+static int delta_find(const struct delta_view *view, const char *name,
+		      const void **v, size_t *len)
+{
+	int rc = -ENOENT;
+	int i;
+
+	for (i = view->nr - 1; i >= 0 && rc == -ENOENT; i--)
+		rc = xattr_blob_lookup(view->rec[i].buf, view->rec[i].len,
+				       name, strlen(name), v, len);
+	if (rc == -ENOENT)
+		rc = xattr_blob_lookup(view->base, view->base_len,
+				       name, strlen(name), v, len);
+	if (rc == 0 && *v == NULL)
+		rc = -ENOENT;
+	return rc;
+}
+
+/* Removes the names which exist and fails with -ENOENT if any did not. */
+static int delta_del(uint64_t ino, const struct xattr_entry *xe, int nr)
+{
+	struct xattr_entry *present;
+	struct delta_view view;
+	const void *v;
+	size_t len;
+	int missing = 0;
+	int n = 0;
+	int rc, i;
+
+	rc = delta_load(ino, &view);
+	if (rc)
+		return rc;
+
+	present = calloc(nr, sizeof(*present));
+	if (present == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < nr; i++) {
+		rc = delta_find(&view, xe[i].name, &v, &len);
+		if (rc == 0)
+			present[n++] = xe[i];
+		else if (rc == -ENOENT)
+			missing++;
+		else
+			goto out;
+	}
+
+	rc = 0;
+	if (n > 0)
+		rc = delta_append(ino, present, n, true);
+	if (rc == 0 && missing > 0)
+		rc = -ENOENT;
+out:
+	free(present);
+	delta_view_fini(&view);
+	return rc;
+}
+
+static int delta_get(uint64_t ino, const char *name, void *value,
+		     size_t *vlen)
+{
+	struct delta_view view;
+	const void *v;
+	size_t len;
+	int rc;
+
+	rc = delta_load(ino, &view);
+	if (rc)
+		return rc;
+
+	rc = delta_find(&view, name, &v, &len);
+	if (rc)
+		goto out;
+
+	if (len > *vlen) {
+		rc = -ERANGE;
+		goto out;
+	}
+
+	memcpy(value, v, len);
+	*vlen = len;
+out:
+	compact_check(ino, &view);
+	delta_view_fini(&view);
+	return rc;
+}
+
+static int delta_list(uint64_t ino, int *nr)
+{
+	struct delta_view view;
+	void *blob;
+	size_t len;
+	int rc;
+
+	rc = delta_load(ino, &view);
+	if (rc)
+		return rc;
+
+	rc = delta_fold(&view, &blob, &len);
+	if (rc == 0) {
+		*nr = xattr_blob_count(blob, len);
+		free(blob);
+	}
+
+	compact_check(ino, &view);
+	delta_view_fini(&view);
+	return rc;
+}
+
+static int delta_init(const struct xattr_layout_params *params)
+{
+	int rc;
+
+	(void)params;
+	pthread_mutex_lock(&compactor.lock);
+	compactor.stop = false;
+	compactor.head = 0;
+	compactor.len = 0;
+	memset(compactor.track, 0, sizeof(compactor.track));
+
+	rc = pthread_create(&compactor.thread, NULL, compactor_fn, NULL);
+	compactor.running = rc == 0;
+	pthread_mutex_unlock(&compactor.lock);
+
+	return -rc;
+}
+
+static void delta_fini(void)
+{
+	pthread_mutex_lock(&compactor.lock);
+	compactor.stop = true;
+	pthread_cond_signal(&compactor.cond);
+	pthread_mutex_unlock(&compactor.lock);
+
+	pthread_join(compactor.thread, NULL);
+
+	pthread_mutex_lock(&compactor.lock);
+	compactor.running = false;
+	pthread_mutex_unlock(&compactor.lock);
+}
+
+const struct xattr_layout xattr_layout_blob_delta = {
+	.name = "blob_delta",
+	.init = delta_init,
+	.fini = delta_fini,
+	.set = delta_set,
+	.get = delta_get,
+	.list = delta_list,
+	.del = delta_del,
+};
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,493 @@
+/*
+ * Filename:         approach3.c
+ * Description:      Hybrid xattr layout: inline record plus spilled keys
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Every inode with xattrs has one record under {ino, '8'} listing all of
+ * its xattr names. Values up to inline_max bytes are stored in the record
+ * itself; larger ones, or ones which would push the record past
+ * HYB_REC_MAX, are spilled to the per-xattr cortxfs_xattr key of approach1
+ * and only a spill marker stays in the record. The name and marker of a
+ * spilled xattr still count towards HYB_REC_MAX; a set which does not fit
+ * even with its value spilled fails with -ENOSPC and changes nothing.
+ *
+ * getxattr of an inline value and listxattr are a single GET. On every set
+ * each value is placed according to its new size, so an xattr moves between
+ * the record and its own key whenever it crosses the threshold. Spilled
+ * values are written before the record and stale spilled keys are removed
+ * after it, so the record never points to a missing value.
+ *
+ * Record format (little-endian):
+ *   u8 version, u8 pad, u16 nr
+ *   nr times: u8 flags, u8 name_len, u32 vlen, name, value if inline
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <endian.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "xattr_kvs.h"
+#include "xattr_layout.h"
+
+#define HYB_REC_VERSION	1
+#define HYB_REC_MAX	16384
+/* Entries one record can count */
+#define HYB_REC_NR_MAX	UINT16_MAX
+#define HYB_INLINE_MAX	256
+
+#define HYB_INLINE	0x1
+#define HYB_SPILLED	0x2
+
+struct hyb_rec_hdr {
+	uint8_t version;
+	uint8_t pad;
+	uint16_t nr;
+} __attribute((packed));
+
+struct hyb_ent_hdr {
+	uint8_t flags;
+	uint8_t name_len;
+	uint32_t vlen;
+} __attribute((packed));
+
+struct hyb_ent {
+	const char *name;
+	size_t name_len;
+	uint8_t flags;
+	uint32_t vlen;
+	/* NULL for spilled entries */
+	const void *value;
+};
+
+/* Decoded record. Entries point into @val or into caller buffers. */
+struct hyb_rec {
+	struct m0_bufvec val;
+	struct hyb_ent *ent;
+	int nr;
+	int cap;
+	size_t bytes;
+};
+
+static size_t inline_max = HYB_INLINE_MAX;
+
+static size_t ent_size(const struct hyb_ent *ent)
+{
+	return sizeof(struct hyb_ent_hdr) + ent->name_len +
+	       (ent->flags & HYB_INLINE ? ent->vlen : 0);
+}
+
+static void rec_key(struct m0_bufvec *key, uint64_t ino)
+{
+	struct cortxfs_xattr *xkey = key->ov_buf[0];
+
+	xattr_key_init(xkey, ino, NULL);
+	xkey->type = XATTR_INLINE_TYPE;
+	key->ov_vec.v_count[0] = XATTR_PREFIX_LEN;
+}
+
+static void rec_fini(struct hyb_rec *rec)
+{
+	m0_bufvec_free(&rec->val);
+	free(rec->ent);
+}
+
+static int rec_grow(struct hyb_rec *rec, int nr)
+{
+	struct hyb_ent *ent;
+	int cap;
+
+	if (nr <= rec->cap)
+		return 0;
+
+	cap = rec->cap ? rec->cap : 16;
+	while (cap < nr)
+		cap *= 2;
+
+	ent = realloc(rec->ent, cap * sizeof(*ent));
+	if (ent == NULL)
+		return -ENOMEM;
+
+	rec->ent = ent;
+	rec->cap = cap;
+	return 0;
+}
+
+static int rec_parse(struct hyb_rec *rec, const char *buf, size_t len)
+{
+	const struct hyb_rec_hdr *hdr = (const void *)buf;
+	const struct hyb_ent_hdr *eh;
+	struct hyb_ent *ent;
+	size_t off = sizeof(*hdr);
+	int nr, rc, i;
+
+	if (len < sizeof(*hdr) || hdr->version != HYB_REC_VERSION)
+		return -EINVAL;
+
+	nr = le16toh(hdr->nr);
+	rc = rec_grow(rec, nr);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < nr; i++) {
+		if (off + sizeof(*eh) > len)
+			return -EINVAL;
+
+		eh = (const void *)(buf + off);
+		ent = &rec->ent[i];
+		ent->flags = eh->flags;
+		ent->name_len = eh->name_len;
+		ent->vlen = le32toh(eh->vlen);
+		ent->name = buf + off + sizeof(*eh);
+		ent->value = ent->flags & HYB_INLINE ?
+			     ent->name + ent->name_len : NULL;
+
+		off += ent_size(ent);
+		if (off > len)
+			return -EINVAL;
+	}
+
+	rec->nr = nr;
+	rec->bytes = off;
+	return 0;
+}
+
+static int rec_load(uint64_t ino, struct hyb_rec *rec)
+{
+	struct m0_bufvec key;
+	int rc;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->bytes = sizeof(struct hyb_rec_hdr);
+
+	rc = m0_bufvec_alloc(&key, 1, XATTR_KEY_MAX);
+	if (rc)
+		return rc;
+
+	rc = m0_bufvec_empty_alloc(&rec->val, 1);
+	if (rc)
+		goto out;
+
+	rec_key(&key, ino);
+	rc = xattr_kvs_op(M0_IC_GET, &key, &rec->val, 0);
+	if (rc == -ENOENT) {
+		rc = 0;
+		goto out;
+	}
+	if (rc)
+		goto out;
+
+	rc = rec_parse(rec, rec->val.ov_buf[0], rec->val.ov_vec.v_count[0]);
+out:
+	m0_bufvec_free(&key);
+	if (rc)
+		rec_fini(rec);
+	return rc;
+}
+
+static int rec_store(uint64_t ino, struct hyb_rec *rec)
+{
+	struct hyb_rec_hdr *hdr;
+	struct hyb_ent_hdr *eh;
+	struct hyb_ent *ent;
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	char *buf;
+	size_t off;
+	int rc, i;
+
+	rc = m0_bufvec_alloc(&key, 1, XATTR_KEY_MAX);
+	if (rc)
+		return rc;
+
+	rec_key(&key, ino);
+
+	if (rec->nr == 0) {
+		rc = xattr_kvs_op(M0_IC_DEL, &key, NULL, 0);
+		if (rc == -ENOENT)
+			rc = 0;
+		goto out;
+	}
+
+	rc = m0_bufvec_alloc(&val, 1, rec->bytes);
+	if (rc)
+		goto out;
+
+	buf = val.ov_buf[0];
+	hdr = (void *)buf;
+	hdr->version = HYB_REC_VERSION;
+	hdr->pad = 0;
+	hdr->nr = htole16(rec->nr);
+	off = sizeof(*hdr);
+
+	for (i = 0; i < rec->nr; i++) {
+		ent = &rec->ent[i];
+		eh = (void *)(buf + off);
+		eh->flags = ent->flags;
+		eh->name_len = ent->name_len;
+		eh->vlen = htole32(ent->vlen);
+		off += sizeof(*eh);
+		memcpy(buf + off, ent->name, ent->name_len);
+		off += ent->name_len;
+		if (ent->flags & HYB_INLINE) {
+			memcpy(buf + off, ent->value, ent->vlen);
+			off += ent->vlen;
+		}
+	}
+
+	rc = xattr_kvs_op(M0_IC_PUT, &key, &val, M0_OIF_OVERWRITE);
+	m0_bufvec_free(&val);
+out:
+	m0_bufvec_free(&key);
+	return rc;
+}
+
+static int rec_find(const struct hyb_rec *rec, const char *name)
+{
+	size_t len = strlen(name);
+	int i;
+
+	for (i = 0; i < rec->nr; i++)
+		if (rec->ent[i].name_len == len &&
+		    memcmp(rec->ent[i].name, name, len) == 0)
+			return i;
+
+	return -1;
+}
+
+/* Replaces entry @idx, or appends when @idx is -1. */
+static int rec_put(struct hyb_rec *rec, int idx, const struct hyb_ent *ent)
+{
+	int rc;
+
+	if (idx < 0) {
+		rc = rec_grow(rec, rec->nr + 1);
+		if (rc)
+			return rc;
+		idx = rec->nr++;
+	} else {
+		rec->bytes -= ent_size(&rec->ent[idx]);
+	}
+
+	rec->ent[idx] = *ent;
+	rec->bytes += ent_size(ent);
+	return 0;
+}
+
+static void rec_remove(struct hyb_rec *rec, int idx)
+{
+	rec->bytes -= ent_size(&rec->ent[idx]);
+	rec->ent[idx] = rec->ent[--rec->nr];
+}
+
+static int hybrid_set(uint64_t ino, const struct xattr_entry *xe, int nr)
+{
+	struct xattr_entry *spill = NULL;
+	struct xattr_entry *unspill = NULL;
+	struct hyb_rec rec;
+	struct hyb_ent ent;
+	int nspill = 0;
+	int nunspill = 0;
+	size_t old;
+	int rc, idx, i;
+
+	rc = rec_load(ino, &rec);
+	if (rc)
+		return rc;
+
+	spill = calloc(nr, sizeof(*spill));
+	unspill = calloc(nr, sizeof(*unspill));
+	if (spill == NULL || unspill == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < nr; i++) {
+		ent.name = xe[i].name;
+		ent.name_len = strlen(xe[i].name);
+		ent.vlen = xe[i].vlen;
+		if (ent.name_len == 0 || ent.name_len > XATTR_NAME_MAX) {
+			rc = -ENAMETOOLONG;
+			goto out;
+		}
+
+		idx = rec_find(&rec, xe[i].name);
+		old = idx < 0 ? 0 : ent_size(&rec.ent[idx]);
+
+		ent.flags = HYB_INLINE;
+		ent.value = xe[i].value;
+		if (xe[i].vlen > inline_max ||
+		    rec.bytes - old + ent_size(&ent) > HYB_REC_MAX) {
+			ent.flags = HYB_SPILLED;
+			ent.value = NULL;
+			spill[nspill++] = xe[i];
+		} else if (idx >= 0 && rec.ent[idx].flags & HYB_SPILLED) {
+			unspill[nunspill++] = xe[i];
+		}
+
+		/* What stays in the record, the value only if inline */
+		if (rec.bytes - old + ent_size(&ent) > HYB_REC_MAX ||
+		    (idx < 0 && rec.nr == HYB_REC_NR_MAX)) {
+			rc = -ENOSPC;
+			goto out;
+		}
+
+		rc = rec_put(&rec, idx, &ent);
+		if (rc)
+			goto out;
+	}
+
+	if (nspill > 0) {
+		rc = xattr_kvs_put_batch(ino, spill, nspill);
+		if (rc)
+			goto out;
+	}
+
+	rc = rec_store(ino, &rec);
+	if (rc)
+		goto out;
+
+	if (nunspill > 0)
+		rc = xattr_kvs_del_batch(ino, unspill, nunspill);
+
+out:
+	free(unspill);
+	free(spill);
+	rec_fini(&rec);
+	return rc;
+}
+
+static int hybrid_get(uint64_t ino, const char *name, void *value,
+		      size_t *vlen)
+{
+	struct hyb_rec rec;
+	struct hyb_ent *ent;
+	int rc, idx;
+
+	rc = rec_load(ino, &rec);
+	if (rc)
+		return rc;
+
+	idx = rec_find(&rec, name);
+	if (idx < 0) {
+		rc = -ENOENT;
+		goto out;
+	}
+
+	ent = &rec.ent[idx];
+	if (ent->flags & HYB_SPILLED) {
+		rc = xattr_kvs_get_one(ino, name, value, vlen);
+		goto out;
+	}
+
+	if (ent->vlen > *vlen) {
+		rc = -ERANGE;
+		goto out;
+	}
+
+	memcpy(value, ent->value, ent->vlen);
+	*vlen = ent->vlen;
+out:
+	rec_fini(&rec);
+	return rc;
+}
+
+static int hybrid_list(uint64_t ino, int *nr)
+{
+	struct hyb_rec rec;
+	int rc;
+
+	rc = rec_load(ino, &rec);
+	if (rc)
+		return rc;
+
+	*nr = rec.nr;
+	rec_fini(&rec);
+	return 0;
+}
+
+static int hybrid_del(uint64_t ino, const struct xattr_entry *xe, int nr)
+{
+	struct xattr_entry *unspill;
+	struct hyb_rec rec;
+	int nunspill = 0;
+	int missing = 0;
+	int rc, idx, i;
+
+	rc = rec_load(ino, &rec);
+	if (rc)
+		return rc;
+
+	unspill = calloc(nr, sizeof(*unspill));
+	if (unspill == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < nr; i++) {
+		idx = rec_find(&rec, xe[i].name);
+		if (idx < 0) {
+			missing++;
+			continue;
+		}
+		if (rec.ent[idx].flags & HYB_SPILLED)
+			unspill[nunspill++] = xe[i];
+		rec_remove(&rec, idx);
+	}
+
+	rc = rec_store(ino, &rec);
+	if (rc == 0 && nunspill > 0)
+		rc = xattr_kvs_del_batch(ino, unspill, nunspill);
+	if (rc == 0 && missing > 0)
+		rc = -ENOENT;
+
+out:
+	free(unspill);
+	rec_fini(&rec);
+	return rc;
+}
+
+static int hybrid_init(const struct xattr_layout_params *params)
+{
+	if (params->inline_max > 0)
+		inline_max = params->inline_max;
+	return 0;
+}
+
+const struct xattr_layout xattr_layout_hybrid = {
+	.name = "hybrid",
+	.init = hybrid_init,
+	.set = hybrid_set,
+	.get = hybrid_get,
+	.list = hybrid_list,
+	.del = hybrid_del,
+};
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
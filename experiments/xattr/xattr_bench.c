@@ -0,0 +1,605 @@
+/*
+ * Filename:         xattr_bench.c
+ * Description:      Benchmark driver comparing xattr storage layouts
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This driver runs the following experiment for every layout and every
+ * combination of the swept parameters:
+ * - each thread owns one inode and sets N xattrs in batches
+ * - gets every xattr by name
+ * - gets as many names which do not exist, expecting ENOENT
+ * - lists the xattrs of its inode
+ * - with -x copies them to a second inode in bulk, checks the copy with a
+ *   list and removes it again; latencies cover the copy only
+ * - deletes the xattrs in batches, or with -u removes all xattrs of the
+ *   inode by prefix as unlink would, inline or through the background
+ *   reclaimer
+ * For each phase one result row is printed with throughput (xattrs/s) and
+ * per-call latency percentiles, merged over all threads and repetitions.
+ *
+ * Build together with approach1.c, approach1_async.c, approach1_cached.c,
+ * approach2.c, approach2_delta.c, approach3.c, xattr_blob.c, xattr_cache.c,
+ * xattr_clone.c, xattr_filter.c, xattr_kvs.c, xattr_kvs_async.c,
+ * xattr_reclaim.c, ../common/bench.c and ../common/perf_hist.c against
+ * Motr.
+ *
+ * Example:
+ *   xattr_bench -l kv,blob,hybrid -n 100,1000 -s 16,512 -b 1,100 -t 1,8
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "../common/bench.h"
+#include "xattr_kvs.h"
+#include "xattr_clone.h"
+#include "xattr_layout.h"
+#include "xattr_reclaim.h"
+
+#define DEFAULT_INO 123456ULL
+
+enum bench_op {
+	BENCH_SET,
+	BENCH_GET,
+	BENCH_MISS,
+	BENCH_LIST,
+	BENCH_CLONE,
+	BENCH_DEL,
+	BENCH_UNLINK,
+	BENCH_OP_NR,
+};
+
+static const char *bench_op_name[BENCH_OP_NR] = {
+	[BENCH_SET] = "set",
+	[BENCH_GET] = "get",
+	[BENCH_MISS] = "miss",
+	[BENCH_LIST] = "list",
+	[BENCH_CLONE] = "clone",
+	[BENCH_DEL] = "del",
+	[BENCH_UNLINK] = "unlink",
+};
+
+enum bench_unlink {
+	UNLINK_NONE,
+	UNLINK_SYNC,
+	UNLINK_DEFER,
+};
+
+static const struct xattr_layout *layouts[] = {
+	&xattr_layout_kv,
+	&xattr_layout_blob,
+	&xattr_layout_kv_async,
+	&xattr_layout_hybrid,
+	&xattr_layout_blob_delta,
+	&xattr_layout_kv_cache,
+	&xattr_layout_kv_cache_filter,
+};
+
+#define NR_LAYOUTS (sizeof(layouts) / sizeof(layouts[0]))
+
+struct bench_cfg {
+	const struct xattr_layout *layout[NR_LAYOUTS];
+	int nr_layouts;
+	struct bench_sweep count;
+	struct bench_sweep vsize;
+	struct bench_sweep batch;
+	struct bench_sweep threads;
+	int op_keys;
+	size_t inline_max;
+	int window;
+	size_t cache_bytes;
+	int reps;
+	uint64_t base_ino;
+	bool json;
+	bool clone;
+	enum bench_unlink unlink;
+};
+
+/* Parameters of one point in the sweep. */
+struct bench_run {
+	const struct xattr_layout *layout;
+	int count;
+	size_t vsize;
+	int batch;
+	int threads;
+	int reps;
+	uint64_t base_ino;
+	bool clone;
+	enum bench_unlink unlink;
+	struct bench_clock clock;
+};
+
+struct bench_thread {
+	int index;
+	struct bench_run *run;
+	struct bench_stats stats[BENCH_OP_NR];
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+"Usage: %s [-l layouts] [-n counts] [-s sizes] [-b batches] [-t threads]\n"
+"          [-k keys] [-w ops] [-m bytes] [-c bytes] [-r reps]\n"
+"          [-u sync|defer] [-x] [-i ino] [-f csv|json]\n"
+"  -l  comma separated layouts (kv,blob,kv_async,hybrid,\n"
+"      blob_delta,kv_cache,kv_cache_filter), default all\n"
+"  -n  xattrs per inode, default 100\n"
+"  -s  value size in bytes, default 512\n"
+"  -b  xattrs per set/del call, default 100\n"
+"  -t  threads, each on its own inode, default 1\n"
+"  -k  keys per index op for kv_async, default 1\n"
+"  -w  index ops in flight for kv_async, default 64\n"
+"  -m  largest inline value for hybrid, default 256\n"
+"  -c  memory budget of the kv_cache cache, default 64MB\n"
+"  -u  replace del by a prefix delete of all xattrs, inline or deferred\n"
+"  -x  also time a bulk copy of all xattrs to a second inode\n"
+"  -r  repetitions merged into each result row, default 1\n"
+"  -i  first inode number, default %llu\n"
+"  -f  output format, default csv\n"
+"  -n, -s, -b and -t take comma separated lists which are swept.\n",
+		prog, DEFAULT_INO);
+}
+
+static int parse_layouts(const char *arg, struct bench_cfg *cfg)
+{
+	char *copy = strdup(arg);
+	char *save = NULL;
+	char *tok;
+	size_t i;
+
+	cfg->nr_layouts = 0;
+	for (tok = strtok_r(copy, ",", &save); tok != NULL;
+	     tok = strtok_r(NULL, ",", &save)) {
+		for (i = 0; i < NR_LAYOUTS; i++)
+			if (strcmp(tok, layouts[i]->name) == 0)
+				break;
+		if (i == NR_LAYOUTS || cfg->nr_layouts == (int)NR_LAYOUTS) {
+			fprintf(stderr, "unknown layout %s\n", tok);
+			free(copy);
+			return -EINVAL;
+		}
+		cfg->layout[cfg->nr_layouts++] = layouts[i];
+	}
+
+	free(copy);
+	return cfg->nr_layouts > 0 ? 0 : -EINVAL;
+}
+
+static int parse_args(int argc, char **argv, struct bench_cfg *cfg)
+{
+	size_t i;
+	int opt;
+	int rc = 0;
+
+	memset(cfg, 0, sizeof(*cfg));
+	for (i = 0; i < NR_LAYOUTS; i++)
+		cfg->layout[i] = layouts[i];
+	cfg->nr_layouts = NR_LAYOUTS;
+	bench_sweep_parse("100", &cfg->count);
+	bench_sweep_parse("512", &cfg->vsize);
+	bench_sweep_parse("100", &cfg->batch);
+	bench_sweep_parse("1", &cfg->threads);
+	cfg->op_keys = 1;
+	cfg->inline_max = 256;
+	cfg->window = 64;
+	cfg->reps = 1;
+	cfg->base_ino = DEFAULT_INO;
+
+	while (rc == 0 && (opt = getopt(argc, argv, "l:n:s:b:t:k:w:m:c:u:xr:i:f:h")) != -1) {
+		switch (opt) {
+		case 'l':
+			rc = parse_layouts(optarg, cfg);
+			break;
+		case 'n':
+			rc = bench_sweep_parse(optarg, &cfg->count);
+			break;
+		case 's':
+			rc = bench_sweep_parse(optarg, &cfg->vsize);
+			break;
+		case 'b':
+			rc = bench_sweep_parse(optarg, &cfg->batch);
+			break;
+		case 't':
+			rc = bench_sweep_parse(optarg, &cfg->threads);
+			break;
+		case 'k':
+			cfg->op_keys = atoi(optarg);
+			break;
+		case 'w':
+			cfg->window = atoi(optarg);
+			break;
+		case 'm':
+			cfg->inline_max = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			cfg->cache_bytes = strtoul(optarg, NULL, 0);
+			break;
+		case 'u':
+			if (strcmp(optarg, "sync") == 0)
+				cfg->unlink = UNLINK_SYNC;
+			else if (strcmp(optarg, "defer") == 0)
+				cfg->unlink = UNLINK_DEFER;
+			else
+				rc = -EINVAL;
+			break;
+		case 'x':
+			cfg->clone = true;
+			break;
+		case 'r':
+			cfg->reps = atoi(optarg);
+			break;
+		case 'i':
+			cfg->base_ino = strtoull(optarg, NULL, 0);
+			break;
+		case 'f':
+			if (strcmp(optarg, "json") == 0)
+				cfg->json = true;
+			else if (strcmp(optarg, "csv") != 0)
+				rc = -EINVAL;
+			break;
+		default:
+			rc = -EINVAL;
+			break;
+		}
+	}
+
+	if (rc == 0 && bench_sweep_max(&cfg->threads) > BENCH_THREADS_MAX)
+		rc = -EINVAL;
+
+	if (rc == 0 && (cfg->op_keys <= 0 || cfg->window <= 0 ||
+			cfg->reps <= 0))
+		rc = -EINVAL;
+
+	return rc;
+}
+
+/* Either del or unlink clears the inode, never both. */
+static bool bench_op_enabled(const struct bench_run *run, enum bench_op op)
+{
+	if (op == BENCH_CLONE)
+		return run->clone;
+	if (op == BENCH_DEL)
+		return run->unlink == UNLINK_NONE;
+	if (op == BENCH_UNLINK)
+		return run->unlink != UNLINK_NONE;
+	return true;
+}
+
+static void bench_phase(struct bench_thread *bt, enum bench_op op,
+			uint64_t ino, const struct xattr_entry *xe, char *out)
+{
+	struct bench_run *run = bt->run;
+	struct bench_stats *stats = &bt->stats[op];
+	const struct xattr_layout *layout = run->layout;
+	char name[XATTR_NAME_MAX + 1];
+	size_t vlen;
+	uint64_t dst;
+	uint64_t t0;
+	int nr, cnt, rc, i;
+
+	switch (op) {
+	case BENCH_SET:
+	case BENCH_DEL:
+		for (i = 0; i < run->count; i += cnt) {
+			cnt = run->count - i < run->batch ? run->count - i :
+							   run->batch;
+			t0 = perf_now_ns();
+			if (op == BENCH_SET)
+				rc = layout->set(ino, xe + i, cnt);
+			else
+				rc = layout->del(ino, xe + i, cnt);
+			bench_record(stats, cnt, rc, t0);
+		}
+		break;
+	case BENCH_GET:
+		for (i = 0; i < run->count; i++) {
+			vlen = run->vsize;
+			t0 = perf_now_ns();
+			rc = layout->get(ino, xe[i].name, out, &vlen);
+			if (rc == 0 && vlen != run->vsize)
+				rc = -EIO;
+			bench_record(stats, 1, rc, t0);
+		}
+		break;
+	case BENCH_MISS:
+		for (i = 0; i < run->count; i++) {
+			snprintf(name, sizeof(name), "user.missing_%d", i);
+			vlen = run->vsize;
+			t0 = perf_now_ns();
+			rc = layout->get(ino, name, out, &vlen);
+			rc = rc == -ENOENT ? 0 : rc == 0 ? -EIO : rc;
+			bench_record(stats, 1, rc, t0);
+		}
+		break;
+	case BENCH_UNLINK:
+		t0 = perf_now_ns();
+		if (run->unlink == UNLINK_DEFER)
+			rc = xattr_reclaim_defer(ino);
+		else
+			rc = xattr_reclaim_ino(ino);
+		bench_record(stats, run->count, rc, t0);
+		break;
+	case BENCH_CLONE:
+		/* Clear of the inodes of all other threads */
+		dst = ino + BENCH_THREADS_MAX;
+		nr = 0;
+		t0 = perf_now_ns();
+		rc = xattr_clone(ino, dst, NULL);
+		bench_record(stats, run->count, 0, t0);
+		if (layout->forget != NULL)
+			layout->forget(dst);
+		if (rc == 0) {
+			rc = layout->list(dst, &nr);
+			if (rc == 0 && nr != run->count)
+				rc = -EIO;
+		}
+		if (rc)
+			stats->errors++;
+		xattr_reclaim_ino(dst);
+		break;
+	case BENCH_LIST:
+		nr = 0;
+		t0 = perf_now_ns();
+		rc = layout->list(ino, &nr);
+		if (rc == 0 && nr != run->count)
+			rc = -EIO;
+		bench_record(stats, nr, rc, t0);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Readies @ino for the next repetition once the unlink phase is timed:
+ * reclaims what was deferred and drops what the layout cached of it.
+ */
+static void bench_unlinked(const struct bench_run *run, uint64_t ino)
+{
+	if (run->unlink == UNLINK_DEFER)
+		xattr_reclaim_flush();
+	if (run->layout->forget != NULL)
+		run->layout->forget(ino);
+}
+
+static void *bench_thread_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	struct bench_run *run = bt->run;
+	uint64_t ino = run->base_ino + bt->index;
+	struct xattr_entry *xe;
+	char *names;
+	char *value;
+	char *out;
+	int rep, op, rc, i;
+
+	xe = calloc(run->count, sizeof(*xe));
+	names = calloc(run->count, XATTR_NAME_MAX + 1);
+	value = malloc(run->vsize);
+	out = malloc(run->vsize);
+	if (xe == NULL || names == NULL || value == NULL || out == NULL) {
+		fprintf(stderr, "thread %d: out of memory\n", bt->index);
+		exit(-ENOMEM);
+	}
+
+	rc = xattr_kvs_thread_init();
+	if (rc)
+		exit(rc);
+
+	memset(value, 'a' + bt->index % 26, run->vsize);
+	for (i = 0; i < run->count; i++) {
+		xe[i].name = names + i * (XATTR_NAME_MAX + 1);
+		snprintf((char *)xe[i].name, XATTR_NAME_MAX + 1,
+			 "user.bench_%d", i);
+		xe[i].value = value;
+		xe[i].vlen = run->vsize;
+	}
+
+	for (rep = 0; rep < run->reps; rep++) {
+		for (op = 0; op < BENCH_OP_NR; op++) {
+			if (!bench_op_enabled(run, op))
+				continue;
+			bench_phase_begin(&run->clock, bt->index);
+			bench_phase(bt, op, ino, xe, out);
+			bench_phase_end(&run->clock, bt->index, op);
+			if (op == BENCH_UNLINK)
+				bench_unlinked(run, ino);
+		}
+	}
+
+	xattr_kvs_thread_fini();
+	free(out);
+	free(value);
+	free(names);
+	free(xe);
+	return NULL;
+}
+
+static void print_row(const struct bench_cfg *cfg, const struct bench_run *run,
+		      enum bench_op op, const struct bench_stats *stats)
+{
+	struct bench_row row;
+
+	bench_row_init(&row, cfg->json);
+	bench_row_str(&row, "layout", run->layout->name);
+	bench_row_str(&row, "op", bench_op_name[op]);
+	bench_row_int(&row, "xattrs", run->count);
+	bench_row_int(&row, "value_size", run->vsize);
+	bench_row_int(&row, "batch", run->batch);
+	bench_row_int(&row, "threads", run->threads);
+	bench_row_stats(&row, stats, run->clock.elapsed[op]);
+	bench_row_int(&row, "errors", stats->errors);
+	bench_row_print(&row);
+}
+
+static int bench_run(const struct bench_cfg *cfg, struct bench_run *run)
+{
+	struct bench_thread *bt;
+	struct bench_stats *stats;
+	int rc = 0;
+	int op, i;
+
+	bt = calloc(run->threads, sizeof(*bt));
+	stats = malloc(sizeof(*stats));
+	if (bt == NULL || stats == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	bench_clock_init(&run->clock, run->threads);
+
+	for (i = 0; i < run->threads; i++) {
+		bt[i].index = i;
+		bt[i].run = run;
+		for (op = 0; op < BENCH_OP_NR; op++)
+			bench_stats_init(&bt[i].stats[op]);
+	}
+
+	rc = bench_threads_run(bt, sizeof(*bt), run->threads, bench_thread_fn);
+	bench_clock_fini(&run->clock);
+	if (rc)
+		goto out;
+
+	for (op = 0; op < BENCH_OP_NR; op++) {
+		if (!bench_op_enabled(run, op))
+			continue;
+		bench_stats_init(stats);
+		for (i = 0; i < run->threads; i++)
+			bench_stats_merge(stats, &bt[i].stats[op]);
+		print_row(cfg, run, op, stats);
+	}
+
+out:
+	free(stats);
+	free(bt);
+	return rc;
+}
+
+/* main */
+int main(int argc, char **argv)
+{
+	struct xattr_layout_params params;
+	struct bench_cfg cfg;
+	struct bench_run run;
+	int l, n, s, b, t;
+	int rc;
+
+	if (parse_args(argc, argv, &cfg) != 0) {
+		usage(basename(argv[0]));
+		return -1;
+	}
+
+	/* time in */
+	c0appz_timein();
+
+	/* c0rcfile
+	 * overwrite .cappzrc to a .[app]rc file.
+	 */
+	char str[256];
+	sprintf(str, ".%src", basename(argv[0]));
+	c0appz_setrc(str);
+	c0appz_putrc();
+
+	/* initialize resources */
+	if (c0appz_init(0) != 0) {
+		fprintf(stderr, "error! motr initialization failed.\n");
+		return -2;
+	}
+
+	rc = xattr_kvs_init();
+	if (rc != 0) {
+		fprintf(stderr, "error in fid initialization\n");
+		goto out;
+	}
+
+	params.max_vlen = bench_sweep_max(&cfg.vsize);
+	params.op_keys = cfg.op_keys;
+	params.inline_max = cfg.inline_max;
+	params.window = cfg.window;
+	params.cache_bytes = cfg.cache_bytes;
+
+	if (cfg.unlink == UNLINK_DEFER) {
+		rc = xattr_reclaim_start();
+		if (rc != 0) {
+			fprintf(stderr, "error(%d): xattr_reclaim_start\n", rc);
+			goto out;
+		}
+	}
+
+	for (l = 0; l < cfg.nr_layouts; l++) {
+		if (cfg.layout[l]->init != NULL) {
+			rc = cfg.layout[l]->init(&params);
+			if (rc != 0) {
+				fprintf(stderr, "%s: init failed: %d\n",
+					cfg.layout[l]->name, rc);
+				goto out;
+			}
+		}
+
+		for (n = 0; n < cfg.count.nr; n++)
+		for (s = 0; s < cfg.vsize.nr; s++)
+		for (b = 0; b < cfg.batch.nr; b++)
+		for (t = 0; t < cfg.threads.nr; t++) {
+			memset(&run, 0, sizeof(run));
+			run.layout = cfg.layout[l];
+			run.count = cfg.count.val[n];
+			run.vsize = cfg.vsize.val[s];
+			run.batch = cfg.batch.val[b];
+			run.threads = cfg.threads.val[t];
+			run.reps = cfg.reps;
+			run.base_ino = cfg.base_ino;
+			run.clone = cfg.clone;
+			run.unlink = cfg.unlink;
+
+			rc = bench_run(&cfg, &run);
+			if (rc != 0)
+				goto out;
+		}
+
+		if (cfg.layout[l]->fini != NULL)
+			cfg.layout[l]->fini();
+	}
+
+out:
+	if (cfg.unlink == UNLINK_DEFER)
+		xattr_reclaim_stop();
+
+	/* free resources*/
+	c0appz_free();
+
+	if (rc == 0)
+		fprintf(stderr, "%s success\n", basename(argv[0]));
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,315 @@
+/*
+ * Filename:         xattr_blob.c
+ * Description:      Binary name-sorted per-inode xattr blob
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <endian.h>
+#include "xattr_blob.h"
+
+#define NAME_MAX_LEN 255
+
+static uint32_t get_le32(const void *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return le32toh(v);
+}
+
+static void put_le32(void *p, uint32_t v)
+{
+	v = htole32(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static int name_cmp(const char *a, size_t alen, const char *b, size_t blen)
+{
+	int rc = memcmp(a, b, alen < blen ? alen : blen);
+
+	if (rc != 0)
+		return rc;
+	return (alen > blen) - (alen < blen);
+}
+
+static size_t ent_size(size_t name_len, size_t vlen)
+{
+	if (vlen == XATTR_BLOB_TOMBSTONE)
+		vlen = 0;
+	return sizeof(struct xattr_blob_ent) + name_len + vlen;
+}
+
+static bool ent_dead(const struct xattr_blob_ent *ent)
+{
+	return get_le32(&ent->vlen) == XATTR_BLOB_TOMBSTONE;
+}
+
+int xattr_blob_check(const void *blob, size_t len)
+{
+	const struct xattr_blob_hdr *hdr = blob;
+	uint32_t nr, table_off;
+
+	if (blob == NULL || len == 0)
+		return 0;
+
+	if (len < sizeof(*hdr) || get_le32(&hdr->magic) != XATTR_BLOB_MAGIC ||
+	    get_le32(&hdr->size) != len)
+		return -EINVAL;
+
+	nr = get_le32(&hdr->nr);
+	table_off = get_le32(&hdr->table_off);
+	if (table_off < sizeof(*hdr) || table_off > len ||
+	    (len - table_off) / sizeof(uint32_t) != nr)
+		return -EINVAL;
+
+	return 0;
+}
+
+int xattr_blob_count(const void *blob, size_t len)
+{
+	if (blob == NULL || len == 0)
+		return 0;
+	return get_le32(&((const struct xattr_blob_hdr *)blob)->nr);
+}
+
+/* Entry @i, bounds-checked against the entry area; NULL if corrupt. */
+static const struct xattr_blob_ent *ent_at(const void *blob, uint32_t i)
+{
+	const struct xattr_blob_hdr *hdr = blob;
+	const struct xattr_blob_ent *ent;
+	uint32_t table_off = get_le32(&hdr->table_off);
+	uint32_t off;
+
+	off = get_le32((const char *)blob + table_off + i * sizeof(uint32_t));
+	if (off < sizeof(*hdr) || off + sizeof(*ent) > table_off)
+		return NULL;
+
+	ent = (const void *)((const char *)blob + off);
+	if (off + ent_size(ent->name_len, get_le32(&ent->vlen)) > table_off)
+		return NULL;
+
+	return ent;
+}
+
+int xattr_blob_lookup(const void *blob, size_t len, const char *name,
+		      size_t name_len, const void **value, size_t *vlen)
+{
+	const struct xattr_blob_ent *ent;
+	uint32_t lo = 0;
+	uint32_t hi = xattr_blob_count(blob, len);
+	uint32_t mid;
+	int rc;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		ent = ent_at(blob, mid);
+		if (ent == NULL)
+			return -EINVAL;
+
+		rc = name_cmp(ent->name, ent->name_len, name, name_len);
+		if (rc == 0) {
+			*value = ent_dead(ent) ? NULL :
+				 ent->name + ent->name_len;
+			*vlen = ent_dead(ent) ? 0 : get_le32(&ent->vlen);
+			return 0;
+		}
+
+		if (rc < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return -ENOENT;
+}
+
+int xattr_blob_entry(const void *blob, size_t len, int i, const char **name,
+		     size_t *name_len, const void **value, size_t *vlen)
+{
+	const struct xattr_blob_ent *ent;
+
+	if (i < 0 || i >= xattr_blob_count(blob, len))
+		return -ENOENT;
+
+	ent = ent_at(blob, i);
+	if (ent == NULL)
+		return -EINVAL;
+
+	*name = ent->name;
+	*name_len = ent->name_len;
+	*value = ent_dead(ent) ? NULL : ent->name + ent->name_len;
+	*vlen = ent_dead(ent) ? 0 : get_le32(&ent->vlen);
+	return 0;
+}
+
+static int op_cmp(const void *a, const void *b)
+{
+	const struct xattr_blob_op *x = a;
+	const struct xattr_blob_op *y = b;
+
+	return name_cmp(x->name, x->name_len, y->name, y->name_len);
+}
+
+void xattr_blob_sort_ops(struct xattr_blob_op *ops, int nr)
+{
+	qsort(ops, nr, sizeof(*ops), op_cmp);
+}
+
+size_t xattr_blob_bound(size_t len, const struct xattr_blob_op *ops, int nr)
+{
+	size_t bound = len > 0 ? len : sizeof(struct xattr_blob_hdr);
+	int i;
+
+	for (i = 0; i < nr; i++)
+		bound += ent_size(ops[i].name_len,
+				  ops[i].value ? ops[i].vlen : 0) +
+			 sizeof(uint32_t);
+
+	return bound;
+}
+
+static size_t ent_write(char *out, const char *name, size_t name_len,
+			const void *value, size_t vlen)
+{
+	struct xattr_blob_ent *ent = (void *)out;
+
+	if (value == NULL)
+		vlen = XATTR_BLOB_TOMBSTONE;
+
+	ent->name_len = name_len;
+	put_le32(&ent->vlen, vlen);
+	memcpy(ent->name, name, name_len);
+	if (value != NULL)
+		memcpy(ent->name + name_len, value, vlen);
+	return ent_size(name_len, vlen);
+}
+
+/* One-pass merge behind xattr_blob_update() and xattr_blob_build().
+ * With @keep removals are written as tombstones instead of being dropped.
+ */
+static int blob_merge(const void *blob, size_t len,
+		      const struct xattr_blob_op *ops, int nr, bool keep,
+		      void *out, size_t *out_len)
+{
+	const struct xattr_blob_ent *ent = NULL;
+	struct xattr_blob_hdr *hdr = out;
+	char *buf = out;
+	char *table;
+	uint32_t old_nr = xattr_blob_count(blob, len);
+	uint32_t new_nr = 0;
+	uint32_t i = 0;
+	size_t off = sizeof(*hdr);
+	size_t bound;
+	int j = 0;
+	int rc;
+
+	rc = xattr_blob_check(blob, len);
+	if (rc)
+		return rc;
+
+	for (j = 0; j < nr; j++)
+		if (ops[j].name_len == 0 || ops[j].name_len > NAME_MAX_LEN ||
+		    ops[j].vlen >= XATTR_BLOB_TOMBSTONE)
+			return -EINVAL;
+
+	/* Offsets are collected at the tail of @out, past anything the merge
+	 * can write, and moved behind the entries at the end.
+	 */
+	bound = xattr_blob_bound(len, ops, nr);
+	table = buf + bound - (old_nr + nr) * sizeof(uint32_t);
+
+	j = 0;
+	while (i < old_nr || j < nr) {
+		if (i < old_nr && ent == NULL) {
+			ent = ent_at(blob, i);
+			if (ent == NULL)
+				return -EINVAL;
+		}
+
+		rc = i == old_nr ? 1 : j == nr ? -1 :
+		     name_cmp(ent->name, ent->name_len,
+			      ops[j].name, ops[j].name_len);
+
+		if (rc < 0) {
+			if (!ent_dead(ent)) {
+				put_le32(table + new_nr++ * sizeof(uint32_t),
+					 off);
+				off += ent_write(buf + off, ent->name,
+						 ent->name_len,
+						 ent->name + ent->name_len,
+						 get_le32(&ent->vlen));
+			}
+			i++;
+			ent = NULL;
+			continue;
+		}
+
+		if (ops[j].value != NULL || keep) {
+			put_le32(table + new_nr++ * sizeof(uint32_t), off);
+			off += ent_write(buf + off, ops[j].name,
+					 ops[j].name_len, ops[j].value,
+					 ops[j].vlen);
+		}
+
+		if (rc == 0) {
+			i++;
+			ent = NULL;
+		}
+		j++;
+	}
+
+	if (new_nr == 0) {
+		*out_len = 0;
+		return 0;
+	}
+
+	memmove(buf + off, table, new_nr * sizeof(uint32_t));
+	put_le32(&hdr->magic, XATTR_BLOB_MAGIC);
+	put_le32(&hdr->nr, new_nr);
+	put_le32(&hdr->table_off, off);
+	off += new_nr * sizeof(uint32_t);
+	put_le32(&hdr->size, off);
+
+	*out_len = off;
+	return 0;
+}
+
+int xattr_blob_update(const void *blob, size_t len,
+		      const struct xattr_blob_op *ops, int nr,
+		      void *out, size_t *out_len)
+{
+	return blob_merge(blob, len, ops, nr, false, out, out_len);
+}
+
+int xattr_blob_build(const struct xattr_blob_op *ops, int nr,
+		     void *out, size_t *out_len)
+{
+	return blob_merge(NULL, 0, ops, nr, true, out, out_len);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,102 @@
+/*
+ * Filename:         xattr_blob.h
+ * Description:      Binary name-sorted per-inode xattr blob
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _XATTR_BLOB_H
+#define _XATTR_BLOB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Blob layout (little-endian):
+ *   header   {magic, nr, table_off, size}
+ *   entries  {u8 name_len, u32 vlen, name, value}, ascending by name
+ *   table    u32 offset of every entry, in the same order
+ * The table sits after the entries so a blob can be produced in one
+ * sequential pass; lookups binary search the table and compare names in
+ * place, without decoding the rest of the blob or allocating.
+ * A NULL or zero length blob is a valid empty blob.
+ *
+ * Delta blobs built by xattr_blob_build() also record removals, as
+ * tombstone entries with vlen XATTR_BLOB_TOMBSTONE and no value bytes.
+ */
+#define XATTR_BLOB_MAGIC	0x31425841	/* "AXB1" */
+#define XATTR_BLOB_TOMBSTONE	UINT32_MAX
+
+struct xattr_blob_hdr {
+	uint32_t magic;
+	uint32_t nr;
+	uint32_t table_off;
+	uint32_t size;
+} __attribute((packed));
+
+struct xattr_blob_ent {
+	uint8_t name_len;
+	uint32_t vlen;
+	char name[];
+} __attribute((packed));
+
+/* One change applied by xattr_blob_update(): a NULL @value removes @name. */
+struct xattr_blob_op {
+	const char *name;
+	size_t name_len;
+	const void *value;
+	size_t vlen;
+};
+
+/* Checks the header and table bounds of a blob fetched from the index. */
+int xattr_blob_check(const void *blob, size_t len);
+
+int xattr_blob_count(const void *blob, size_t len);
+
+/* Finds @name and returns a pointer to its value inside @blob. A tombstone
+ * is found with a NULL @value.
+ */
+int xattr_blob_lookup(const void *blob, size_t len, const char *name,
+		      size_t name_len, const void **value, size_t *vlen);
+
+/* Returns entry @i in name order, for listing; NULL @value for a tombstone. */
+int xattr_blob_entry(const void *blob, size_t len, int i, const char **name,
+		     size_t *name_len, const void **value, size_t *vlen);
+
+/* Sorts @ops by name as required by xattr_blob_update(). Names must be
+ * unique within one call.
+ */
+void xattr_blob_sort_ops(struct xattr_blob_op *ops, int nr);
+
+/* Upper bound of the size of the blob produced by applying @ops to a blob
+ * of @len bytes.
+ */
+size_t xattr_blob_bound(size_t len, const struct xattr_blob_op *ops, int nr);
+
+/* Merges the sorted @ops into @blob and writes the result to @out, which
+ * must hold xattr_blob_bound() bytes. Removing a missing name is not an
+ * error, and tombstones in @blob are dropped. On return @out_len is 0 if
+ * no entries remain.
+ */
+int xattr_blob_update(const void *blob, size_t len,
+		      const struct xattr_blob_op *ops, int nr,
+		      void *out, size_t *out_len);
+
+/* Builds a delta blob from the sorted @ops, keeping removals as
+ * tombstones. @out must hold xattr_blob_bound(0, ops, nr) bytes.
+ */
+int xattr_blob_build(const struct xattr_blob_op *ops, int nr,
+		     void *out, size_t *out_len);
+
+#endif /* _XATTR_BLOB_H */
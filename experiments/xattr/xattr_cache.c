@@ -0,0 +1,364 @@
+/*
+ * Filename:         xattr_cache.c
+ * Description:      Bounded in-memory xattr cache with negative entries
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <pthread.h>
+#include "xattr_cache.h"
+
+#define XC_BUCKETS	4096
+
+enum xc_kind {
+	XC_VALUE,
+	XC_ABSENT,
+	/* Number of xattrs of the inode, kept in vlen */
+	XC_LIST,
+};
+
+struct xc_entry {
+	struct xc_entry *hnext;
+	struct xc_entry *prev;
+	struct xc_entry *next;
+	uint64_t ino;
+	uint32_t hash;
+	uint8_t kind;
+	uint8_t name_len;
+	size_t vlen;
+	/* name, then value */
+	char data[];
+};
+
+struct xc_shard {
+	pthread_mutex_t lock;
+	uint64_t gen;
+	struct xc_entry *bucket[XC_BUCKETS];
+	/* LRU list, most recently used first */
+	struct xc_entry *head;
+	struct xc_entry *tail;
+	size_t bytes;
+	size_t limit;
+};
+
+static struct xc_shard *shards;
+static uint64_t xc_hits;
+static uint64_t xc_misses;
+
+static uint32_t xc_hash(uint64_t ino, enum xc_kind kind, const char *name,
+			size_t len)
+{
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < sizeof(ino); i++)
+		h = (h ^ (uint8_t)(ino >> (i * 8))) * 16777619u;
+	h = (h ^ (kind == XC_LIST)) * 16777619u;
+	for (i = 0; i < len; i++)
+		h = (h ^ (uint8_t)name[i]) * 16777619u;
+
+	return h;
+}
+
+static struct xc_shard *shard_of(uint64_t ino)
+{
+	return &shards[((ino * 0x9E3779B97F4A7C15ULL) >> 32) %
+		       XATTR_CACHE_SHARDS];
+}
+
+static size_t entry_size(const struct xc_entry *e)
+{
+	return sizeof(*e) + e->name_len + (e->kind == XC_VALUE ? e->vlen : 0);
+}
+
+static struct xc_entry *entry_find(struct xc_shard *sh, uint64_t ino,
+				   enum xc_kind kind, const char *name,
+				   size_t len, uint32_t hash)
+{
+	struct xc_entry *e;
+
+	for (e = sh->bucket[hash % XC_BUCKETS]; e != NULL; e = e->hnext) {
+		if (e->hash != hash || e->ino != ino)
+			continue;
+		if ((kind == XC_LIST) != (e->kind == XC_LIST))
+			continue;
+		if (e->name_len == len &&
+		    (len == 0 || memcmp(e->data, name, len) == 0))
+			return e;
+	}
+
+	return NULL;
+}
+
+static void lru_unlink(struct xc_shard *sh, struct xc_entry *e)
+{
+	if (e->prev != NULL)
+		e->prev->next = e->next;
+	else
+		sh->head = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+	else
+		sh->tail = e->prev;
+}
+
+static void lru_push(struct xc_shard *sh, struct xc_entry *e)
+{
+	e->prev = NULL;
+	e->next = sh->head;
+	if (sh->head != NULL)
+		sh->head->prev = e;
+	else
+		sh->tail = e;
+	sh->head = e;
+}
+
+static void entry_remove(struct xc_shard *sh, struct xc_entry *e)
+{
+	struct xc_entry **p = &sh->bucket[e->hash % XC_BUCKETS];
+
+	while (*p != e)
+		p = &(*p)->hnext;
+	*p = e->hnext;
+
+	lru_unlink(sh, e);
+	sh->bytes -= entry_size(e);
+	free(e);
+}
+
+static void entry_drop(struct xc_shard *sh, uint64_t ino, enum xc_kind kind,
+		       const char *name, size_t len)
+{
+	struct xc_entry *e;
+
+	e = entry_find(sh, ino, kind, name, len,
+		       xc_hash(ino, kind, name, len));
+	if (e != NULL)
+		entry_remove(sh, e);
+}
+
+/* Looks up an entry and moves it to the front of the LRU list. */
+static struct xc_entry *entry_get(struct xc_shard *sh, uint64_t ino,
+				  enum xc_kind kind, const char *name,
+				  size_t len)
+{
+	struct xc_entry *e;
+
+	e = entry_find(sh, ino, kind, name, len,
+		       xc_hash(ino, kind, name, len));
+	if (e == NULL) {
+		__atomic_add_fetch(&xc_misses, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	__atomic_add_fetch(&xc_hits, 1, __ATOMIC_RELAXED);
+	lru_unlink(sh, e);
+	lru_push(sh, e);
+	return e;
+}
+
+static void entry_put(uint64_t ino, enum xc_kind kind, const char *name,
+		      size_t len, const void *value, size_t vlen,
+		      uint64_t gen)
+{
+	struct xc_shard *sh = shard_of(ino);
+	struct xc_entry *e;
+	size_t size;
+
+	size = sizeof(*e) + len + (kind == XC_VALUE ? vlen : 0);
+	/* Do not let a single large value flush a whole shard */
+	if (len > UINT8_MAX || size > sh->limit / 8)
+		return;
+
+	e = malloc(size);
+	if (e == NULL)
+		return;
+
+	e->ino = ino;
+	e->kind = kind;
+	e->name_len = len;
+	e->vlen = vlen;
+	e->hash = xc_hash(ino, kind, name, len);
+	if (len > 0)
+		memcpy(e->data, name, len);
+	if (kind == XC_VALUE)
+		memcpy(e->data + len, value, vlen);
+
+	pthread_mutex_lock(&sh->lock);
+	if (gen != sh->gen) {
+		/* Invalidated since the caller missed */
+		pthread_mutex_unlock(&sh->lock);
+		free(e);
+		return;
+	}
+
+	entry_drop(sh, ino, kind, name, len);
+
+	e->hnext = sh->bucket[e->hash % XC_BUCKETS];
+	sh->bucket[e->hash % XC_BUCKETS] = e;
+	lru_push(sh, e);
+	sh->bytes += size;
+
+	while (sh->bytes > sh->limit)
+		entry_remove(sh, sh->tail);
+	pthread_mutex_unlock(&sh->lock);
+}
+
+int xattr_cache_init(size_t max_bytes)
+{
+	int i;
+
+	if (max_bytes == 0)
+		max_bytes = XATTR_CACHE_BYTES;
+
+	shards = calloc(XATTR_CACHE_SHARDS, sizeof(*shards));
+	if (shards == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < XATTR_CACHE_SHARDS; i++) {
+		pthread_mutex_init(&shards[i].lock, NULL);
+		shards[i].limit = max_bytes / XATTR_CACHE_SHARDS;
+	}
+
+	xc_hits = 0;
+	xc_misses = 0;
+	return 0;
+}
+
+void xattr_cache_fini(void)
+{
+	int i;
+
+	if (shards == NULL)
+		return;
+
+	for (i = 0; i < XATTR_CACHE_SHARDS; i++) {
+		while (shards[i].head != NULL)
+			entry_remove(&shards[i], shards[i].head);
+		pthread_mutex_destroy(&shards[i].lock);
+	}
+
+	free(shards);
+	shards = NULL;
+}
+
+int xattr_cache_get(uint64_t ino, const char *name, void *value,
+		    size_t *vlen, uint64_t *gen)
+{
+	struct xc_shard *sh = shard_of(ino);
+	struct xc_entry *e;
+	int rc;
+
+	pthread_mutex_lock(&sh->lock);
+	*gen = sh->gen;
+
+	e = entry_get(sh, ino, XC_VALUE, name, strlen(name));
+	if (e == NULL)
+		rc = -EAGAIN;
+	else if (e->kind == XC_ABSENT)
+		rc = -ENOENT;
+	else if (e->vlen > *vlen)
+		rc = -ERANGE;
+	else {
+		memcpy(value, e->data + e->name_len, e->vlen);
+		*vlen = e->vlen;
+		rc = 0;
+	}
+	pthread_mutex_unlock(&sh->lock);
+
+	return rc;
+}
+
+void xattr_cache_put(uint64_t ino, const char *name, const void *value,
+		     size_t vlen, uint64_t gen)
+{
+	entry_put(ino, value != NULL ? XC_VALUE : XC_ABSENT, name,
+		  strlen(name), value, value != NULL ? vlen : 0, gen);
+}
+
+int xattr_cache_list_get(uint64_t ino, int *nr, uint64_t *gen)
+{
+	struct xc_shard *sh = shard_of(ino);
+	struct xc_entry *e;
+	int rc = -EAGAIN;
+
+	pthread_mutex_lock(&sh->lock);
+	*gen = sh->gen;
+
+	e = entry_get(sh, ino, XC_LIST, NULL, 0);
+	if (e != NULL) {
+		*nr = e->vlen;
+		rc = 0;
+	}
+	pthread_mutex_unlock(&sh->lock);
+
+	return rc;
+}
+
+void xattr_cache_list_put(uint64_t ino, int nr, uint64_t gen)
+{
+	entry_put(ino, XC_LIST, NULL, 0, NULL, nr, gen);
+}
+
+void xattr_cache_invalidate(uint64_t ino, const char *name)
+{
+	struct xc_shard *sh = shard_of(ino);
+	size_t len = strlen(name);
+
+	pthread_mutex_lock(&sh->lock);
+	sh->gen++;
+	entry_drop(sh, ino, XC_VALUE, name, len);
+	entry_drop(sh, ino, XC_LIST, NULL, 0);
+	pthread_mutex_unlock(&sh->lock);
+}
+
+/* Walks the whole shard; inode-wide invalidation is rare (unlink, bulk
+ * changes) compared to lookups.
+ */
+void xattr_cache_invalidate_ino(uint64_t ino)
+{
+	struct xc_shard *sh = shard_of(ino);
+	struct xc_entry *e;
+	struct xc_entry *next;
+
+	pthread_mutex_lock(&sh->lock);
+	sh->gen++;
+	for (e = sh->head; e != NULL; e = next) {
+		next = e->next;
+		if (e->ino == ino)
+			entry_remove(sh, e);
+	}
+	pthread_mutex_unlock(&sh->lock);
+}
+
+void xattr_cache_stats(uint64_t *hits, uint64_t *misses)
+{
+	*hits = __atomic_load_n(&xc_hits, __ATOMIC_RELAXED);
+	*misses = __atomic_load_n(&xc_misses, __ATOMIC_RELAXED);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,70 @@
+/*
+ * Filename:         xattr_cache.h
+ * Description:      Bounded in-memory xattr cache with negative entries
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _XATTR_CACHE_H
+#define _XATTR_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Caches getxattr results by (ino, name), including "no such xattr", and
+ * the listxattr count of an inode. All entries of an inode live in the
+ * same shard, chosen by inode number; each shard has its own lock, LRU
+ * list and share of the byte budget.
+ *
+ * A lookup miss returns the generation of the shard. Every invalidation
+ * bumps it, and an insert carrying an older generation is dropped, so a
+ * value read from the index before a concurrent set or remove can never
+ * be cached after that change was invalidated.
+ *
+ * Only changes made through this process are seen; there is no
+ * invalidation from other nodes.
+ */
+
+#define XATTR_CACHE_SHARDS	64
+#define XATTR_CACHE_BYTES	(64 << 20)
+
+/* @max_bytes of 0 selects XATTR_CACHE_BYTES. */
+int xattr_cache_init(size_t max_bytes);
+void xattr_cache_fini(void);
+
+/* Returns 0 with the value for a cached xattr, -ENOENT for a cached
+ * absent one, -ERANGE if the value is larger than @vlen, or -EAGAIN on a
+ * miss. @gen is set in every case, for a following xattr_cache_put().
+ */
+int xattr_cache_get(uint64_t ino, const char *name, void *value,
+		    size_t *vlen, uint64_t *gen);
+
+/* Caches @value, or an absent xattr when @value is NULL. */
+void xattr_cache_put(uint64_t ino, const char *name, const void *value,
+		     size_t vlen, uint64_t gen);
+
+/* Same for the number of xattrs of @ino; -EAGAIN on a miss. */
+int xattr_cache_list_get(uint64_t ino, int *nr, uint64_t *gen);
+void xattr_cache_list_put(uint64_t ino, int nr, uint64_t gen);
+
+/* Drops @name and the xattr count of @ino. */
+void xattr_cache_invalidate(uint64_t ino, const char *name);
+
+/* Drops everything cached for @ino. */
+void xattr_cache_invalidate_ino(uint64_t ino);
+
+void xattr_cache_stats(uint64_t *hits, uint64_t *misses);
+
+#endif /* _XATTR_CACHE_H */
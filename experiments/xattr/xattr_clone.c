@@ -0,0 +1,270 @@
+/*
+ * Filename:         xattr_clone.c
+ * Description:      Bulk copy of all xattr records between inodes
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <endian.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "xattr_kvs.h"
+#include "xattr_kvs_async.h"
+#include "xattr_clone.h"
+
+/* One PUT op worth of records copied out of the scan. Keys and values
+ * are packed in the arena, which the bufvecs point into.
+ */
+struct put_slot {
+	struct xattr_kvs_aop aop;
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	char *arena;
+	size_t arena_cap;
+};
+
+/* A record returned by the scan which did not fit in the previous slot.
+ * It stays valid until the next xattr_kvs_iter_next().
+ */
+struct clone_scan {
+	struct xattr_kvs_iter it;
+	uint64_t dst;
+	bool pending;
+	const void *key;
+	const void *val;
+	size_t klen;
+	size_t vlen;
+};
+
+static int slot_init(struct put_slot *slot)
+{
+	memset(slot, 0, sizeof(*slot));
+	M0_ALLOC_ARR(slot->key.ov_buf, XATTR_CLONE_BATCH);
+	M0_ALLOC_ARR(slot->key.ov_vec.v_count, XATTR_CLONE_BATCH);
+	M0_ALLOC_ARR(slot->val.ov_buf, XATTR_CLONE_BATCH);
+	M0_ALLOC_ARR(slot->val.ov_vec.v_count, XATTR_CLONE_BATCH);
+	slot->arena = m0_alloc(XATTR_CLONE_BYTES);
+	slot->arena_cap = XATTR_CLONE_BYTES;
+
+	if (slot->key.ov_buf == NULL || slot->key.ov_vec.v_count == NULL ||
+	    slot->val.ov_buf == NULL || slot->val.ov_vec.v_count == NULL ||
+	    slot->arena == NULL)
+		return -ENOMEM;
+
+	slot->aop.opcode = M0_IC_PUT;
+	slot->aop.key = &slot->key;
+	slot->aop.val = &slot->val;
+	slot->aop.flags = M0_OIF_OVERWRITE;
+	slot->aop.datum = slot;
+	return 0;
+}
+
+/* The bufvecs only point into the arena: free the arrays, not the
+ * buffers.
+ */
+static void slot_fini(struct put_slot *slot)
+{
+	xattr_kvs_aop_fini(&slot->aop);
+	m0_free(slot->key.ov_buf);
+	m0_free(slot->key.ov_vec.v_count);
+	m0_free(slot->val.ov_buf);
+	m0_free(slot->val.ov_vec.v_count);
+	m0_free(slot->arena);
+}
+
+/* Copies up to XATTR_CLONE_BATCH records from the scan into @slot, as many
+ * as fit in its arena, and rewrites their inode number. A record larger
+ * than the arena gets a slot of its own.
+ */
+static int slot_fill(struct put_slot *slot, struct clone_scan *cs,
+		     uint32_t *nr)
+{
+	size_t used = 0;
+	size_t need;
+	char *buf;
+	int rc = 0;
+
+	*nr = 0;
+	while (*nr < XATTR_CLONE_BATCH) {
+		if (!cs->pending) {
+			rc = xattr_kvs_iter_next(&cs->it, &cs->key, &cs->klen,
+						 &cs->val, &cs->vlen);
+			if (rc <= 0)
+				break;
+			cs->pending = true;
+		}
+
+		if (cs->klen < XATTR_PREFIX_LEN || cs->klen > XATTR_KEY_MAX)
+			return -EINVAL;
+
+		need = cs->klen + cs->vlen;
+		if (used + need > slot->arena_cap) {
+			if (*nr > 0)
+				break;
+
+			buf = m0_alloc(need);
+			if (buf == NULL)
+				return -ENOMEM;
+			m0_free(slot->arena);
+			slot->arena = buf;
+			slot->arena_cap = need;
+		}
+
+		buf = slot->arena + used;
+		memcpy(buf, cs->key, cs->klen);
+		/* The inode number leads the key */
+		memcpy(buf, &cs->dst, sizeof(cs->dst));
+		slot->key.ov_buf[*nr] = buf;
+		slot->key.ov_vec.v_count[*nr] = cs->klen;
+
+		buf += cs->klen;
+		memcpy(buf, cs->val, cs->vlen);
+		slot->val.ov_buf[*nr] = buf;
+		slot->val.ov_vec.v_count[*nr] = cs->vlen;
+
+		used += need;
+		cs->pending = false;
+		(*nr)++;
+	}
+
+	return rc < 0 ? rc : 0;
+}
+
+/* Copies all records under one {ino, type} prefix of the source and waits
+ * until they are all written.
+ */
+static int clone_prefix(const struct cortxfs_xattr *prefix, uint64_t dst_ino,
+			int *nr)
+{
+	struct put_slot slots[XATTR_CLONE_WINDOW];
+	struct put_slot *free_slot[XATTR_CLONE_WINDOW];
+	struct xattr_kvs_async engine;
+	struct xattr_kvs_aop *aop;
+	struct put_slot *slot;
+	struct clone_scan cs;
+	int nfree = 0;
+	uint32_t cnt;
+	int rc, rc2, i;
+
+	for (i = 0; i < XATTR_CLONE_WINDOW; i++) {
+		rc = slot_init(&slots[i]);
+		if (rc) {
+			/* slot_init() leaves the failed slot safe to free */
+			i++;
+			goto free_slots;
+		}
+		free_slot[nfree++] = &slots[i];
+	}
+
+	rc = xattr_kvs_async_init(&engine, XATTR_CLONE_WINDOW);
+	if (rc)
+		goto free_slots;
+
+	memset(&cs, 0, sizeof(cs));
+	cs.dst = htobe64(dst_ino);
+	rc = xattr_kvs_iter_init(&cs.it, prefix, XATTR_PREFIX_LEN);
+	if (rc)
+		goto fini_engine;
+
+	for (;;) {
+		/* Reuse the slot of the oldest PUT once all are in flight */
+		if (nfree == 0) {
+			aop = xattr_kvs_async_wait(&engine);
+			rc = aop->rc;
+			if (rc)
+				break;
+			free_slot[nfree++] = aop->datum;
+		}
+
+		slot = free_slot[--nfree];
+		rc = slot_fill(slot, &cs, &cnt);
+		if (rc || cnt == 0)
+			break;
+
+		slot->key.ov_vec.v_nr = cnt;
+		slot->val.ov_vec.v_nr = cnt;
+		rc = xattr_kvs_async_submit(&engine, &slot->aop, true);
+		if (rc)
+			break;
+		*nr += cnt;
+	}
+
+	while ((aop = xattr_kvs_async_wait(&engine)) != NULL) {
+		rc2 = aop->rc;
+		if (rc == 0)
+			rc = rc2;
+	}
+
+	xattr_kvs_iter_fini(&cs.it);
+fini_engine:
+	xattr_kvs_async_fini(&engine);
+free_slots:
+	while (i-- > 0)
+		slot_fini(&slots[i]);
+
+	return rc;
+}
+
+int xattr_clone(uint64_t src_ino, uint64_t dst_ino, int *nr)
+{
+	/* Spilled values before the hybrid records that refer to them */
+	static const char types[] = {
+		XATTR_TYPE,
+		XATTR_DELTA_TYPE,
+		XATTR_BLOB_TYPE,
+		XATTR_INLINE_TYPE,
+	};
+	struct cortxfs_xattr prefix;
+	int copied = 0;
+	size_t i;
+	int rc;
+
+	if (src_ino == dst_ino)
+		return -EINVAL;
+
+	for (i = 0; i < sizeof(types); i++) {
+		xattr_key_init(&prefix, src_ino, NULL);
+		prefix.type = types[i];
+
+		rc = clone_prefix(&prefix, dst_ino, &copied);
+		if (rc) {
+			fprintf(stderr, "error(%d): clone of %llu to %llu\n",
+				rc, (unsigned long long)src_ino,
+				(unsigned long long)dst_ino);
+			return rc;
+		}
+	}
+
+	if (nr != NULL)
+		*nr = copied;
+	return 0;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
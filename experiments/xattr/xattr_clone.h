@@ -0,0 +1,45 @@
+/*
+ * Filename:         xattr_clone.h
+ * Description:      Bulk copy of all xattr records between inodes
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _XATTR_CLONE_H
+#define _XATTR_CLONE_H
+
+#include <stdint.h>
+
+/* Records per PUT op, PUT ops in flight and value bytes buffered per op */
+#define XATTR_CLONE_BATCH	128
+#define XATTR_CLONE_WINDOW	4
+#define XATTR_CLONE_BYTES	(256 * 1024)
+
+/* Copies every xattr record of @src_ino to @dst_ino, whatever layout wrote
+ * them. The source keys are streamed with xattr_kvs_iter, the inode number
+ * is rewritten in place in each copied key and the records are written
+ * with batched PUTs, up to XATTR_CLONE_WINDOW of them in flight while the
+ * scan goes on. Values are stored as they are; none of the layouts embeds
+ * the inode number in a value.
+ *
+ * Per-xattr keys are copied before the hybrid records which may refer to
+ * them. Existing records of @dst_ino with the same names are overwritten,
+ * others are left alone, so @dst_ino should have no xattrs. Concurrent
+ * changes to @src_ino may or may not be part of the copy.
+ * @nr, if not NULL, returns the number of records copied.
+ */
+int xattr_clone(uint64_t src_ino, uint64_t dst_ino, int *nr);
+
+#endif /* _XATTR_CLONE_H */
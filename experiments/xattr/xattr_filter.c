@@ -0,0 +1,395 @@
+/*
+ * Filename:         xattr_filter.c
+ * Description:      Per-inode Bloom filter over xattr names
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <pthread.h>
+#include "xattr_kvs.h"
+#include "xattr_filter.h"
+
+#define XF_LOCKS	64
+
+struct xf_filter {
+	uint64_t ino;
+	uint32_t nbits;
+	/* Names the filter was sized for */
+	uint32_t cap;
+	/* Names added and removed since the build */
+	uint32_t adds;
+	uint32_t removes;
+	uint64_t bits[];
+};
+
+/* Negative GETs of an inode without a filter, see xattr_filter_miss() */
+struct xf_miss {
+	uint64_t ino;
+	uint32_t nr;
+};
+
+/* Slots are striped over the locks. The generation of a slot is bumped by
+ * every change to it, under the lock of its stripe, and its pending count
+ * is the number of adds whose names may not have reached the index yet.
+ * Its misses count towards the build of a filter.
+ */
+static struct xf_filter **slots;
+static uint64_t *slot_gen;
+static uint32_t *slot_pending;
+static struct xf_miss *slot_miss;
+static pthread_mutex_t locks[XF_LOCKS];
+static uint64_t xf_negatives;
+static uint64_t xf_builds;
+
+static uint64_t name_hash(const char *name, size_t len)
+{
+	uint64_t h = 14695981039346656037ULL;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ (uint8_t)name[i]) * 1099511628211ULL;
+
+	return h;
+}
+
+static uint32_t slot_of(uint64_t ino)
+{
+	return ((ino * 0x9E3779B97F4A7C15ULL) >> 32) % XATTR_FILTER_SLOTS;
+}
+
+static pthread_mutex_t *lock_of(uint32_t slot)
+{
+	return &locks[slot % XF_LOCKS];
+}
+
+/* Double hashing: bit i is h1 + i * h2. */
+static void filter_set(struct xf_filter *f, uint64_t h)
+{
+	uint32_t h1 = h;
+	uint32_t h2 = (h >> 32) | 1;
+	uint32_t bit;
+	int i;
+
+	for (i = 0; i < XATTR_FILTER_HASHES; i++) {
+		bit = (h1 + i * h2) % f->nbits;
+		f->bits[bit / 64] |= 1ULL << (bit % 64);
+	}
+}
+
+static bool filter_test(const struct xf_filter *f, uint64_t h)
+{
+	uint32_t h1 = h;
+	uint32_t h2 = (h >> 32) | 1;
+	uint32_t bit;
+	int i;
+
+	for (i = 0; i < XATTR_FILTER_HASHES; i++) {
+		bit = (h1 + i * h2) % f->nbits;
+		if (!(f->bits[bit / 64] & (1ULL << (bit % 64))))
+			return false;
+	}
+
+	return true;
+}
+
+static bool filter_worn(const struct xf_filter *f)
+{
+	return f->adds > f->cap / 2 || f->removes > f->cap / 2;
+}
+
+struct xf_build {
+	uint64_t *hash;
+	int nr;
+	int cap;
+	int rc;
+};
+
+static bool build_cb(void *arg, const void *key, size_t klen,
+		     const void *val, size_t vlen)
+{
+	const struct cortxfs_xattr *xkey = key;
+	struct xf_build *b = arg;
+	uint64_t *hash;
+
+	(void)val;
+	(void)vlen;
+	if (klen < sizeof(*xkey) || klen != xattr_key_len(xkey)) {
+		b->rc = -EINVAL;
+		return false;
+	}
+
+	if (b->nr == b->cap) {
+		b->cap = b->cap ? b->cap * 2 : XATTR_FILTER_MIN_KEYS;
+		hash = realloc(b->hash, b->cap * sizeof(*hash));
+		if (hash == NULL) {
+			b->rc = -ENOMEM;
+			return false;
+		}
+		b->hash = hash;
+	}
+
+	b->hash[b->nr++] = name_hash(xkey->name, xkey->name_len);
+	return true;
+}
+
+/* Scans the names of @ino and installs a filter for them, unless the slot
+ * changed meanwhile or an add to it is still in flight, as the scan may
+ * have missed its name.
+ */
+static int filter_build(uint64_t ino)
+{
+	uint32_t slot = slot_of(ino);
+	pthread_mutex_t *lk = lock_of(slot);
+	char buf[XATTR_KEY_MAX];
+	struct xf_build b = { 0 };
+	struct xf_filter *f;
+	uint64_t gen;
+	uint32_t cap, nbits;
+	int rc, i;
+
+	pthread_mutex_lock(lk);
+	gen = slot_gen[slot];
+	pthread_mutex_unlock(lk);
+
+	rc = xattr_key_init((struct cortxfs_xattr *)buf, ino, NULL);
+	rc = xattr_kvs_scan(buf, rc, build_cb, &b);
+	if (rc == 0)
+		rc = b.rc;
+	if (rc)
+		goto out;
+
+	/* Leave room for names set after the build */
+	cap = b.nr * 2 > XATTR_FILTER_MIN_KEYS ? b.nr * 2 :
+						 XATTR_FILTER_MIN_KEYS;
+	nbits = (cap * XATTR_FILTER_BITS_PER_KEY + 63) / 64 * 64;
+
+	f = calloc(1, sizeof(*f) + nbits / 8);
+	if (f == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	f->ino = ino;
+	f->nbits = nbits;
+	f->cap = cap;
+	for (i = 0; i < b.nr; i++)
+		filter_set(f, b.hash[i]);
+
+	pthread_mutex_lock(lk);
+	if (gen == slot_gen[slot] && slot_pending[slot] == 0) {
+		free(slots[slot]);
+		slots[slot] = f;
+		f = NULL;
+		__atomic_add_fetch(&xf_builds, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(lk);
+
+	free(f);
+out:
+	free(b.hash);
+	return rc;
+}
+
+int xattr_filter_init(void)
+{
+	int i;
+
+	slots = calloc(XATTR_FILTER_SLOTS, sizeof(*slots));
+	slot_gen = calloc(XATTR_FILTER_SLOTS, sizeof(*slot_gen));
+	slot_pending = calloc(XATTR_FILTER_SLOTS, sizeof(*slot_pending));
+	slot_miss = calloc(XATTR_FILTER_SLOTS, sizeof(*slot_miss));
+	if (slots == NULL || slot_gen == NULL || slot_pending == NULL ||
+	    slot_miss == NULL) {
+		free(slots);
+		free(slot_gen);
+		free(slot_pending);
+		free(slot_miss);
+		slots = NULL;
+		slot_gen = NULL;
+		slot_pending = NULL;
+		slot_miss = NULL;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < XF_LOCKS; i++)
+		pthread_mutex_init(&locks[i], NULL);
+
+	xf_negatives = 0;
+	xf_builds = 0;
+	return 0;
+}
+
+void xattr_filter_fini(void)
+{
+	int i;
+
+	if (slots == NULL)
+		return;
+
+	for (i = 0; i < XATTR_FILTER_SLOTS; i++)
+		free(slots[i]);
+	for (i = 0; i < XF_LOCKS; i++)
+		pthread_mutex_destroy(&locks[i]);
+
+	free(slot_miss);
+	free(slot_pending);
+	free(slot_gen);
+	free(slots);
+	slot_miss = NULL;
+	slot_pending = NULL;
+	slot_gen = NULL;
+	slots = NULL;
+}
+
+int xattr_filter_check(uint64_t ino, const char *name)
+{
+	uint32_t slot = slot_of(ino);
+	pthread_mutex_t *lk = lock_of(slot);
+	uint64_t h = name_hash(name, strlen(name));
+	struct xf_filter *f;
+	bool build = false;
+	int rc = 0;
+	int pass;
+
+	/* The scan of a build is paid for by the misses it saves, so it
+	 * only runs after XATTR_FILTER_BUILD_MISSES of them, once, whether
+	 * or not its filter gets installed.
+	 */
+	for (pass = 0; pass < 2; pass++) {
+		pthread_mutex_lock(lk);
+		f = slots[slot];
+		if (f != NULL && f->ino == ino) {
+			if (!filter_test(f, h))
+				rc = -ENOENT;
+			pthread_mutex_unlock(lk);
+			break;
+		}
+		if (pass == 0 && slot_miss[slot].ino == ino &&
+		    slot_miss[slot].nr >= XATTR_FILTER_BUILD_MISSES) {
+			slot_miss[slot].nr = 0;
+			build = true;
+		}
+		pthread_mutex_unlock(lk);
+
+		if (!build || filter_build(ino) != 0)
+			break;
+	}
+
+	if (rc == -ENOENT)
+		__atomic_add_fetch(&xf_negatives, 1, __ATOMIC_RELAXED);
+	return rc;
+}
+
+void xattr_filter_miss(uint64_t ino)
+{
+	uint32_t slot = slot_of(ino);
+	pthread_mutex_t *lk = lock_of(slot);
+
+	pthread_mutex_lock(lk);
+	if (slot_miss[slot].ino != ino) {
+		slot_miss[slot].ino = ino;
+		slot_miss[slot].nr = 0;
+	}
+	slot_miss[slot].nr++;
+	pthread_mutex_unlock(lk);
+}
+
+void xattr_filter_add(uint64_t ino, const char *name)
+{
+	uint32_t slot = slot_of(ino);
+	pthread_mutex_t *lk = lock_of(slot);
+	struct xf_filter *f;
+
+	pthread_mutex_lock(lk);
+	slot_gen[slot]++;
+	slot_pending[slot]++;
+	f = slots[slot];
+	if (f != NULL && f->ino == ino) {
+		filter_set(f, name_hash(name, strlen(name)));
+		f->adds++;
+		if (filter_worn(f)) {
+			free(f);
+			slots[slot] = NULL;
+		}
+	}
+	pthread_mutex_unlock(lk);
+}
+
+void xattr_filter_added(uint64_t ino)
+{
+	uint32_t slot = slot_of(ino);
+	pthread_mutex_t *lk = lock_of(slot);
+
+	pthread_mutex_lock(lk);
+	slot_gen[slot]++;
+	slot_pending[slot]--;
+	pthread_mutex_unlock(lk);
+}
+
+void xattr_filter_remove(uint64_t ino, const char *name)
+{
+	uint32_t slot = slot_of(ino);
+	pthread_mutex_t *lk = lock_of(slot);
+	struct xf_filter *f;
+
+	/* A Bloom filter cannot forget @name */
+	(void)name;
+	pthread_mutex_lock(lk);
+	slot_gen[slot]++;
+	f = slots[slot];
+	if (f != NULL && f->ino == ino) {
+		f->removes++;
+		if (filter_worn(f)) {
+			free(f);
+			slots[slot] = NULL;
+		}
+	}
+	pthread_mutex_unlock(lk);
+}
+
+void xattr_filter_drop(uint64_t ino)
+{
+	uint32_t slot = slot_of(ino);
+	pthread_mutex_t *lk = lock_of(slot);
+
+	pthread_mutex_lock(lk);
+	slot_gen[slot]++;
+	if (slots[slot] != NULL && slots[slot]->ino == ino) {
+		free(slots[slot]);
+		slots[slot] = NULL;
+	}
+	pthread_mutex_unlock(lk);
+}
+
+void xattr_filter_stats(uint64_t *negatives, uint64_t *builds)
+{
+	*negatives = __atomic_load_n(&xf_negatives, __ATOMIC_RELAXED);
+	*builds = __atomic_load_n(&xf_builds, __ATOMIC_RELAXED);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,89 @@
+/*
+ * Filename:         xattr_filter.h
+ * Description:      Per-inode Bloom filter over xattr names
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _XATTR_FILTER_H
+#define _XATTR_FILTER_H
+
+#include <stdint.h>
+
+/* A Bloom filter over the xattr names of an inode, built from one scan of
+ * its cortxfs_xattr keys, lets a getxattr of a name which definitely does
+ * not exist return without an index round trip.
+ *
+ * Filters live in a direct-mapped table of XATTR_FILTER_SLOTS entries, so
+ * memory is bounded and a colliding inode simply replaces the older one.
+ * Names are added before they are written to the index, and no filter is
+ * installed while such a write is in flight, so the filter never misses a
+ * stored name. A Bloom filter cannot forget a name: removes only count
+ * towards a rebuild, as do adds beyond the capacity the filter was sized
+ * for, since both raise the false positive rate. The filter is then
+ * dropped, and rebuilt once lookups miss again.
+ *
+ * A build scans all names of the inode, which only pays off for an inode
+ * that keeps being asked for names it does not have. So a filter is only
+ * built after XATTR_FILTER_BUILD_MISSES negative GETs of its inode, and
+ * a working set larger than the table, or builds discarded by concurrent
+ * sets, cost a counter per miss rather than a scan.
+ *
+ * As with xattr_cache, a build that races with a set or remove of the same
+ * slot is discarded, and only changes made through this process are seen.
+ */
+
+#define XATTR_FILTER_SLOTS	16384
+/* About 1% false positives at capacity */
+#define XATTR_FILTER_BITS_PER_KEY	10
+#define XATTR_FILTER_HASHES	7
+#define XATTR_FILTER_MIN_KEYS	32
+/* Negative GETs of an inode before its names are scanned for a filter */
+#define XATTR_FILTER_BUILD_MISSES	4
+
+int xattr_filter_init(void);
+void xattr_filter_fini(void);
+
+/* Returns -ENOENT if @name is definitely not an xattr of @ino, 0 if it may
+ * be one. Without a filter of @ino the answer is 0, unless
+ * XATTR_FILTER_BUILD_MISSES negative GETs were reported for it since the
+ * last build: then the filter is built first, and the answer is 0 only if
+ * that fails or the build is discarded.
+ */
+int xattr_filter_check(uint64_t ino, const char *name);
+
+/* Reports a GET of an xattr of @ino which the filter let through, and
+ * which found none. Misses are counted per slot, and the count restarts
+ * when another inode of the slot misses.
+ */
+void xattr_filter_miss(uint64_t ino);
+
+/* Must be called before @name is written to the index, and be followed by
+ * xattr_filter_added() once the write completed, whether or not it failed.
+ * No filter of the slot is built in between, since its scan could miss
+ * @name.
+ */
+void xattr_filter_add(uint64_t ino, const char *name);
+void xattr_filter_added(uint64_t ino);
+
+/* Called after @name was removed from the index. */
+void xattr_filter_remove(uint64_t ino, const char *name);
+
+/* Forgets the filter of @ino, e.g. once all its xattrs are gone. */
+void xattr_filter_drop(uint64_t ino);
+
+void xattr_filter_stats(uint64_t *negatives, uint64_t *builds);
+
+#endif /* _XATTR_FILTER_H */
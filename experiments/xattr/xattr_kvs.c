@@ -0,0 +1,590 @@
+/*
+ * Filename:         xattr_kvs.c
+ * Description:      Motr index helpers shared by the xattr experiments
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "lib/thread.h"
+#include "xattr_kvs.h"
+
+struct m0_idx xattr_idx;
+
+static struct m0_fid ifid;
+static struct m0_ufid_generator cortxfs_ufid_generator;
+static __thread struct m0_thread xattr_thread;
+static __thread bool xattr_thread_adopted;
+
+int xattr_kvs_init(void)
+{
+	char tmpfid[255];
+	int rc = 0;
+
+	/* Get fid from config parameter */
+	memset(&ifid, 0, sizeof(struct m0_fid));
+	rc = m0_fid_sscanf("<0x780000000000000b:1>", &ifid);
+	if (rc != 0) {
+		fprintf(stderr, "Failed to read ifid value from conf\n");
+		goto err_exit;
+	}
+
+	rc = m0_fid_print(tmpfid, 255, &ifid);
+	if (rc < 0) {
+		fprintf(stderr, "Failed to read ifid value from conf\n");
+		goto err_exit;
+	}
+
+	m0_idx_init(&xattr_idx, &motr_container.co_realm,
+		    (struct m0_uint128 *)&ifid);
+
+	rc = m0_ufid_init(motr_instance, &cortxfs_ufid_generator);
+	if (rc != 0) {
+		fprintf(stderr, "Failed to initialise fid generator: %d\n", rc);
+		goto err_exit;
+	}
+
+	return 0;
+
+err_exit:
+	return rc;
+}
+
+int xattr_kvs_thread_init(void)
+{
+	int rc;
+
+	if (xattr_thread_adopted)
+		return 0;
+
+	memset(&xattr_thread, 0, sizeof(xattr_thread));
+	rc = m0_thread_adopt(&xattr_thread, motr_instance->m0c_motr);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): m0_thread_adopt\n", rc);
+		return rc;
+	}
+
+	xattr_thread_adopted = true;
+	return 0;
+}
+
+int xattr_kvs_op_rcs(enum m0_idx_opcode opcode, struct m0_bufvec *key,
+		     struct m0_bufvec *val, int32_t *rcs, uint32_t flags)
+{
+	struct m0_op *op = NULL;
+	uint32_t i;
+	int rc;
+
+	rc = m0_idx_op(&xattr_idx, opcode, key, val, rcs, flags, &op);
+	if (rc) {
+		fprintf(stderr, "error(%d): m0_idx_op\n", rc);
+		return rc;
+	}
+
+	m0_op_launch(&op, 1);
+	rc = m0_op_wait(op, M0_BITS(M0_OS_STABLE), M0_TIME_NEVER);
+	if (rc == 0)
+		rc = m0_rc(op);
+
+	/* Check rcs array even if op is succesful */
+	for (i = 0; rc == 0 && i < key->ov_vec.v_nr; i++)
+		rc = rcs[i];
+
+	m0_op_fini(op);
+	m0_op_free(op);
+	return rc;
+}
+
+int xattr_kvs_op(enum m0_idx_opcode opcode, struct m0_bufvec *key,
+		 struct m0_bufvec *val, uint32_t flags)
+{
+	int32_t *rcs;
+	int rc;
+
+	M0_ALLOC_ARR(rcs, key->ov_vec.v_nr);
+	if (rcs == NULL)
+		return -ENOMEM;
+
+	rc = xattr_kvs_op_rcs(opcode, key, val, rcs, flags);
+	m0_free(rcs);
+	return rc;
+}
+
+static __thread struct xattr_bvec xattr_thread_bvec;
+
+struct xattr_bvec *xattr_bvec_get(void)
+{
+	return &xattr_thread_bvec;
+}
+
+void xattr_kvs_thread_fini(void)
+{
+	xattr_bvec_fini(&xattr_thread_bvec);
+
+	if (xattr_thread_adopted) {
+		m0_thread_shun();
+		xattr_thread_adopted = false;
+	}
+}
+
+static int bvec_grow(struct xattr_bvec *bv, uint32_t nr)
+{
+	struct xattr_bvec new;
+	uint32_t cap = bv->cap ? bv->cap : 16;
+
+	while (cap < nr)
+		cap *= 2;
+
+	memset(&new, 0, sizeof(new));
+	M0_ALLOC_ARR(new.key.ov_buf, cap);
+	M0_ALLOC_ARR(new.key.ov_vec.v_count, cap);
+	M0_ALLOC_ARR(new.val.ov_buf, cap);
+	M0_ALLOC_ARR(new.val.ov_vec.v_count, cap);
+	M0_ALLOC_ARR(new.rcs, cap);
+	new.arena = m0_alloc(cap * XATTR_KEY_MAX);
+
+	if (new.key.ov_buf == NULL || new.key.ov_vec.v_count == NULL ||
+	    new.val.ov_buf == NULL || new.val.ov_vec.v_count == NULL ||
+	    new.rcs == NULL || new.arena == NULL) {
+		xattr_bvec_fini(&new);
+		return -ENOMEM;
+	}
+
+	xattr_bvec_fini(bv);
+	new.cap = cap;
+	new.arena_cap = cap * XATTR_KEY_MAX;
+	*bv = new;
+	return 0;
+}
+
+int xattr_bvec_reset(struct xattr_bvec *bv, uint32_t nr)
+{
+	int rc;
+
+	if (nr > bv->cap) {
+		rc = bvec_grow(bv, nr);
+		if (rc)
+			return rc;
+	}
+
+	bv->key.ov_vec.v_nr = nr;
+	bv->val.ov_vec.v_nr = nr;
+	bv->used = 0;
+	return 0;
+}
+
+int xattr_bvec_key(struct xattr_bvec *bv, uint32_t i, uint64_t ino,
+		   const char *name)
+{
+	int len;
+
+	len = xattr_key_init((void *)(bv->arena + bv->used), ino, name);
+	if (len < 0)
+		return len;
+
+	bv->key.ov_buf[i] = bv->arena + bv->used;
+	bv->key.ov_vec.v_count[i] = len;
+	bv->used += len;
+	return 0;
+}
+
+void xattr_bvec_fini(struct xattr_bvec *bv)
+{
+	m0_free(bv->key.ov_buf);
+	m0_free(bv->key.ov_vec.v_count);
+	m0_free(bv->val.ov_buf);
+	m0_free(bv->val.ov_vec.v_count);
+	m0_free(bv->rcs);
+	m0_free(bv->arena);
+	memset(bv, 0, sizeof(*bv));
+}
+
+int xattr_kvs_get_one(uint64_t ino, const char *name, void *value,
+		      size_t *vlen)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	int rc;
+
+	rc = m0_bufvec_alloc(&key, 1, XATTR_KEY_MAX);
+	if (rc)
+		return rc;
+
+	rc = xattr_key_fill(&key, 0, ino, name);
+	if (rc)
+		goto free_key;
+
+	rc = m0_bufvec_empty_alloc(&val, 1);
+	if (rc)
+		goto free_key;
+
+	rc = xattr_kvs_op(M0_IC_GET, &key, &val, 0);
+	if (rc)
+		goto free_val;
+
+	if (val.ov_vec.v_count[0] > *vlen) {
+		rc = -ERANGE;
+		goto free_val;
+	}
+
+	*vlen = val.ov_vec.v_count[0];
+	memcpy(value, val.ov_buf[0], *vlen);
+
+free_val:
+	m0_bufvec_free(&val);
+free_key:
+	m0_bufvec_free(&key);
+	return rc;
+}
+
+int xattr_kvs_put_batch(uint64_t ino, const struct xattr_entry *xe, int nr)
+{
+	struct xattr_bvec *bv = xattr_bvec_get();
+	int rc, i;
+
+	rc = xattr_bvec_reset(bv, nr);
+	if (rc) {
+		fprintf(stderr, "error(%d): xattr_bvec_reset\n", rc);
+		return rc;
+	}
+
+	for (i = 0; i < nr; i++) {
+		rc = xattr_bvec_key(bv, i, ino, xe[i].name);
+		if (rc)
+			return rc;
+		xattr_bvec_val(bv, i, xe[i].value, xe[i].vlen);
+	}
+
+	rc = xattr_kvs_op_rcs(M0_IC_PUT, &bv->key, &bv->val, bv->rcs,
+			      M0_OIF_OVERWRITE);
+	if (rc)
+		fprintf(stderr, "error(%d): xattr_kvs_op PUT\n", rc);
+
+	return rc;
+}
+
+int xattr_kvs_del_batch(uint64_t ino, const struct xattr_entry *xe, int nr)
+{
+	struct xattr_bvec *bv = xattr_bvec_get();
+	int rc, i;
+
+	rc = xattr_bvec_reset(bv, nr);
+	if (rc) {
+		fprintf(stderr, "error(%d): xattr_bvec_reset\n", rc);
+		return rc;
+	}
+
+	for (i = 0; i < nr; i++) {
+		rc = xattr_bvec_key(bv, i, ino, xe[i].name);
+		if (rc)
+			return rc;
+	}
+
+	rc = xattr_kvs_op_rcs(M0_IC_DEL, &bv->key, NULL, bv->rcs, 0);
+	if (rc)
+		fprintf(stderr, "error(%d): xattr_kvs_op DEL\n", rc);
+
+	return rc;
+}
+
+/* Frees the records Motr handed back for @pg. The bufvec arrays stay
+ * allocated and are reused by the next page.
+ */
+static void page_release(struct xattr_kvs_page *pg)
+{
+	uint32_t i;
+
+	for (i = 0; i < XATTR_NEXT_MAX; i++) {
+		m0_free(pg->keys.ov_buf[i]);
+		pg->keys.ov_buf[i] = NULL;
+		pg->keys.ov_vec.v_count[i] = 0;
+		m0_free(pg->vals.ov_buf[i]);
+		pg->vals.ov_buf[i] = NULL;
+		pg->vals.ov_vec.v_count[i] = 0;
+	}
+
+	pg->nr = 0;
+	pg->pos = 0;
+	pg->valid = 0;
+}
+
+/* Starts fetching up to it->page_nr records from @start into @pg. */
+static int page_launch(struct xattr_kvs_iter *it, struct xattr_kvs_page *pg,
+		       const void *start, size_t slen, uint32_t flags)
+{
+	int rc;
+
+	pg->start = m0_alloc(slen);
+	if (pg->start == NULL)
+		return -ENOMEM;
+	memcpy(pg->start, start, slen);
+
+	pg->nr = it->page_nr;
+	pg->pos = 0;
+	pg->valid = 0;
+	pg->last = false;
+	pg->keys.ov_vec.v_nr = pg->nr;
+	pg->vals.ov_vec.v_nr = pg->nr;
+	pg->keys.ov_buf[0] = pg->start;
+	pg->keys.ov_vec.v_count[0] = slen;
+
+	rc = m0_idx_op(&xattr_idx, M0_IC_NEXT, &pg->keys, &pg->vals,
+		       pg->rcs, flags, &pg->op);
+	if (rc) {
+		fprintf(stderr, "error(%d): m0_idx_op NEXT\n", rc);
+		pg->keys.ov_buf[0] = NULL;
+		m0_free(pg->start);
+		pg->start = NULL;
+		pg->op = NULL;
+		return rc;
+	}
+
+	m0_op_launch(&pg->op, 1);
+
+	/* Small inodes are done with one short round trip, large ones get
+	 * fewer and larger pages.
+	 */
+	if (it->page_nr < XATTR_NEXT_MAX)
+		it->page_nr *= 2;
+	return 0;
+}
+
+/* Waits for the page in flight and counts its leading records which
+ * still carry the prefix.
+ */
+static int page_wait(struct xattr_kvs_iter *it, struct xattr_kvs_page *pg)
+{
+	uint32_t i;
+	int rc;
+
+	rc = m0_op_wait(pg->op, M0_BITS(M0_OS_STABLE), M0_TIME_NEVER);
+	if (rc == 0)
+		rc = m0_rc(pg->op);
+	m0_op_fini(pg->op);
+	m0_op_free(pg->op);
+	pg->op = NULL;
+
+	/* Motr replaces the start key with the first returned one */
+	if (pg->keys.ov_buf[0] != pg->start)
+		m0_free(pg->start);
+	pg->start = NULL;
+
+	pg->keys.ov_vec.v_nr = XATTR_NEXT_MAX;
+	pg->vals.ov_vec.v_nr = XATTR_NEXT_MAX;
+
+	if (rc == -ENOENT)
+		rc = 0;
+	if (rc) {
+		pg->last = true;
+		return rc;
+	}
+
+	for (i = 0; i < pg->nr; i++)
+		if (pg->rcs[i] != 0 ||
+		    pg->keys.ov_vec.v_count[i] < it->plen ||
+		    memcmp(pg->keys.ov_buf[i], it->prefix, it->plen) != 0)
+			break;
+
+	pg->valid = i;
+	/* A short page means we ran past the prefix or the index */
+	pg->last = i < pg->nr;
+	return 0;
+}
+
+static int page_alloc(struct xattr_kvs_page *pg)
+{
+	int rc;
+
+	memset(pg, 0, sizeof(*pg));
+
+	M0_ALLOC_ARR(pg->rcs, XATTR_NEXT_MAX);
+	if (pg->rcs == NULL)
+		return -ENOMEM;
+
+	rc = m0_bufvec_empty_alloc(&pg->keys, XATTR_NEXT_MAX);
+	if (rc)
+		return rc;
+
+	return m0_bufvec_empty_alloc(&pg->vals, XATTR_NEXT_MAX);
+}
+
+static void page_free(struct xattr_kvs_page *pg)
+{
+	if (pg->op != NULL) {
+		m0_op_wait(pg->op, M0_BITS(M0_OS_STABLE, M0_OS_FAILED),
+			   M0_TIME_NEVER);
+		m0_op_fini(pg->op);
+		m0_op_free(pg->op);
+		if (pg->keys.ov_buf[0] != pg->start)
+			m0_free(pg->start);
+	}
+
+	if (pg->keys.ov_buf != NULL) {
+		pg->keys.ov_vec.v_nr = XATTR_NEXT_MAX;
+		pg->vals.ov_vec.v_nr = XATTR_NEXT_MAX;
+		if (pg->vals.ov_buf != NULL)
+			page_release(pg);
+		m0_bufvec_free(&pg->keys);
+	}
+	if (pg->vals.ov_buf != NULL)
+		m0_bufvec_free(&pg->vals);
+	m0_free(pg->rcs);
+}
+
+int xattr_kvs_iter_init(struct xattr_kvs_iter *it, const void *prefix,
+			size_t plen)
+{
+	int rc;
+
+	if (plen == 0 || plen > sizeof(it->prefix))
+		return -EINVAL;
+
+	memset(it, 0, sizeof(*it));
+	memcpy(it->prefix, prefix, plen);
+	it->plen = plen;
+	it->page_nr = XATTR_NEXT_MIN;
+
+	rc = page_alloc(&it->page[0]);
+	if (rc == 0)
+		rc = page_alloc(&it->page[1]);
+	if (rc == 0)
+		rc = page_launch(it, &it->page[0], prefix, plen, 0);
+
+	if (rc)
+		xattr_kvs_iter_fini(it);
+	return rc;
+}
+
+int xattr_kvs_iter_next(struct xattr_kvs_iter *it, const void **key,
+			size_t *klen, const void **val, size_t *vlen)
+{
+	struct xattr_kvs_page *pg;
+	uint32_t last;
+	int rc;
+
+	for (;;) {
+		pg = &it->page[it->cur];
+
+		if (pg->op != NULL) {
+			rc = page_wait(it, pg);
+			if (rc)
+				return rc;
+
+			/* Read ahead from the last key while the caller
+			 * consumes this page.
+			 */
+			if (!pg->last) {
+				last = pg->nr - 1;
+				rc = page_launch(it, &it->page[!it->cur],
+						 pg->keys.ov_buf[last],
+						 pg->keys.ov_vec.v_count[last],
+						 M0_OIF_EXCLUDE_START_KEY);
+				if (rc)
+					return rc;
+			}
+		}
+
+		if (pg->pos < pg->valid) {
+			*key = pg->keys.ov_buf[pg->pos];
+			*klen = pg->keys.ov_vec.v_count[pg->pos];
+			*val = pg->vals.ov_buf[pg->pos];
+			*vlen = pg->vals.ov_vec.v_count[pg->pos];
+			pg->pos++;
+			return 1;
+		}
+
+		if (pg->last)
+			return 0;
+
+		page_release(pg);
+		it->cur = !it->cur;
+	}
+}
+
+void xattr_kvs_iter_fini(struct xattr_kvs_iter *it)
+{
+	page_free(&it->page[0]);
+	page_free(&it->page[1]);
+}
+
+int xattr_kvs_scan(const void *prefix, size_t plen, xattr_scan_cb_t cb,
+		   void *arg)
+{
+	struct xattr_kvs_iter it;
+	const void *key;
+	const void *val;
+	size_t klen;
+	size_t vlen;
+	int rc;
+
+	rc = xattr_kvs_iter_init(&it, prefix, plen);
+	if (rc)
+		return rc;
+
+	while ((rc = xattr_kvs_iter_next(&it, &key, &klen, &val, &vlen)) > 0)
+		if (!cb(arg, key, klen, val, vlen))
+			break;
+
+	xattr_kvs_iter_fini(&it);
+	return rc < 0 ? rc : 0;
+}
+
+static bool count_cb(void *arg, const void *key, size_t klen,
+		     const void *val, size_t vlen)
+{
+	(void)key;
+	(void)klen;
+	(void)val;
+	(void)vlen;
+
+	(*(int *)arg)++;
+	return true;
+}
+
+/* Walks all records sharing the ino/type prefix of @xkey and returns their
+ * number in @nr.
+ */
+int m0_search_pattern(const struct cortxfs_xattr *xkey, int *nr)
+{
+	*nr = 0;
+	return xattr_kvs_scan(xkey, XATTR_PREFIX_LEN, count_cb, nr);
+}
+
+int xattr_kvs_count(uint64_t ino, int *nr)
+{
+	char buf[XATTR_KEY_MAX];
+	struct cortxfs_xattr *xkey = (struct cortxfs_xattr *)buf;
+
+	xattr_key_init(xkey, ino, NULL);
+	return m0_search_pattern(xkey, nr);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,259 @@
+/*
+ * Filename:         xattr_kvs.h
+ * Description:      Motr index helpers shared by the xattr experiments
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _XATTR_KVS_H
+#define _XATTR_KVS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include "motr/client.h"
+
+#define XATTR_NAME_MAX	255
+/* Per-inode blob of the blob layout, keyed by the bare prefix */
+#define XATTR_BLOB_TYPE	'6'
+#define XATTR_TYPE	'7'
+/* Per-inode record of the hybrid layout, keyed by the bare prefix */
+#define XATTR_INLINE_TYPE	'8'
+/* Base and delta records of the blob_delta layout, {prefix, be64 seq} */
+#define XATTR_DELTA_TYPE	'9'
+
+/* On-wire xattr key: the big-endian inode number and the type byte form a
+ * fixed prefix, so all keys of an inode are adjacent in the index and can be
+ * walked with M0_IC_NEXT. The name follows with an explicit length and
+ * without padding or a terminating NUL; only xattr_key_len() bytes of a key
+ * are sent to the index.
+ */
+struct cortxfs_xattr {
+	uint64_t ino;
+	char type;
+	uint8_t name_len;
+	char name[];
+} __attribute((packed));
+
+#define XATTR_PREFIX_LEN	offsetof(struct cortxfs_xattr, name_len)
+#define XATTR_KEY_MAX		(sizeof(struct cortxfs_xattr) + XATTR_NAME_MAX)
+
+static inline size_t xattr_key_len(const struct cortxfs_xattr *key)
+{
+	return sizeof(*key) + key->name_len;
+}
+
+/* Encodes {ino, name} into @key, which must have room for XATTR_KEY_MAX
+ * bytes, and returns the encoded length. A NULL @name yields the bare
+ * prefix used to start a scan.
+ */
+static inline int xattr_key_init(struct cortxfs_xattr *key, uint64_t ino,
+				 const char *name)
+{
+	size_t len;
+
+	key->ino = htobe64(ino);
+	key->type = XATTR_TYPE;
+
+	if (name == NULL)
+		return XATTR_PREFIX_LEN;
+
+	len = strlen(name);
+	if (len == 0 || len > XATTR_NAME_MAX)
+		return -ENAMETOOLONG;
+
+	key->name_len = len;
+	memcpy(key->name, name, len);
+	return xattr_key_len(key);
+}
+
+/* Validates a key returned by the index and extracts its inode and name.
+ * The name is not NUL-terminated.
+ */
+static inline int xattr_key_parse(const void *buf, size_t len, uint64_t *ino,
+				  const char **name, size_t *name_len)
+{
+	const struct cortxfs_xattr *key = buf;
+
+	if (len < sizeof(*key) || key->type != XATTR_TYPE ||
+	    len != xattr_key_len(key))
+		return -EINVAL;
+
+	*ino = be64toh(key->ino);
+	*name = key->name;
+	*name_len = key->name_len;
+	return 0;
+}
+
+/* Encodes the key of @name into record @i of a bufvec allocated with
+ * XATTR_KEY_MAX sized buffers and trims the record to the key length.
+ */
+static inline int xattr_key_fill(struct m0_bufvec *bv, uint32_t i,
+				 uint64_t ino, const char *name)
+{
+	int len;
+
+	len = xattr_key_init(bv->ov_buf[i], ino, name);
+	if (len < 0)
+		return len;
+
+	bv->ov_vec.v_count[i] = len;
+	return 0;
+}
+
+struct xattr_entry {
+	const char *name;
+	const void *value;
+	size_t vlen;
+};
+
+/* Index used by all layouts, set up by xattr_kvs_init(). */
+extern struct m0_idx xattr_idx;
+
+int xattr_kvs_init(void);
+
+/* Must be called once by every thread, other than the one which ran
+ * c0appz_init(), before it issues Motr operations. Adopts the thread into
+ * Motr; the thread has to call xattr_kvs_thread_fini() before it exits.
+ */
+int xattr_kvs_thread_init(void);
+
+/* Frees the per-thread state set up by this module, see xattr_bvec_get(),
+ * and shuns the thread from Motr if xattr_kvs_thread_init() adopted it.
+ */
+void xattr_kvs_thread_fini(void);
+
+/* Synchronous index operation over all records of @key/@val.
+ * Per-record return codes are checked, the first failure is returned.
+ */
+int xattr_kvs_op(enum m0_idx_opcode opcode, struct m0_bufvec *key,
+		 struct m0_bufvec *val, uint32_t flags);
+
+/* Same, with a caller provided array for the per-record return codes. */
+int xattr_kvs_op_rcs(enum m0_idx_opcode opcode, struct m0_bufvec *key,
+		     struct m0_bufvec *val, int32_t *rcs, uint32_t flags);
+
+/* Reusable key/value bufvecs for batched ops.
+ *
+ * Keys are encoded straight into their final slot in a single arena, and
+ * values are referenced in place from the caller's buffers instead of being
+ * copied, which is fine because PUT only reads them. The bufvec arrays,
+ * the arena and the return code array only ever grow, so once a thread has
+ * seen its largest batch, a batched PUT or DEL does no heap allocation.
+ *
+ * The ov_buf entries point into the arena or into caller memory: never
+ * pass these bufvecs to m0_bufvec_free(), nor to ops which let Motr
+ * allocate returned buffers (GET, NEXT).
+ */
+struct xattr_bvec {
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	int32_t *rcs;
+	uint32_t cap;
+	char *arena;
+	size_t arena_cap;
+	size_t used;
+};
+
+/* The calling thread's instance, freed by xattr_kvs_thread_fini(). */
+struct xattr_bvec *xattr_bvec_get(void);
+
+/* Prepares @bv for @nr records, with room for @nr keys of any length. */
+int xattr_bvec_reset(struct xattr_bvec *bv, uint32_t nr);
+
+/* Encodes the key of record @i in place. */
+int xattr_bvec_key(struct xattr_bvec *bv, uint32_t i, uint64_t ino,
+		   const char *name);
+
+/* Points the value of record @i at @value, which must outlive the op. */
+static inline void xattr_bvec_val(struct xattr_bvec *bv, uint32_t i,
+				  const void *value, size_t vlen)
+{
+	bv->val.ov_buf[i] = (void *)value;
+	bv->val.ov_vec.v_count[i] = vlen;
+}
+
+void xattr_bvec_fini(struct xattr_bvec *bv);
+
+/* Streaming walk over all records whose key starts with a prefix.
+ *
+ * Records are fetched with M0_IC_NEXT in pages which start at
+ * XATTR_NEXT_MIN records and double up to XATTR_NEXT_MAX. As soon as a
+ * page completes the next one is launched from its last key, so the
+ * following round trip overlaps with the caller consuming the current
+ * page. A page which is short or ends past the prefix stops the walk
+ * without a further request. Both pages keep their bufvec arrays for the
+ * whole walk; only the records returned by Motr are freed per page.
+ */
+#define XATTR_NEXT_MIN	16
+#define XATTR_NEXT_MAX	1024
+
+struct xattr_kvs_page {
+	struct m0_bufvec keys;
+	struct m0_bufvec vals;
+	int32_t *rcs;
+	/* In flight when not NULL */
+	struct m0_op *op;
+	void *start;
+	/* Records requested, matching the prefix and handed out */
+	uint32_t nr;
+	uint32_t valid;
+	uint32_t pos;
+	/* No page follows this one */
+	bool last;
+};
+
+struct xattr_kvs_iter {
+	char prefix[XATTR_KEY_MAX];
+	size_t plen;
+	struct xattr_kvs_page page[2];
+	/* Page being consumed */
+	int cur;
+	/* Size of the next page to launch */
+	uint32_t page_nr;
+};
+
+int xattr_kvs_iter_init(struct xattr_kvs_iter *it, const void *prefix,
+			size_t plen);
+/* Returns 1 and the next record, 0 at the end of the prefix or an error.
+ * The record stays valid until the following call.
+ */
+int xattr_kvs_iter_next(struct xattr_kvs_iter *it, const void **key,
+			size_t *klen, const void **val, size_t *vlen);
+/* Waits for any page still in flight and frees the iterator. */
+void xattr_kvs_iter_fini(struct xattr_kvs_iter *it);
+
+/* Calls @cb for every record whose key starts with @prefix, in key order,
+ * until it returns false. Keys and values are only valid during the call.
+ */
+typedef bool (*xattr_scan_cb_t)(void *arg, const void *key, size_t klen,
+				const void *val, size_t vlen);
+
+int xattr_kvs_scan(const void *prefix, size_t plen, xattr_scan_cb_t cb,
+		   void *arg);
+
+/* Per-key record helpers (one cortxfs_xattr key per xattr). */
+int m0_search_pattern(const struct cortxfs_xattr *xkey, int *nr);
+int xattr_kvs_get_one(uint64_t ino, const char *name, void *value,
+		      size_t *vlen);
+int xattr_kvs_count(uint64_t ino, int *nr);
+int xattr_kvs_put_batch(uint64_t ino, const struct xattr_entry *xe, int nr);
+/* Only the names of @xe are used. */
+int xattr_kvs_del_batch(uint64_t ino, const struct xattr_entry *xe, int nr);
+
+#endif /* _XATTR_KVS_H */
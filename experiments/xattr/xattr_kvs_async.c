@@ -0,0 +1,223 @@
+/*
+ * Filename:         xattr_kvs_async.c
+ * Description:      Asynchronous Motr index op submission with a bounded
+ *                   in-flight window
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "xattr_kvs.h"
+#include "xattr_kvs_async.h"
+
+/* Runs from a Motr thread: only record the outcome and queue the op. */
+static void aop_complete(struct m0_op *op)
+{
+	struct xattr_kvs_aop *aop = op->op_datum;
+	struct xattr_kvs_async *engine = aop->engine;
+	uint32_t i;
+	int rc;
+
+	rc = m0_rc(op);
+	for (i = 0; rc == 0 && i < aop->key->ov_vec.v_nr; i++)
+		rc = aop->rcs[i];
+
+	pthread_mutex_lock(&engine->lock);
+	aop->rc = rc;
+	aop->next = NULL;
+	if (engine->cq_tail != NULL)
+		engine->cq_tail->next = aop;
+	else
+		engine->cq_head = aop;
+	engine->cq_tail = aop;
+	engine->inflight--;
+	pthread_cond_broadcast(&engine->cond);
+	pthread_mutex_unlock(&engine->lock);
+}
+
+static const struct m0_op_ops aop_ops = {
+	.oop_executed = NULL,
+	.oop_stable = aop_complete,
+	.oop_failed = aop_complete,
+};
+
+int xattr_kvs_async_init(struct xattr_kvs_async *engine, int window)
+{
+	if (window <= 0)
+		return -EINVAL;
+
+	memset(engine, 0, sizeof(*engine));
+	pthread_mutex_init(&engine->lock, NULL);
+	pthread_cond_init(&engine->cond, NULL);
+	engine->window = window;
+	return 0;
+}
+
+void xattr_kvs_async_fini(struct xattr_kvs_async *engine)
+{
+	while (xattr_kvs_async_wait(engine) != NULL)
+		;
+
+	pthread_cond_destroy(&engine->cond);
+	pthread_mutex_destroy(&engine->lock);
+}
+
+static int aop_prepare(struct xattr_kvs_aop *aop)
+{
+	uint32_t nr = aop->key->ov_vec.v_nr;
+	int32_t *rcs;
+
+	if (nr > aop->rcs_cap) {
+		M0_ALLOC_ARR(rcs, nr);
+		if (rcs == NULL)
+			return -ENOMEM;
+		m0_free(aop->rcs);
+		aop->rcs = rcs;
+		aop->rcs_cap = nr;
+	}
+
+	memset(aop->rcs, 0, nr * sizeof(*aop->rcs));
+	aop->rc = 0;
+	aop->op = NULL;
+	aop->next = NULL;
+	return 0;
+}
+
+int xattr_kvs_async_submit(struct xattr_kvs_async *engine,
+			   struct xattr_kvs_aop *aop, bool block)
+{
+	int rc;
+
+	rc = aop_prepare(aop);
+	if (rc)
+		return rc;
+
+	/* Take the slot before building the op, so back-pressure applies
+	 * before any Motr resources are allocated.
+	 */
+	pthread_mutex_lock(&engine->lock);
+	while (engine->inflight >= engine->window) {
+		if (!block) {
+			pthread_mutex_unlock(&engine->lock);
+			return -EAGAIN;
+		}
+		pthread_cond_wait(&engine->cond, &engine->lock);
+	}
+	engine->inflight++;
+	pthread_mutex_unlock(&engine->lock);
+
+	rc = m0_idx_op(&xattr_idx, aop->opcode, aop->key, aop->val,
+		       aop->rcs, aop->flags, &aop->op);
+	if (rc) {
+		fprintf(stderr, "error(%d): m0_idx_op\n", rc);
+		pthread_mutex_lock(&engine->lock);
+		engine->inflight--;
+		pthread_cond_broadcast(&engine->cond);
+		pthread_mutex_unlock(&engine->lock);
+		return rc;
+	}
+
+	aop->engine = engine;
+	aop->op->op_datum = aop;
+	m0_op_setup(aop->op, &aop_ops, 0);
+	m0_op_launch(&aop->op, 1);
+	return 0;
+}
+
+/* Pops the oldest completion; called with the lock held. */
+static struct xattr_kvs_aop *cq_pop(struct xattr_kvs_async *engine)
+{
+	struct xattr_kvs_aop *aop = engine->cq_head;
+
+	if (aop == NULL)
+		return NULL;
+
+	engine->cq_head = aop->next;
+	if (engine->cq_head == NULL)
+		engine->cq_tail = NULL;
+	aop->next = NULL;
+	return aop;
+}
+
+static void aop_reap(struct xattr_kvs_aop *aop)
+{
+	m0_op_fini(aop->op);
+	m0_op_free(aop->op);
+	aop->op = NULL;
+}
+
+struct xattr_kvs_aop *xattr_kvs_async_poll(struct xattr_kvs_async *engine)
+{
+	struct xattr_kvs_aop *aop;
+
+	pthread_mutex_lock(&engine->lock);
+	aop = cq_pop(engine);
+	pthread_mutex_unlock(&engine->lock);
+
+	if (aop != NULL)
+		aop_reap(aop);
+	return aop;
+}
+
+struct xattr_kvs_aop *xattr_kvs_async_wait(struct xattr_kvs_async *engine)
+{
+	struct xattr_kvs_aop *aop;
+
+	pthread_mutex_lock(&engine->lock);
+	while (engine->cq_head == NULL && engine->inflight > 0)
+		pthread_cond_wait(&engine->cond, &engine->lock);
+	aop = cq_pop(engine);
+	pthread_mutex_unlock(&engine->lock);
+
+	if (aop != NULL)
+		aop_reap(aop);
+	return aop;
+}
+
+int xattr_kvs_async_drain(struct xattr_kvs_async *engine)
+{
+	struct xattr_kvs_aop *aop;
+	int rc = 0;
+
+	while ((aop = xattr_kvs_async_wait(engine)) != NULL)
+		if (rc == 0)
+			rc = aop->rc;
+
+	return rc;
+}
+
+void xattr_kvs_aop_fini(struct xattr_kvs_aop *aop)
+{
+	m0_free(aop->rcs);
+	aop->rcs = NULL;
+	aop->rcs_cap = 0;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,107 @@
+/*
+ * Filename:         xattr_kvs_async.h
+ * Description:      Asynchronous Motr index op submission with a bounded
+ *                   in-flight window
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _XATTR_KVS_ASYNC_H
+#define _XATTR_KVS_ASYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "motr/client.h"
+
+/* An engine launches index ops on xattr_idx without waiting for them and
+ * hands them back through a completion queue once they are stable or
+ * failed. At most @window ops are in flight; submitting beyond that blocks,
+ * or fails with -EAGAIN for a non-blocking submit, until one completes.
+ *
+ * The caller owns every xattr_kvs_aop and the bufvecs it points to, and
+ * must keep them alive from submit until the aop is reaped from the
+ * completion queue. An aop may be resubmitted after it was reaped; its
+ * result array is kept and only grows, so a steady stream of same-sized
+ * ops does not allocate. The Motr op is finalised when it is reaped, never
+ * from the Motr callback.
+ *
+ * Any thread may submit, poll or wait, but each thread must have called
+ * xattr_kvs_thread_init() first.
+ */
+
+struct xattr_kvs_async;
+
+struct xattr_kvs_aop {
+	enum m0_idx_opcode opcode;
+	struct m0_bufvec *key;
+	struct m0_bufvec *val;
+	uint32_t flags;
+	/* Opaque to the engine */
+	void *datum;
+
+	/* Results, valid once reaped: m0_rc() or the first failing record */
+	int rc;
+	/* Per-record return codes, key->ov_vec.v_nr of them */
+	int32_t *rcs;
+
+	/* Engine private */
+	uint32_t rcs_cap;
+	struct m0_op *op;
+	struct xattr_kvs_async *engine;
+	struct xattr_kvs_aop *next;
+};
+
+struct xattr_kvs_async {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int window;
+	int inflight;
+	/* Completed ops, oldest first */
+	struct xattr_kvs_aop *cq_head;
+	struct xattr_kvs_aop *cq_tail;
+};
+
+int xattr_kvs_async_init(struct xattr_kvs_async *engine, int window);
+/* Waits for all ops in flight. Completed ops which were not reaped are
+ * finalised and dropped.
+ */
+void xattr_kvs_async_fini(struct xattr_kvs_async *engine);
+
+/* Launches @aop. With @block the call waits for a free slot in the window,
+ * otherwise a full window returns -EAGAIN.
+ */
+int xattr_kvs_async_submit(struct xattr_kvs_async *engine,
+			   struct xattr_kvs_aop *aop, bool block);
+
+/* Returns the oldest completed op, or NULL if none has completed yet. */
+struct xattr_kvs_aop *xattr_kvs_async_poll(struct xattr_kvs_async *engine);
+
+/* Like poll but blocks until an op completes. Returns NULL only when
+ * nothing is in flight and the completion queue is empty.
+ */
+struct xattr_kvs_aop *xattr_kvs_async_wait(struct xattr_kvs_async *engine);
+
+/* Reaps every op until none is left in flight and returns the first
+ * failure among them.
+ */
+int xattr_kvs_async_drain(struct xattr_kvs_async *engine);
+
+/* Frees the result array of an aop which is not going to be submitted
+ * again.
+ */
+void xattr_kvs_aop_fini(struct xattr_kvs_aop *aop);
+
+#endif /* _XATTR_KVS_ASYNC_H */
@@ -0,0 +1,78 @@
+/*
+ * Filename:         xattr_layout.h
+ * Description:      Pluggable xattr storage layouts for xattr_bench
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _XATTR_LAYOUT_H
+#define _XATTR_LAYOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "xattr_kvs.h"
+
+struct xattr_layout_params {
+	/* Largest value the benchmark will store */
+	size_t max_vlen;
+	/* Keys carried by one index op, for layouts that split batches */
+	int op_keys;
+	/* Largest value the hybrid layout keeps in its per-inode record */
+	size_t inline_max;
+	/* Ops in flight at once, for layouts that submit asynchronously */
+	int window;
+	/* Memory budget of the xattr cache, 0 for the default */
+	size_t cache_bytes;
+};
+
+/* A storage layout maps the xattrs of an inode onto index records.
+ * All calls are synchronous and may be issued concurrently for different
+ * inodes; a layout is not required to serialise calls on the same inode.
+ * set and del receive one benchmark batch and may use as many index ops
+ * as the layout needs.
+ */
+struct xattr_layout {
+	const char *name;
+	int (*init)(const struct xattr_layout_params *params);
+	void (*fini)(void);
+	int (*set)(uint64_t ino, const struct xattr_entry *xe, int nr);
+	/* On entry @vlen is the size of @value, on return the value length */
+	int (*get)(uint64_t ino, const char *name, void *value, size_t *vlen);
+	int (*list)(uint64_t ino, int *nr);
+	int (*del)(uint64_t ino, const struct xattr_entry *xe, int nr);
+	/* Optional: drops what the layout cached about @ino after its records
+	 * were written or removed behind its back, by clone or reclaim
+	 */
+	void (*forget)(uint64_t ino);
+};
+
+/* approach1.c: one cortxfs_xattr record per xattr */
+extern const struct xattr_layout xattr_layout_kv;
+/* approach2.c: one name-sorted binary blob per inode */
+extern const struct xattr_layout xattr_layout_blob;
+/* approach1_async.c: per-xattr records, batches split into windowed
+ * asynchronous ops
+ */
+extern const struct xattr_layout xattr_layout_kv_async;
+/* approach3.c: small xattrs in one per-inode record, large ones per key */
+extern const struct xattr_layout xattr_layout_hybrid;
+/* approach2_delta.c: blob per inode updated through appended deltas */
+extern const struct xattr_layout xattr_layout_blob_delta;
+/* approach1_cached.c: per-xattr records behind xattr_cache */
+extern const struct xattr_layout xattr_layout_kv_cache;
+/* approach1_cached.c: kv_cache plus a per-inode name filter */
+extern const struct xattr_layout xattr_layout_kv_cache_filter;
+
+#endif /* _XATTR_LAYOUT_H */
@@ -0,0 +1,302 @@
+/*
+ * Filename:         xattr_reclaim.c
+ * Description:      Removal of all xattr records of an inode
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "xattr_kvs.h"
+#include "xattr_kvs_async.h"
+#include "xattr_reclaim.h"
+
+/* One DEL op worth of keys copied out of the scan. */
+struct del_slot {
+	struct xattr_kvs_aop aop;
+	struct m0_bufvec key;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	bool running;
+	bool stop;
+	/* The reclaimer is working on an inode it took off the queue */
+	bool busy;
+	uint64_t queue[XATTR_RECLAIM_QUEUE_LEN];
+	int head;
+	int len;
+} reclaimer = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+/* A record deleted by someone else meanwhile is fine. */
+static int del_result(const struct xattr_kvs_aop *aop)
+{
+	uint32_t i;
+
+	if (aop->rc == 0 || aop->rc != -ENOENT)
+		return aop->rc;
+
+	for (i = 0; i < aop->key->ov_vec.v_nr; i++)
+		if (aop->rcs[i] != 0 && aop->rcs[i] != -ENOENT)
+			return aop->rcs[i];
+
+	return 0;
+}
+
+/* Copies up to XATTR_RECLAIM_BATCH keys from the scan into @slot. */
+static int slot_fill(struct del_slot *slot, struct xattr_kvs_iter *it,
+		     uint32_t *nr)
+{
+	const void *key;
+	const void *val;
+	size_t klen;
+	size_t vlen;
+	int rc = 0;
+
+	*nr = 0;
+	slot->key.ov_vec.v_nr = XATTR_RECLAIM_BATCH;
+
+	while (*nr < XATTR_RECLAIM_BATCH &&
+	       (rc = xattr_kvs_iter_next(it, &key, &klen, &val, &vlen)) > 0) {
+		if (klen > XATTR_KEY_MAX)
+			return -EINVAL;
+
+		memcpy(slot->key.ov_buf[*nr], key, klen);
+		slot->key.ov_vec.v_count[*nr] = klen;
+		(*nr)++;
+	}
+
+	return rc < 0 ? rc : 0;
+}
+
+int xattr_kvs_del_prefix(const void *prefix, size_t plen, int *nr)
+{
+	struct del_slot slots[XATTR_RECLAIM_WINDOW];
+	struct del_slot *free_slot[XATTR_RECLAIM_WINDOW];
+	struct xattr_kvs_async engine;
+	struct xattr_kvs_aop *aop;
+	struct xattr_kvs_iter it;
+	struct del_slot *slot;
+	int nfree = 0;
+	int deleted = 0;
+	uint32_t cnt;
+	int rc, rc2, i;
+
+	memset(slots, 0, sizeof(slots));
+	for (i = 0; i < XATTR_RECLAIM_WINDOW; i++) {
+		rc = m0_bufvec_alloc(&slots[i].key, XATTR_RECLAIM_BATCH,
+				     XATTR_KEY_MAX);
+		if (rc)
+			goto free_slots;
+		slots[i].aop.opcode = M0_IC_DEL;
+		slots[i].aop.key = &slots[i].key;
+		slots[i].aop.datum = &slots[i];
+		free_slot[nfree++] = &slots[i];
+	}
+
+	rc = xattr_kvs_async_init(&engine, XATTR_RECLAIM_WINDOW);
+	if (rc)
+		goto free_slots;
+
+	rc = xattr_kvs_iter_init(&it, prefix, plen);
+	if (rc)
+		goto fini_engine;
+
+	for (;;) {
+		/* Reuse the slot of the oldest DEL once all are in flight */
+		if (nfree == 0) {
+			aop = xattr_kvs_async_wait(&engine);
+			rc = del_result(aop);
+			if (rc)
+				break;
+			free_slot[nfree++] = aop->datum;
+		}
+
+		slot = free_slot[--nfree];
+		rc = slot_fill(slot, &it, &cnt);
+		if (rc || cnt == 0)
+			break;
+
+		slot->key.ov_vec.v_nr = cnt;
+		rc = xattr_kvs_async_submit(&engine, &slot->aop, true);
+		if (rc)
+			break;
+		deleted += cnt;
+	}
+
+	while ((aop = xattr_kvs_async_wait(&engine)) != NULL) {
+		rc2 = del_result(aop);
+		if (rc == 0)
+			rc = rc2;
+	}
+
+	xattr_kvs_iter_fini(&it);
+fini_engine:
+	xattr_kvs_async_fini(&engine);
+free_slots:
+	for (i = 0; i < XATTR_RECLAIM_WINDOW; i++) {
+		xattr_kvs_aop_fini(&slots[i].aop);
+		if (slots[i].key.ov_buf != NULL) {
+			slots[i].key.ov_vec.v_nr = XATTR_RECLAIM_BATCH;
+			m0_bufvec_free(&slots[i].key);
+		}
+	}
+
+	if (rc == 0 && nr != NULL)
+		*nr = deleted;
+	return rc;
+}
+
+int xattr_reclaim_ino(uint64_t ino)
+{
+	static const char types[] = {
+		XATTR_BLOB_TYPE,
+		XATTR_INLINE_TYPE,
+		XATTR_DELTA_TYPE,
+		XATTR_TYPE,
+	};
+	struct cortxfs_xattr prefix;
+	size_t i;
+	int rc;
+
+	for (i = 0; i < sizeof(types); i++) {
+		xattr_key_init(&prefix, ino, NULL);
+		prefix.type = types[i];
+
+		rc = xattr_kvs_del_prefix(&prefix, XATTR_PREFIX_LEN, NULL);
+		if (rc) {
+			fprintf(stderr, "error(%d): reclaim of %llu\n", rc,
+				(unsigned long long)ino);
+			return rc;
+		}
+	}
+
+	return 0;
+}
+
+static void *reclaimer_fn(void *arg)
+{
+	uint64_t ino;
+
+	(void)arg;
+	xattr_kvs_thread_init();
+
+	pthread_mutex_lock(&reclaimer.lock);
+	for (;;) {
+		while (reclaimer.len == 0 && !reclaimer.stop)
+			pthread_cond_wait(&reclaimer.cond, &reclaimer.lock);
+
+		/* Drain the queue before stopping */
+		if (reclaimer.len == 0)
+			break;
+
+		ino = reclaimer.queue[reclaimer.head];
+		reclaimer.head = (reclaimer.head + 1) % XATTR_RECLAIM_QUEUE_LEN;
+		reclaimer.len--;
+		reclaimer.busy = true;
+		pthread_mutex_unlock(&reclaimer.lock);
+
+		xattr_reclaim_ino(ino);
+
+		pthread_mutex_lock(&reclaimer.lock);
+		reclaimer.busy = false;
+		pthread_cond_broadcast(&reclaimer.cond);
+	}
+	pthread_mutex_unlock(&reclaimer.lock);
+
+	xattr_kvs_thread_fini();
+	return NULL;
+}
+
+int xattr_reclaim_start(void)
+{
+	int rc;
+
+	pthread_mutex_lock(&reclaimer.lock);
+	reclaimer.stop = false;
+	reclaimer.head = 0;
+	reclaimer.len = 0;
+
+	rc = pthread_create(&reclaimer.thread, NULL, reclaimer_fn, NULL);
+	reclaimer.running = rc == 0;
+	pthread_mutex_unlock(&reclaimer.lock);
+
+	return -rc;
+}
+
+void xattr_reclaim_stop(void)
+{
+	pthread_mutex_lock(&reclaimer.lock);
+	if (!reclaimer.running) {
+		pthread_mutex_unlock(&reclaimer.lock);
+		return;
+	}
+	reclaimer.stop = true;
+	pthread_cond_broadcast(&reclaimer.cond);
+	pthread_mutex_unlock(&reclaimer.lock);
+
+	pthread_join(reclaimer.thread, NULL);
+
+	pthread_mutex_lock(&reclaimer.lock);
+	reclaimer.running = false;
+	pthread_mutex_unlock(&reclaimer.lock);
+}
+
+int xattr_reclaim_defer(uint64_t ino)
+{
+	pthread_mutex_lock(&reclaimer.lock);
+	if (!reclaimer.running || reclaimer.stop ||
+	    reclaimer.len == XATTR_RECLAIM_QUEUE_LEN) {
+		pthread_mutex_unlock(&reclaimer.lock);
+		return xattr_reclaim_ino(ino);
+	}
+
+	reclaimer.queue[(reclaimer.head + reclaimer.len++) %
+			XATTR_RECLAIM_QUEUE_LEN] = ino;
+	pthread_cond_broadcast(&reclaimer.cond);
+	pthread_mutex_unlock(&reclaimer.lock);
+	return 0;
+}
+
+void xattr_reclaim_flush(void)
+{
+	pthread_mutex_lock(&reclaimer.lock);
+	while (reclaimer.running && (reclaimer.len > 0 || reclaimer.busy))
+		pthread_cond_wait(&reclaimer.cond, &reclaimer.lock);
+	pthread_mutex_unlock(&reclaimer.lock);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,58 @@
+/*
+ * Filename:         xattr_reclaim.h
+ * Description:      Removal of all xattr records of an inode
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _XATTR_RECLAIM_H
+#define _XATTR_RECLAIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Keys per DEL op and DEL ops in flight during a prefix delete */
+#define XATTR_RECLAIM_BATCH	128
+#define XATTR_RECLAIM_WINDOW	4
+/* Inodes the background reclaimer can hold before callers reclaim inline */
+#define XATTR_RECLAIM_QUEUE_LEN	1024
+
+/* Deletes every record whose key starts with @prefix without knowing the
+ * names: the keys are streamed with xattr_kvs_iter and deleted in batches
+ * of XATTR_RECLAIM_BATCH, with up to XATTR_RECLAIM_WINDOW DEL ops in flight
+ * while the scan goes on. Keys which are already gone are not an error.
+ * @nr, if not NULL, returns the number of keys deleted.
+ */
+int xattr_kvs_del_prefix(const void *prefix, size_t plen, int *nr);
+
+/* Deletes all xattr records of @ino, whatever layout wrote them: the
+ * blob and hybrid records first, the latter so it never refers to a
+ * missing spilled value, then the blob_delta records and the per-xattr
+ * keys.
+ */
+int xattr_reclaim_ino(uint64_t ino);
+
+/* Background reclaimer, so that unlink does not wait for the deletes.
+ * xattr_reclaim_defer() queues @ino, or reclaims it inline when the queue
+ * is full or the reclaimer is not running. The caller must ensure @ino
+ * gets no new xattrs until it is reclaimed, e.g. by not reusing it.
+ */
+int xattr_reclaim_start(void);
+void xattr_reclaim_stop(void);
+int xattr_reclaim_defer(uint64_t ino);
+/* Waits until every queued inode has been reclaimed. */
+void xattr_reclaim_flush(void);
+
+#endif /* _XATTR_RECLAIM_H */